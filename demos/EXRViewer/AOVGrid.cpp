@@ -0,0 +1,342 @@
+#include "AOVGrid.h"
+
+#include <iostream>
+#include <algorithm>
+#include <chrono>
+#include <map>
+#include <array>
+#include <climits>
+
+#include "imgui.h"
+#include "helpers.h" // glformat_from_channels
+
+AOVGrid::AOVGrid(int width, int height) : m_width(width), m_height(height)
+{
+    m_worker = std::thread(&AOVGrid::worker_loop, this);
+}
+
+AOVGrid::~AOVGrid()
+{
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_stop = true;
+        m_generation++; // stop a decode after its current band
+    }
+    m_cv.notify_all();
+    m_worker.join();
+
+    for (auto& cell : m_cells) {
+        if (cell.texture) glDeleteTextures(1, &cell.texture);
+    }
+}
+
+bool AOVGrid::load(BaseSequenceReader* reader, int frame, const std::vector<Layer>& layers)
+{
+    // whole frames: the grid shows every layer, not the visible region
+    ReadRequest request{ frame, -1, {}, { 0,0,0,0 }, level };
+
+    // display pixels averaged per thumbnail pixel, a power of two so resizing the window does not decode again on every step
+    // at least the size of a level pixel, so a decoded level leaves no gaps
+    int factor = 1;
+    while (factor * 2 <= m_width / m_cell_width) factor *= 2;
+    factor = std::max(factor, 1 << level);
+
+    bool same_layers = layers.size() == m_cells.size();
+    for (auto i = 0; same_layers && i < layers.size(); i++) {
+        same_layers = layers[i].part == m_cells[i].layer.part && layers[i].channels == m_cells[i].layer.channels;
+    }
+    if (same_layers && request == m_loaded.request && factor == m_loaded.factor && reader == m_loaded.reader) return false;
+
+    if (!same_layers)
+    {
+        for (auto& cell : m_cells) {
+            if (cell.texture) glDeleteTextures(1, &cell.texture);
+        }
+        m_cells.clear();
+        for (const auto& layer : layers) {
+            Cell cell;
+            cell.layer = layer;
+            cell.channels = std::vector<std::string>(layer.channels.begin(), layer.channels.begin() + std::min((size_t)4, layer.channels.size()));
+            m_cells.push_back(std::move(cell));
+        }
+    }
+
+    Job job{ reader, request, factor };
+    for (const auto& cell : m_cells) {
+        job.parts.push_back(cell.layer.part);
+        job.channels.push_back(cell.channels);
+    }
+    m_loaded = job;
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_job = std::move(job);
+        m_pending = true;
+        m_generation++;
+    }
+    m_cv.notify_one();
+    return true;
+}
+
+void AOVGrid::worker_loop()
+{
+    while (true)
+    {
+        Job job;
+        int generation;
+        {
+            std::unique_lock<std::mutex> lock(m_mutex);
+            m_cv.wait(lock, [&] { return m_stop || m_pending; });
+            if (m_stop) return;
+            job = m_job;
+            generation = m_generation;
+            m_pending = false;
+            m_busy = true;
+        }
+
+        std::vector<Thumbnail> thumbnails;
+        auto start = std::chrono::steady_clock::now();
+        bool finished = false;
+        try {
+            finished = decode(job, generation, &thumbnails);
+        }
+        catch (const std::exception& ex) {
+            std::cerr << "AOVGrid: " << ex.what() << "\n";
+        }
+        auto end = std::chrono::steady_clock::now();
+
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            m_busy = false;
+            finished = finished && generation == m_generation; // the cells may have changed meanwhile
+            if (finished) {
+                m_result = std::move(thumbnails);
+                m_result_changed = true;
+                m_read_seconds = std::chrono::duration<double>(end - start).count();
+            }
+        }
+        if (finished && on_finished) on_finished();
+    }
+}
+
+bool AOVGrid::decode(const Job& job, int generation, std::vector<Thumbnail>* thumbnails)
+{
+    const int factor = job.factor;
+    const int thumb_width = (m_width + factor - 1) / factor;
+    const int thumb_height = (m_height + factor - 1) / factor;
+
+    std::vector<std::vector<float>> sums(job.channels.size());
+    for (auto i = 0; i < job.channels.size(); i++) {
+        sums[i].assign((size_t)thumb_width * thumb_height * job.channels[i].size(), 0.0f);
+    }
+
+    /// one pass over the rows for the layers of each part
+    std::map<int, std::vector<int>> parts; // cells of each part
+    for (auto i = 0; i < job.parts.size(); i++) {
+        parts[job.parts[i]].push_back(i);
+    }
+
+    int passes = 0;
+    std::vector<bool> valid(job.channels.size(), false);
+    std::vector<std::vector<float>> counts(job.channels.size()); // pixels summed in each thumbnail pixel, per cell
+    for (const auto& [part, cells] : parts)
+    {
+        // bands of whole blocks. a band is read at the requested level or a finer one, so its rows are sized for level 0
+        const int block = job.reader->block_rows(job.request.frame, part);
+        int band = m_height; // a single read when the reader decodes whole frames
+        int scratch_rows = m_height;
+        if (block > 0) {
+            const int step = block << job.request.level;
+            band = std::min(m_height, (std::max(band_rows, step) + step - 1) / step * step);
+            scratch_rows = band + 2 * block; // a band is widened to whole blocks on both sides
+        }
+
+        std::vector<std::vector<std::string>> groups;
+        std::vector<size_t> offsets;
+        size_t bytes = 0;
+        for (int i : cells) {
+            groups.push_back(job.channels[i]);
+            offsets.push_back(bytes);
+            bytes += (size_t)m_width * scratch_rows * job.channels[i].size() * sizeof(half);
+        }
+        FramePool::Buffer scratch = FramePool::global().acquire(bytes);
+        std::vector<void*> memories;
+        for (auto offset : offsets) memories.push_back((char*)scratch.get() + offset);
+
+        std::vector<float> count((size_t)thumb_width * thumb_height, 0.0f);
+        bool success = true;
+        int done = INT_MIN; // display rows summed already
+        for (int y = 0; y < m_height;)
+        {
+            {
+                std::lock_guard<std::mutex> lock(m_mutex);
+                if (generation != m_generation) return false;
+            }
+
+            ReadRequest request = job.request;
+            request.part = part;
+            request.roi = { 0, y, m_width, band };
+            if (band >= m_height) request.roi = { 0,0,0,0 };
+            std::tuple<int, int, int, int> bbox;
+            int decoded_level{ 0 };
+            success = job.reader->read_groups(request, groups, memories, &bbox, &decoded_level) && success;
+            passes++;
+            auto [bx, by, bw, bh] = bbox;
+            if (!success || bh <= 0) {
+                y += band;
+                continue;
+            }
+
+            /// sum the decoded rows into the thumbnails
+            const int scale = 1 << decoded_level; // display pixels of a decoded pixel, at most factor
+            for (int row = 0; row < bh; row++)
+            {
+                const int display_y = (by + row) * scale;
+                if (display_y < std::max(0, done) || display_y >= m_height) continue;
+                const int ty = display_y / factor;
+                for (int col = 0; col < bw; col++)
+                {
+                    const int display_x = (bx + col) * scale;
+                    if (display_x < 0 || display_x >= m_width) continue;
+                    const size_t t = (size_t)ty * thumb_width + display_x / factor;
+                    count[t] += 1.0f;
+                    for (auto c = 0; c < cells.size(); c++)
+                    {
+                        const int nchannels = (int)groups[c].size();
+                        const half* src = (const half*)memories[c] + ((size_t)row * bw + col) * nchannels;
+                        float* dst = sums[cells[c]].data() + t * nchannels;
+                        for (int k = 0; k < nchannels; k++) dst[k] += src[k];
+                    }
+                }
+            }
+            const int end = (by + bh) * scale;
+            done = std::max(done, end);
+            y = std::max(y + 1, end);
+        }
+
+        for (int i : cells) {
+            valid[i] = success;
+            counts[i] = count;
+        }
+    }
+
+    /// average
+    thumbnails->resize(job.channels.size());
+    for (auto i = 0; i < job.channels.size(); i++)
+    {
+        auto& thumbnail = (*thumbnails)[i];
+        thumbnail.width = thumb_width;
+        thumbnail.height = thumb_height;
+        thumbnail.valid = valid[i];
+        thumbnail.pixels = std::move(sums[i]);
+        const size_t nchannels = job.channels[i].size();
+        for (size_t t = 0; t < counts[i].size(); t++) {
+            if (counts[i][t] == 0) continue;
+            for (size_t k = 0; k < nchannels; k++) thumbnail.pixels[t * nchannels + k] /= counts[i][t];
+        }
+    }
+
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_passes = passes;
+    return true;
+}
+
+void AOVGrid::upload(Cell& cell, const Thumbnail& thumbnail)
+{
+    std::array<GLint, 4> swizzle_mask;
+    const GLenum glformat = glformat_from_channels(cell.channels, swizzle_mask);
+    cell.valid = thumbnail.valid && glformat != -1 && thumbnail.width > 0 && thumbnail.height > 0;
+    if (!cell.valid) return;
+
+    if (!cell.texture) {
+        glGenTextures(1, &cell.texture);
+        glBindTexture(GL_TEXTURE_2D, cell.texture);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+    }
+    glBindTexture(GL_TEXTURE_2D, cell.texture);
+    glTexParameteriv(GL_TEXTURE_2D, GL_TEXTURE_SWIZZLE_RGBA, swizzle_mask.data());
+    const GLint internalformats[]{ GL_R16F, GL_RG16F, GL_RGB16F, GL_RGBA16F }; // halves, as many channels as the layer
+    glTexImage2D(GL_TEXTURE_2D, 0, internalformats[cell.channels.size() - 1], thumbnail.width, thumbnail.height, 0, glformat, GL_FLOAT, thumbnail.pixels.data());
+    glBindTexture(GL_TEXTURE_2D, 0);
+    cell.width = thumbnail.width;
+    cell.height = thumbnail.height;
+}
+
+int AOVGrid::onGUI(const Layer* selected)
+{
+    /// upload the thumbnails decoded since the last draw
+    double read_seconds;
+    int passes;
+    bool busy;
+    {
+        std::vector<Thumbnail> thumbnails;
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            if (m_result_changed) thumbnails = std::move(m_result);
+            m_result_changed = false;
+            read_seconds = m_read_seconds;
+            passes = m_passes;
+            busy = m_busy || m_pending;
+        }
+        if (!thumbnails.empty() && thumbnails.size() == m_cells.size())
+        {
+            auto start = std::chrono::steady_clock::now();
+            for (auto i = 0; i < m_cells.size(); i++) {
+                upload(m_cells[i], thumbnails[i]);
+            }
+            m_upload_seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+        }
+    }
+
+    ImGui::SetNextItemWidth(ImGui::GetTextLineHeight() * 6);
+    ImGui::SliderInt("columns", &columns, 1, 8);
+    ImGui::SameLine();
+    ImGui::SetNextItemWidth(ImGui::GetTextLineHeight() * 6);
+    ImGui::SliderInt("level", &level, 0, 4);
+    if (ImGui::IsItemHovered()) ImGui::SetTooltip("resolution level of the thumbnails, for tiled files with levels");
+    ImGui::SameLine();
+    ImGui::Text("%d layers, %d passes, read: %.1f ms, upload: %.1f ms%s", (int)m_cells.size(), passes, read_seconds * 1000, m_upload_seconds * 1000, busy ? ", decoding" : "");
+
+    /// thumbnails
+    int clicked = -1;
+    const float spacing = ImGui::GetStyle().ItemSpacing.x;
+    const float cell_width = std::max(1.0f, (ImGui::GetContentRegionAvail().x - spacing * (columns - 1)) / columns);
+    m_cell_width = cell_width; // the next load decodes to this size
+    for (auto i = 0; i < m_cells.size(); i++)
+    {
+        const auto& cell = m_cells[i];
+        ImGui::PushID(i);
+        if (i % columns != 0) ImGui::SameLine();
+        ImGui::BeginGroup();
+        {
+            const float aspect = cell.valid ? (float)cell.height / cell.width : (float)m_height / m_width;
+            const ImVec2 size(cell_width, cell_width * aspect);
+            if (cell.valid) {
+                ImGui::Image((ImTextureID)(intptr_t)cell.texture, size);
+            }
+            else {
+                ImGui::Dummy(size);
+            }
+            if (ImGui::IsItemClicked()) clicked = i;
+
+            // outline the layer shown in the viewer
+            const bool is_selected = selected && selected->part == cell.layer.part && selected->channels == cell.layer.channels;
+            if (is_selected) {
+                ImGui::GetWindowDrawList()->AddRect(ImGui::GetItemRectMin(), ImGui::GetItemRectMax(), ImColor(ImGui::GetStyle().Colors[ImGuiCol_CheckMark]), 0, 0, 2);
+            }
+
+            std::string label = cell.layer.name.empty() ? "<rgba>" : cell.layer.name;
+            label += " (";
+            for (const auto& channel : cell.channels) label += channel.substr(channel.find_last_of('.') + 1);
+            label += ")";
+            ImGui::PushTextWrapPos(ImGui::GetCursorPosX() + cell_width);
+            ImGui::TextUnformatted(label.c_str());
+            ImGui::PopTextWrapPos();
+        }
+        ImGui::EndGroup();
+        ImGui::PopID();
+    }
+    return clicked;
+}
@@ -0,0 +1,96 @@
+#pragma once
+
+#include <vector>
+#include <string>
+#include <tuple>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <functional>
+
+#include "glad/glad.h"
+#include "Readers/BaseSequenceReader.h"
+#include "Readers/BaseLayerManager.h"
+#include "FramePool.h"
+
+/// Thumbnails of every layer of a frame, side by side, eg. to compare the AOVs of a render.
+/// The layers of a part are decoded with BaseSequenceReader::read_groups calls,
+/// so a scanline block is decompressed once for all of them, not once per layer.
+/// Frames are decoded on a worker thread, in bands of rows that are averaged down to the size of a cell as they arrive:
+/// neither the decoded frame nor the textures are ever held at full resolution.
+class AOVGrid
+{
+private:
+    /// a layer decoded to a thumbnail
+    struct Thumbnail {
+        std::vector<float> pixels; // interleaved, as many channels as the layer
+        int width{ 0 }, height{ 0 };
+        bool valid{ false };
+    };
+
+    struct Cell {
+        Layer layer;
+        std::vector<std::string> channels; // decoded channels of the layer, at most 4
+        int width{ 0 }, height{ 0 }; // of the texture
+        bool valid{ false };
+        GLuint texture{ 0 };
+    };
+
+    /// a frame to decode, with the channels of every cell
+    struct Job {
+        BaseSequenceReader* reader{ NULL };
+        ReadRequest request{ -1, -1, {} };
+        int factor{ 1 }; // display pixels averaged in a thumbnail pixel, per side
+        std::vector<int> parts; // of each cell
+        std::vector<std::vector<std::string>> channels;
+    };
+
+    int m_width, m_height; // display size
+    std::vector<Cell> m_cells; // GL thread
+    Job m_loaded; // last job handed to the worker
+
+    std::mutex m_mutex;
+    std::condition_variable m_cv;
+    std::thread m_worker;
+    bool m_stop{ false };
+    Job m_job; // guarded by m_mutex
+    bool m_pending{ false };
+    int m_generation{ 0 }; // bumped by every job, a decode stops when a newer one is pending
+    std::vector<Thumbnail> m_result; // guarded by m_mutex
+    bool m_result_changed{ false };
+    bool m_busy{ false };
+
+    double m_read_seconds{ 0 }; // every layer of the last load
+    double m_upload_seconds{ 0 };
+    int m_passes{ 0 }; // read_groups calls of the last load, one per band of each part
+
+    float m_cell_width{ 256 }; // in pixels, as last drawn
+
+    void worker_loop();
+    /// decode the layers of a job to thumbnails. return false when a newer job replaced it
+    bool decode(const Job& job, int generation, std::vector<Thumbnail>* thumbnails);
+    void upload(Cell& cell, const Thumbnail& thumbnail);
+
+public:
+    int columns{ 4 };
+    int level{ 2 }; // resolution level of the thumbnails, for tiled files with levels
+    int band_rows{ 32 }; // display rows decoded at once, rounded up to whole blocks
+    std::function<void()> on_finished; // called on the worker thread when the thumbnails of a frame are ready eg. to wake an idle main loop
+
+    /// width, height: the display size
+    AOVGrid(int width, int height);
+    ~AOVGrid();
+
+    AOVGrid(const AOVGrid&) = delete;
+    AOVGrid& operator=(const AOVGrid&) = delete;
+
+    /// decode every layer of the frame in the background, unless the same frame and layers are loaded already
+    /// the reader must outlive the grid. call from the GL thread. return true when a decode was started
+    bool load(BaseSequenceReader* reader, int frame, const std::vector<Layer>& layers);
+
+    /// decode the frame again on the next load, when it is loaded eg. after it was rewritten on disk
+    void invalidate(int frame) { if (m_loaded.request.frame == frame) m_loaded.request = { -1, -1, {} }; }
+
+    /// upload finished thumbnails, and draw the grid. return the index of the clicked layer, -1 when none was clicked
+    int onGUI(const Layer* selected);
+};
@@ -0,0 +1,82 @@
+#include "BandedFrameLoader.h"
+
+#include <iostream>
+
+#include "imgui.h"
+
+BandedFrameLoader::BandedFrameLoader(BaseSequenceReader* reader, size_t frame_bytes) :
+    m_reader(reader),
+    m_memory(FramePool::global().acquire(frame_bytes)),
+    m_frame_bytes(frame_bytes)
+{
+
+}
+
+BandedFrameLoader::~BandedFrameLoader()
+{
+    stop();
+}
+
+void BandedFrameLoader::stop()
+{
+    if (m_worker.joinable()) {
+        m_progress->cancel = true;
+        m_worker.join(); // waits for the current band only
+    }
+}
+
+void BandedFrameLoader::start(const ReadRequest& request)
+{
+    stop();
+
+    m_request = request;
+    m_progress = std::make_unique<ReadProgress>();
+    m_progress->band_rows = band_rows;
+    m_finished = false;
+    m_success = false;
+    m_uploaded_rows = 0;
+
+    m_worker = std::thread([this, request, progress = m_progress.get()]() {
+        bool success = false;
+        try {
+            success = m_reader->read(request, m_memory.get(), &m_bbox, &m_level, progress);
+        }
+        catch (const std::exception& ex) {
+            std::cerr << "banded read of frame " << request.frame << " failed: " << ex.what() << "\n";
+        }
+        m_success = success;
+        m_finished = true;
+        if (on_finished) on_finished();
+    });
+}
+
+bool BandedFrameLoader::upload(PixelsRenderer* renderer)
+{
+    if (!m_progress) return false;
+
+    // rows first: bbox and level are valid once rows are published
+    int rows = m_progress->rows;
+    if (rows <= m_uploaded_rows) return false;
+
+    renderer->update_rows_from_data(m_memory.get(), m_bbox, m_request.channels, m_uploaded_rows, rows, GL_HALF_FLOAT, m_level);
+    m_uploaded_rows = rows;
+    return true;
+}
+
+bool BandedFrameLoader::done() const
+{
+    if (!m_finished) return false;
+    if (!m_success) return true; // nothing more to upload
+    return m_uploaded_rows >= std::get<3>(m_bbox);
+}
+
+void BandedFrameLoader::onGUI()
+{
+    ImGui::SliderInt("band rows", &band_rows, 1, 512);
+    ImGui::LabelText("buffer", "%.1f MB", m_frame_bytes / 1024.0 / 1024.0);
+    if (m_progress) {
+        ImGui::LabelText("frame", "%d", m_request.frame);
+        ImGui::LabelText("decoded rows", "%d%s", m_progress->rows.load(), m_finished ? " (finished)" : "");
+        ImGui::LabelText("uploaded rows", "%d", m_uploaded_rows);
+    }
+}
@@ -0,0 +1,65 @@
+#pragma once
+
+#include <tuple>
+#include <memory>
+#include <thread>
+#include <atomic>
+#include <functional>
+
+#include "Readers/BaseSequenceReader.h"
+#include "PixelsRenderer.h"
+#include "FramePool.h"
+
+/// Decodes a single frame on a worker thread in scanline bands.
+/// The GL thread uploads each band as soon as it is decoded, so reading the file, decompression
+/// and the texture upload overlap, and large plates show up progressively from the top.
+class BandedFrameLoader
+{
+private:
+    BaseSequenceReader* m_reader;
+    FramePool::Buffer m_memory;
+    size_t m_frame_bytes;
+
+    std::thread m_worker;
+    ReadRequest m_request{ -1, -1, {} };
+    std::unique_ptr<ReadProgress> m_progress;
+    std::tuple<int, int, int, int> m_bbox; // set by the worker before the first band
+    int m_level{ 0 };
+    std::atomic<bool> m_finished{ false };
+    bool m_success{ false };
+
+    int m_uploaded_rows{ 0 };
+
+    void stop();
+
+public:
+    int band_rows{ 64 };
+    std::function<void()> on_finished; // called on the worker thread when a read ends eg. to wake an idle main loop
+
+    /// frame_bytes: size of the decode buffer
+    BandedFrameLoader(BaseSequenceReader* reader, size_t frame_bytes);
+    ~BandedFrameLoader();
+
+    BandedFrameLoader(const BandedFrameLoader&) = delete;
+    BandedFrameLoader& operator=(const BandedFrameLoader&) = delete;
+
+    /// start decoding a request. A read in progress is cancelled after its current band.
+    void start(const ReadRequest& request);
+
+    /// upload the bands decoded since the last call. Call once per GUI frame from the GL thread.
+    /// return true when new rows were uploaded
+    bool upload(PixelsRenderer* renderer);
+
+    const ReadRequest& request() const { return m_request; }
+
+    /// the whole frame is decoded and uploaded
+    bool done() const;
+
+    /// the decoded frame, valid once done() and success()
+    bool success() const { return m_finished && m_success; }
+    const char* memory() const { return m_memory.get(); }
+    std::tuple<int, int, int, int> bbox() const { return m_bbox; }
+    int level() const { return m_level; }
+
+    void onGUI();
+};
@@ -0,0 +1,151 @@
+#include "ChannelArray.h"
+
+#include <iostream>
+#include <algorithm>
+#include <chrono>
+#include <cctype>
+
+#include "imgui.h"
+
+ChannelArray::ChannelArray(int width, int height) : m_width(width), m_height(height)
+{
+}
+
+ChannelArray::~ChannelArray()
+{
+    if (m_texture) glDeleteTextures(1, &m_texture);
+}
+
+void ChannelArray::allocate(int slices, GLenum internalformat)
+{
+    // immutable storage: a larger array is a new texture
+    if (m_texture) glDeleteTextures(1, &m_texture);
+    glGenTextures(1, &m_texture);
+    glBindTexture(GL_TEXTURE_2D_ARRAY, m_texture);
+    glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+    glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+    glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_BASE_LEVEL, 0);
+    glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MAX_LEVEL, 0);
+    glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+    glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+    glTexStorage3D(GL_TEXTURE_2D_ARRAY, 1, internalformat, m_width, m_height, slices);
+    glBindTexture(GL_TEXTURE_2D_ARRAY, 0);
+
+    m_slices = slices;
+    m_internalformat = internalformat;
+}
+
+bool ChannelArray::load(BaseSequenceReader* reader, ReadRequest request)
+{
+    request.planar = true;
+    request.full_float = full_float;
+    if (m_valid && request == m_request) return false;
+    if (request.channels.empty()) return false;
+
+    GLint max_slices;
+    glGetIntegerv(GL_MAX_ARRAY_TEXTURE_LAYERS, &max_slices);
+    if (request.channels.size() > max_slices) {
+        std::cerr << "cannot fit " << request.channels.size() << " channels to a texture array" << "\n";
+        return false;
+    }
+
+    /// read every channel, a plane after the other
+    const size_t bytes = (size_t)m_width * m_height * request.channels.size() * request.typesize();
+    if (m_memory.capacity() < bytes) {
+        m_memory.reset(); // the pool may hand back the same buffer
+        m_memory = FramePool::global().acquire(bytes);
+    }
+
+    m_valid = false;
+    m_request = request;
+    auto start = std::chrono::steady_clock::now();
+    if (!reader->read(request, m_memory.get(), &m_bbox, &m_level, NULL)) return false;
+    auto read_end = std::chrono::steady_clock::now();
+
+    /// upload all the planes at once, each plane is a slice
+    const int slices = request.channels.size();
+    const GLenum internalformat = request.full_float ? GL_R32F : GL_R16F;
+    if (slices > m_slices || internalformat != m_internalformat) {
+        allocate(slices, internalformat);
+    }
+
+    auto [x, y, w, h] = m_bbox;
+    if (w > 0 && h > 0)
+    {
+        glBindTexture(GL_TEXTURE_2D_ARRAY, m_texture);
+        glPixelStorei(GL_UNPACK_ALIGNMENT, 1); // rows of single halves are not 4 byte aligned
+        glTexSubImage3D(GL_TEXTURE_2D_ARRAY, 0, 0, 0, 0, w, h, slices, GL_RED, request.full_float ? GL_FLOAT : GL_HALF_FLOAT, m_memory.get());
+        glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+        glBindTexture(GL_TEXTURE_2D_ARRAY, 0);
+    }
+    auto upload_end = std::chrono::steady_clock::now();
+
+    m_read_seconds = std::chrono::duration<double>(read_end - start).count();
+    m_upload_seconds = std::chrono::duration<double>(upload_end - read_end).count();
+    m_valid = true;
+    return true;
+}
+
+std::array<int, 4> ChannelArray::slices(const std::vector<std::string>& layer_channels) const
+{
+    std::array<int, 4> rgba{ -1, -1, -1, -1 };
+    if (!m_valid) return rgba;
+
+    // name of the channel within its layer, lower case
+    auto component = [](const std::string& channel) {
+        auto name = channel.substr(channel.find_last_of('.') + 1);
+        std::transform(name.begin(), name.end(), name.begin(), [](unsigned char c) { return std::tolower(c); });
+        return name;
+    };
+    const std::vector<std::vector<std::string>> names{ {"r", "red"}, {"g", "green"}, {"b", "blue"}, {"a", "alpha"} };
+
+    /// place channels by name
+    std::vector<int> unnamed; // slices of the other channels
+    const auto& channels = m_request.channels;
+    for (const auto& channel : layer_channels)
+    {
+        auto it = std::find(channels.begin(), channels.end(), channel);
+        if (it == channels.end()) continue; // not in the part
+        const int slice = it - channels.begin();
+
+        const auto name = component(channel);
+        int c = 0;
+        while (c < 4 && std::find(names[c].begin(), names[c].end(), name) == names[c].end()) c++;
+        if (c < 4 && rgba[c] < 0) {
+            rgba[c] = slice;
+        }
+        else {
+            unnamed.push_back(slice);
+        }
+    }
+
+    // a single channel that is not a color is grey eg. Z, or a lone alpha
+    if (layer_channels.size() == 1 && rgba[0] < 0 && rgba[1] < 0 && rgba[2] < 0)
+    {
+        const int slice = !unnamed.empty() ? unnamed[0] : rgba[3];
+        return { slice, slice, slice, -1 };
+    }
+
+    // the other channels in order eg. x y z, u v
+    for (int slice : unnamed) {
+        for (auto c = 0; c < 4; c++) {
+            if (rgba[c] < 0) {
+                rgba[c] = slice;
+                break;
+            }
+        }
+    }
+    return rgba;
+}
+
+void ChannelArray::onGUI()
+{
+    ImGui::Checkbox("32 bit float", &full_float);
+    if (ImGui::IsItemHovered()) ImGui::SetTooltip("keep the precision of float channels eg. depth and positions. twice the memory");
+
+    const size_t typesize = m_internalformat == GL_R32F ? 4 : 2;
+    ImGui::LabelText("slices", "%d %s", (int)m_request.channels.size(), m_internalformat == GL_R32F ? "R32F" : "R16F");
+    ImGui::LabelText("memory", "%.1f MB", (double)m_width * m_height * m_slices * typesize / 1024.0 / 1024.0);
+    ImGui::LabelText("read", "%.1f ms", m_read_seconds * 1000);
+    ImGui::LabelText("upload", "%.1f ms", m_upload_seconds * 1000);
+}
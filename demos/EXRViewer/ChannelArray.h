@@ -0,0 +1,61 @@
+#pragma once
+
+#include <vector>
+#include <string>
+#include <tuple>
+#include <array>
+
+#include "glad/glad.h"
+#include "Readers/BaseSequenceReader.h"
+#include "FramePool.h"
+
+/// Every channel of a part, resident on the GPU as the slices of a GL_TEXTURE_2D_ARRAY (R16F, or R32F for full floats).
+/// The frame is read once in planar layout and uploaded with a single call. Switching layers only picks
+/// other slices in the shader, see PixelsRenderer::update_from_array, so it costs no read and no upload.
+class ChannelArray
+{
+private:
+    GLuint m_texture{ 0 };
+    int m_width, m_height; // of each slice
+    int m_slices{ 0 }; // allocated slices
+    GLenum m_internalformat{ GL_R16F };
+
+    FramePool::Buffer m_memory;
+    ReadRequest m_request{ -1, -1, {} }; // resident frame
+    bool m_valid{ false };
+    std::tuple<int, int, int, int> m_bbox{ 0,0,0,0 };
+    int m_level{ 0 };
+
+    double m_read_seconds{ 0 }; // last load
+    double m_upload_seconds{ 0 };
+
+    void allocate(int slices, GLenum internalformat);
+
+public:
+    bool full_float{ false }; // read 32 bit floats eg. for depth. twice the memory
+
+    /// width, height: size of a slice, the display size
+    ChannelArray(int width, int height);
+    ~ChannelArray();
+
+    ChannelArray(const ChannelArray&) = delete;
+    ChannelArray& operator=(const ChannelArray&) = delete;
+
+    /// read every channel of the request to the array, unless the same frame is resident already
+    /// call from the GL thread. return true when the frame was read
+    bool load(BaseSequenceReader* reader, ReadRequest request);
+
+    /// read the frame again on the next load, when it is resident eg. after it was rewritten on disk
+    void invalidate(int frame) { if (m_request.frame == frame) m_valid = false; }
+
+    GLuint texture() const { return m_texture; }
+    const std::vector<std::string>& channels() const { return m_request.channels; }
+    std::tuple<int, int, int, int> bbox() const { return m_bbox; }
+    int level() const { return m_level; }
+
+    /// slices to show as red, green, blue and alpha for the channels of a layer, -1 where there is none
+    /// channels are placed by name (R, G, B, A, red, ...) and the others in order, a single channel is grey
+    std::array<int, 4> slices(const std::vector<std::string>& layer_channels) const;
+
+    void onGUI();
+};
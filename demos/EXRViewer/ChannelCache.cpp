@@ -0,0 +1,264 @@
+#include "ChannelCache.h"
+
+#include <iostream>
+#include <algorithm>
+#include <chrono>
+#include <future>
+#include <climits>
+#include <cstdint>
+
+#include "imgui.h"
+
+/// frames decoded from the same part and level, with the same channels
+static bool same_source(const ReadRequest& a, const ReadRequest& b)
+{
+    return a.part == b.part && a.level == b.level && a.channels == b.channels;
+}
+
+ChannelCache::ChannelCache(BaseSequenceReader* reader, int first_frame, int last_frame, size_t plane_bytes) :
+    m_reader(reader),
+    m_first_frame(first_frame),
+    m_last_frame(last_frame),
+    m_plane_bytes(plane_bytes)
+{
+    m_worker = std::thread(&ChannelCache::worker_loop, this);
+}
+
+ChannelCache::~ChannelCache()
+{
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_stop = true;
+    }
+    m_cv.notify_all();
+    m_worker.join();
+}
+
+int ChannelCache::distance(int F) const
+{
+    return std::abs(F - m_current.frame);
+}
+
+bool ChannelCache::evict(size_t required, int max_distance)
+{
+    // frames around another frame, or of another layer of parts
+    for (auto it = m_frames.begin(); it != m_frames.end();) {
+        const auto& request = (*it)->request;
+        if (distance(request.frame) > radius || !same_source(request, m_current)) {
+            m_used -= (*it)->memory.size();
+            it = m_frames.erase(it);
+        }
+        else {
+            ++it;
+        }
+    }
+
+    // the furthest frames, to make room for a nearer one
+    while (m_used + required > budget)
+    {
+        auto furthest = std::max_element(m_frames.begin(), m_frames.end(), [&](const auto& a, const auto& b) {
+            return distance(a->request.frame) < distance(b->request.frame);
+        });
+        if (furthest == m_frames.end() || distance((*furthest)->request.frame) <= max_distance) return false;
+        m_used -= (*furthest)->memory.size();
+        m_frames.erase(furthest);
+    }
+    return true;
+}
+
+void ChannelCache::worker_loop()
+{
+    while (true)
+    {
+        /// take the nearest wanted frame
+        ReadRequest request;
+        int generation;
+        {
+            std::unique_lock<std::mutex> lock(m_mutex);
+            m_cv.wait(lock, [&] { return m_stop || !m_wanted.empty(); });
+            if (m_stop) return;
+
+            request = m_wanted.front();
+            m_wanted.pop_front();
+            if (!evict(m_plane_bytes * request.channels.size(), distance(request.frame))) continue; // over budget this far
+            m_reading = request;
+            generation = m_generation;
+        }
+
+        /// decode every channel without holding the lock
+        auto frame = std::make_shared<Frame>();
+        frame->request = request;
+        bool success = false;
+        auto start = std::chrono::steady_clock::now();
+        try {
+            frame->memory = FramePool::global().acquire(m_plane_bytes * request.channels.size());
+            success = m_reader->read(request, frame->memory.get(), &frame->bbox, &frame->level, NULL);
+        }
+        catch (const std::exception& ex) {
+            std::cerr << "cannot read every channel of frame " << request.frame << ": " << ex.what() << "\n";
+        }
+        std::chrono::duration<double> seconds = std::chrono::steady_clock::now() - start;
+
+        /// publish, unless the current frame moved away while reading
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_reading = { -1, -1, {} };
+        if (success && generation == m_generation && same_source(request, m_current) && distance(request.frame) <= radius) {
+            m_used += frame->memory.size();
+            m_frames.push_back(frame);
+            m_read_seconds = seconds.count();
+        }
+    }
+}
+
+void ChannelCache::update(const ReadRequest& current, const std::vector<std::string>& part_channels)
+{
+    // whole frames, so a pan does not miss
+    ReadRequest key{ current.frame, current.part, part_channels, { 0,0,0,0 }, current.level };
+    key.planar = true;
+
+    std::lock_guard<std::mutex> lock(m_mutex);
+    if (key == m_current) return;
+    m_current = key;
+    evict(0, INT_MAX);
+
+    /// the current frame first, then its neighbours, nearest first
+    std::vector<int> frames{ key.frame };
+    for (auto d = 1; d <= radius; d++) {
+        frames.push_back(key.frame + d);
+        frames.push_back(key.frame - d);
+    }
+
+    m_wanted.clear();
+    for (int F : frames)
+    {
+        if (F < m_first_frame || F > m_last_frame) continue;
+        ReadRequest request = key;
+        request.frame = F;
+        if (request == m_reading) continue;
+        bool cached = std::any_of(m_frames.begin(), m_frames.end(), [&](const auto& frame) { return frame->request == request; });
+        if (!cached) m_wanted.push_back(request);
+    }
+    m_cv.notify_one();
+}
+
+std::shared_ptr<const ChannelCache::Frame> ChannelCache::find(const ReadRequest& request)
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+
+    // count each requested frame once, not every redraw
+    const bool count = !(request == m_last_find);
+    m_last_find = request;
+
+    if (!request.planar && !request.full_float)
+    {
+        for (const auto& frame : m_frames)
+        {
+            const auto& cached = frame->request;
+            if (cached.frame != request.frame || cached.part != request.part || cached.level != request.level) continue;
+            bool has_channels = std::all_of(request.channels.begin(), request.channels.end(), [&](const std::string& channel) {
+                return std::find(cached.channels.begin(), cached.channels.end(), channel) != cached.channels.end();
+            });
+            if (!has_channels) continue;
+
+            if (count) m_hits++;
+            return frame;
+        }
+    }
+    if (count) m_misses++;
+    return NULL;
+}
+
+void ChannelCache::gather(const Frame& frame, const std::vector<std::string>& channels, void* memory)
+{
+    auto start = std::chrono::steady_clock::now();
+    auto [x, y, w, h] = frame.bbox;
+    const size_t plane_pixels = (size_t)w * h;
+
+    // plane of each channel, NULL when the part has no such channel
+    // cached frames are halves, copied as 16 bit words
+    const auto& cached = frame.request.channels;
+    std::vector<const uint16_t*> planes;
+    for (const auto& channel : channels) {
+        auto it = std::find(cached.begin(), cached.end(), channel);
+        planes.push_back(it != cached.end() ? (const uint16_t*)frame.memory.get() + (it - cached.begin()) * plane_pixels : NULL);
+    }
+
+    const size_t n = channels.size();
+    auto gather_rows = [&](int row_begin, int row_end) {
+        for (int row = row_begin; row < row_end; row++) {
+            uint16_t* dst = (uint16_t*)memory + (size_t)row * w * n;
+            for (auto c = 0; c < n; c++) {
+                const uint16_t* src = planes[c] ? planes[c] + (size_t)row * w : NULL;
+                for (int i = 0; i < w; i++) {
+                    dst[i * n + c] = src ? src[i] : 0;
+                }
+            }
+        }
+    };
+
+    // bands of rows in parallel
+    const int threads = std::max(1, std::min((int)std::thread::hardware_concurrency(), h / 16));
+    std::vector<std::future<void>> bands;
+    for (auto t = 1; t < threads; t++) {
+        bands.push_back(std::async(std::launch::async, gather_rows, h * t / threads, h * (t + 1) / threads));
+    }
+    gather_rows(0, h / threads);
+    for (auto& band : bands) band.get();
+
+    m_gather_seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+}
+
+void ChannelCache::set_range(int first_frame, int last_frame)
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_first_frame = first_frame;
+    m_last_frame = last_frame;
+}
+
+void ChannelCache::clear()
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_frames.clear();
+    m_wanted.clear();
+    m_used = 0;
+    m_current = { -1, -1, {} };
+    m_generation++;
+}
+
+void ChannelCache::onGUI()
+{
+    if (ImGui::SliderInt("radius", &radius, 0, 8)) {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_current = { -1, -1, {} }; // collect the neighbours again on the next update
+    }
+    if (ImGui::IsItemHovered()) ImGui::SetTooltip("frames kept on each side of the current frame");
+    int budget_mb = (int)(budget / (1024 * 1024));
+    if (ImGui::DragInt("budget", &budget_mb, 64, 256, 256 * 1024, "%d MB")) {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        budget = (size_t)budget_mb * 1024 * 1024;
+    }
+
+    std::lock_guard<std::mutex> lock(m_mutex);
+    ImGui::LabelText("memory", "%.1f MB", m_used / 1024.0 / 1024.0);
+    ImGui::LabelText("channels", "%d", (int)m_current.channels.size());
+    ImGui::LabelText("hits", "%d", m_hits);
+    ImGui::LabelText("misses", "%d", m_misses);
+    ImGui::LabelText("read", "%.1f ms", m_read_seconds * 1000);
+    ImGui::LabelText("gather", "%.1f ms", m_gather_seconds * 1000);
+
+    // cached frames, and the frame being read
+    std::vector<int> frames;
+    for (const auto& frame : m_frames) frames.push_back(frame->request.frame);
+    std::sort(frames.begin(), frames.end());
+    for (int F : frames) {
+        ImGui::Text("%d", F);
+        ImGui::SameLine();
+    }
+    if (m_reading.frame >= 0) {
+        ImGui::PushStyleColor(ImGuiCol_Text, ImVec4(1, 0, 0, 1));
+        ImGui::Text("%d", m_reading.frame);
+        ImGui::PopStyleColor();
+        ImGui::SameLine();
+    }
+    ImGui::NewLine();
+}
@@ -0,0 +1,87 @@
+#pragma once
+
+#include <vector>
+#include <string>
+#include <tuple>
+#include <deque>
+#include <memory>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+
+#include "Readers/BaseSequenceReader.h"
+#include "FramePool.h"
+
+/// Decoded frames with every channel of their part, in planar layout.
+/// Scanline exr files decompress every channel of a block, even when a single layer is read.
+/// Keeping all of them makes another layer of a cached frame a gather in memory, without reading the file again.
+/// The current frame and its neighbours are decoded on a background thread, whole, at the requested level.
+/// This is not a frame to frame cache: frames further than radius from the current frame are dropped.
+class ChannelCache
+{
+public:
+    struct Frame {
+        ReadRequest request; // planar, every channel of the part, no roi
+        FramePool::Buffer memory;
+        std::tuple<int, int, int, int> bbox;
+        int level{ 0 };
+    };
+
+private:
+    BaseSequenceReader* m_reader;
+    int m_first_frame;
+    int m_last_frame;
+    size_t m_plane_bytes; // a single channel of a frame
+
+    std::mutex m_mutex;
+    std::condition_variable m_cv;
+    std::thread m_worker;
+    bool m_stop{ false };
+    std::vector<std::shared_ptr<const Frame>> m_frames;
+    std::deque<ReadRequest> m_wanted; // nearest first
+    ReadRequest m_reading{ -1, -1, {} };
+    ReadRequest m_current{ -1, -1, {} }; // key of the current frame
+    int m_generation{ 0 }; // bumped by clear, a frame read before is dropped
+    size_t m_used{ 0 };
+
+    // stats
+    ReadRequest m_last_find{ -1, -1, {} };
+    int m_hits{ 0 };
+    int m_misses{ 0 };
+    double m_read_seconds{ 0 };
+    double m_gather_seconds{ 0 };
+
+    void worker_loop();
+    int distance(int F) const;
+    /// drop frames outside the radius, then the furthest ones until required bytes fit. call locked
+    bool evict(size_t required, int max_distance);
+
+public:
+    int radius{ 1 }; // frames kept on each side of the current frame
+    size_t budget{ size_t(4) * 1024 * 1024 * 1024 };
+
+    /// plane_bytes: size of a single decoded channel eg. display width * height * sizeof(half)
+    ChannelCache(BaseSequenceReader* reader, int first_frame, int last_frame, size_t plane_bytes);
+    ~ChannelCache();
+
+    ChannelCache(const ChannelCache&) = delete;
+    ChannelCache& operator=(const ChannelCache&) = delete;
+
+    /// follow the current frame, and decode it and its neighbours in the background
+    /// part_channels: every channel in the part of the request. Call from the GL thread.
+    void update(const ReadRequest& current, const std::vector<std::string>& part_channels);
+
+    /// the cached frame holding the channels of an interleaved request, at its level. NULL on a miss
+    std::shared_ptr<const Frame> find(const ReadRequest& request);
+
+    /// copy channels of a cached frame to memory, interleaved like the reader decodes them. missing channels are black
+    void gather(const Frame& frame, const std::vector<std::string>& channels, void* memory);
+
+    /// follow a sequence that grows on disk
+    void set_range(int first_frame, int last_frame);
+
+    /// drop every frame eg. when the sequence was rewritten on disk. a frame being read is dropped when it finishes
+    void clear();
+
+    void onGUI();
+};
@@ -0,0 +1,84 @@
+#include "DecodeScheduler.h"
+
+#include <algorithm>
+
+#include "imgui.h"
+
+DecodeScheduler::DecodeScheduler(int cores, int max_frames)
+{
+    cores = std::max(1, cores);
+    max_frames = std::max(1, max_frames);
+
+    // frames: powers of two up to max_frames, threads: split the cores between them
+    for (int frames = 1; frames <= max_frames; frames *= 2) {
+        m_configs.push_back({ frames, std::max(1, cores / frames) });
+    }
+    if (m_configs.back().frames != max_frames) {
+        m_configs.push_back({ max_frames, std::max(1, cores / max_frames) });
+    }
+    m_fps.resize(m_configs.size(), 0.0);
+
+    // start in the middle
+    m_current = (int)m_configs.size() / 2;
+}
+
+bool DecodeScheduler::record(double seconds)
+{
+    m_window_frames++;
+    m_window_seconds += seconds;
+
+    // measure a few rounds of concurrent frames
+    const int window = 2 * m_configs[m_current].frames + 2;
+    if (m_window_frames < window) return false;
+
+    // throughput: concurrent frames over the average decode time
+    double fps = m_configs[m_current].frames * m_window_frames / std::max(m_window_seconds, 1e-6);
+    m_fps[m_current] = m_fps[m_current] > 0 ? 0.5 * m_fps[m_current] + 0.5 * fps : fps;
+    m_window_frames = 0;
+    m_window_seconds = 0;
+
+    /// climb to a better neighbour
+    int next = m_current;
+    for (int n : { m_current - 1, m_current + 1 })
+    {
+        if (n < 0 || n >= m_configs.size()) continue;
+        if (m_fps[n] == 0) { // not measured yet
+            next = n;
+            break;
+        }
+        if (m_fps[n] > m_fps[next] * 1.05) next = n; // ignore noise
+    }
+
+    if (next == m_current)
+    {
+        // the content may change: measure the neighbours again from time to time
+        if (++m_stable_windows % reprobe_interval == 0) {
+            if (m_current > 0) m_fps[m_current - 1] = 0;
+            if (m_current + 1 < m_configs.size()) m_fps[m_current + 1] = 0;
+        }
+        return false;
+    }
+
+    m_current = next;
+    m_stable_windows = 0;
+    return true;
+}
+
+void DecodeScheduler::reset()
+{
+    std::fill(m_fps.begin(), m_fps.end(), 0.0);
+    m_window_frames = 0;
+    m_window_seconds = 0;
+    m_stable_windows = 0;
+}
+
+void DecodeScheduler::onGUI()
+{
+    ImGui::LabelText("config", "%d frames x %d threads", config().frames, config().threads);
+    for (auto i = 0; i < m_configs.size(); i++)
+    {
+        if (i == m_current) ImGui::PushStyleColor(ImGuiCol_Text, ImVec4(0, 1, 0, 1));
+        ImGui::Text("%2d x %2d: %.1f fps", m_configs[i].frames, m_configs[i].threads, m_fps[i]);
+        if (i == m_current) ImGui::PopStyleColor();
+    }
+}
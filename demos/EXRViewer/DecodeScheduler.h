@@ -0,0 +1,43 @@
+#pragma once
+
+#include <vector>
+
+/// Chooses how many frames to decode at once, and how many threads each frame gets.
+/// Small scanline files scale poorly within a frame, large PIZ files scale well. The scheduler measures
+/// the decode time of each frame, and hill climbs between configurations of frames x threads that keep
+/// every core busy without oversubscribing them.
+class DecodeScheduler
+{
+public:
+    struct Config {
+        int frames;  // frames decoded concurrently
+        int threads; // decoder threads per frame
+    };
+
+private:
+    std::vector<Config> m_configs; // ordered by frames
+    std::vector<double> m_fps; // measured throughput per config, 0 when not measured yet
+    int m_current{ 0 };
+
+    // current measurement window
+    int m_window_frames{ 0 };
+    double m_window_seconds{ 0 };
+    int m_stable_windows{ 0 };
+
+public:
+    int reprobe_interval{ 8 }; // windows to stay on the best config before measuring the neighbours again
+
+    /// cores: threads available for decoding. max_frames: most frames decoded at once
+    DecodeScheduler(int cores, int max_frames);
+
+    /// a frame finished decoding in seconds
+    /// return true when the config changed
+    bool record(double seconds);
+
+    Config config() const { return m_configs[m_current]; }
+
+    /// forget the measurements eg. when the sequence changed
+    void reset();
+
+    void onGUI();
+};
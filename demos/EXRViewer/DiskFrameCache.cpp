@@ -0,0 +1,353 @@
+#include "DiskFrameCache.h"
+
+#include <fstream>
+#include <iostream>
+#include <algorithm>
+#include <cstring>
+#include <thread>
+
+#ifdef _WIN32
+#include <process.h> // _getpid
+#define getpid _getpid
+#else
+#include <unistd.h> // getpid
+#endif
+
+#include "helpers.h" // stable_hash
+#include "stringutils.h" // join_string
+
+#include "imgui.h"
+
+/// file layout
+// header: magic, header size, bbox, level, typesize, channel count, pixel bytes, key, channel names
+// padded to a whole page, so the pixels are page aligned in the mapping
+static const char RAW_MAGIC[8] = { 'G','L','Z','R','A','W','0','1' };
+static const size_t PAGE_SIZE = 4096;
+
+std::string DiskFrameCache::Key::to_string() const
+{
+    return source.string() + "|" + std::to_string(mtime) + "|" + std::to_string(part) + "|" + join_string(channels, ",") + "|" + std::to_string(level);
+}
+
+DiskFrameCache::DiskFrameCache(const std::filesystem::path& directory, size_t capacity) : m_directory(directory), capacity(capacity)
+{
+    std::error_code ec;
+    std::filesystem::create_directories(m_directory, ec);
+    for (auto it = std::filesystem::directory_iterator(m_directory, ec); !ec && it != std::filesystem::directory_iterator(); it.increment(ec)) {
+        if (it->path().extension() == ".raw") {
+            m_files.insert(it->path().filename().string());
+        }
+    }
+
+    m_writer = std::thread(&DiskFrameCache::writer_loop, this);
+}
+
+DiskFrameCache::~DiskFrameCache()
+{
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_stop = true;
+    }
+    m_cv.notify_all();
+    m_writer.join();
+}
+
+std::filesystem::path DiskFrameCache::filepath(const Key& key) const
+{
+    char name[32];
+    snprintf(name, sizeof(name), "%016llx.raw", (unsigned long long)stable_hash(key.to_string()));
+    return m_directory / name;
+}
+
+bool DiskFrameCache::contains(const Key& key)
+{
+    auto name = filepath(key).filename().string();
+    std::lock_guard<std::mutex> lock(m_mutex);
+    return m_files.contains(name);
+}
+
+void DiskFrameCache::forget(const std::filesystem::path& path)
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_files.erase(path.filename().string());
+}
+
+template<typename T>
+static T read_value(const char*& ptr) {
+    T value;
+    memcpy(&value, ptr, sizeof(T));
+    ptr += sizeof(T);
+    return value;
+}
+
+static std::string read_text(const char*& ptr, const char* end) {
+    uint32_t size = read_value<uint32_t>(ptr);
+    if (ptr + size > end) throw std::runtime_error("corrupt cache header");
+    std::string text(ptr, size);
+    ptr += size;
+    return text;
+}
+
+std::unique_ptr<DiskFrameCache::Entry> DiskFrameCache::open(const Key& key)
+{
+    auto path = filepath(key);
+    std::error_code ec;
+    if (!std::filesystem::exists(path, ec)) {
+        forget(path);
+        m_misses++;
+        return NULL;
+    }
+
+    try
+    {
+        // mark as recently used. before mapping, a mapped file cannot be touched on windows
+        std::filesystem::last_write_time(path, std::filesystem::file_time_type::clock::now(), ec);
+
+        auto entry = std::make_unique<Entry>();
+        entry->file = std::make_unique<MemoryMappedIStream>(path.string().c_str(), MemoryMappedIStream::AccessHint::Sequential);
+
+        /// parse header
+        const char* ptr = entry->file->readMemoryMapped(sizeof(RAW_MAGIC) + sizeof(uint32_t));
+        if (memcmp(ptr, RAW_MAGIC, sizeof(RAW_MAGIC)) != 0) throw std::runtime_error("not a cached frame");
+        ptr += sizeof(RAW_MAGIC);
+        uint32_t header_bytes = read_value<uint32_t>(ptr);
+
+        entry->file->seekg(0);
+        const char* header = entry->file->readMemoryMapped(header_bytes);
+        const char* end = header + header_bytes;
+        ptr = header + sizeof(RAW_MAGIC) + sizeof(uint32_t);
+        int32_t x = read_value<int32_t>(ptr);
+        int32_t y = read_value<int32_t>(ptr);
+        int32_t w = read_value<int32_t>(ptr);
+        int32_t h = read_value<int32_t>(ptr);
+        entry->bbox = { x, y, w, h };
+        entry->level = read_value<int32_t>(ptr);
+        entry->typesize = read_value<uint32_t>(ptr);
+        uint32_t nchannels = read_value<uint32_t>(ptr);
+        uint64_t bytes = read_value<uint64_t>(ptr);
+
+        // the file name is a hash, the key tells collisions apart
+        if (read_text(ptr, end) != key.to_string()) {
+            forget(path);
+            m_misses++;
+            return NULL;
+        }
+        for (size_t c = 0; c < nchannels; c++) {
+            entry->channels.push_back(read_text(ptr, end));
+        }
+        if (bytes != (uint64_t)w * h * nchannels * entry->typesize) throw std::runtime_error("corrupt cache header");
+
+        entry->pixels = entry->file->readMemoryMapped((int)bytes); // throws when the file is truncated
+        m_hits++;
+        return entry;
+    }
+    catch (const std::exception& ex)
+    {
+        std::cerr << "cannot open cached frame " << path << ": " << ex.what() << "\n";
+        forget(path);
+        m_misses++;
+        return NULL;
+    }
+}
+
+void DiskFrameCache::store(const Key& key, const void* pixels, const std::tuple<int, int, int, int>& bbox, int level, size_t typesize)
+{
+    auto name = filepath(key).filename().string();
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        if (m_files.contains(name) || m_writing.contains(name)) return;
+        if (m_jobs.size() >= max_pending) {
+            m_dropped++;
+            return;
+        }
+        m_writing.insert(name);
+    }
+
+    // copy now, the caller reuses its buffer
+    auto [x, y, w, h] = bbox;
+    Job job;
+    job.key = key;
+    job.bytes = (size_t)w * h * key.channels.size() * typesize;
+    job.pixels = FramePool::global().acquire(job.bytes);
+    memcpy(job.pixels.get(), pixels, job.bytes);
+    job.bbox = bbox;
+    job.level = level;
+    job.typesize = typesize;
+
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_jobs.push_back(std::move(job));
+    }
+    m_cv.notify_one();
+}
+
+void DiskFrameCache::writer_loop()
+{
+    cleanup(); // measure what earlier sessions left
+
+    while (true)
+    {
+        Job job;
+        {
+            std::unique_lock<std::mutex> lock(m_mutex);
+            m_cv.wait(lock, [&] { return m_stop || !m_jobs.empty(); });
+            if (m_stop) return; // pending frames are not worth delaying the exit
+            job = std::move(m_jobs.front());
+            m_jobs.pop_front();
+        }
+
+        write(job);
+        if (m_used > capacity) cleanup();
+    }
+}
+
+template<typename T>
+static void write_value(std::vector<char>& buffer, const T& value) {
+    buffer.insert(buffer.end(), (const char*)&value, (const char*)&value + sizeof(T));
+}
+
+static void write_text(std::vector<char>& buffer, const std::string& text) {
+    write_value(buffer, (uint32_t)text.size());
+    buffer.insert(buffer.end(), text.begin(), text.end());
+}
+
+void DiskFrameCache::write(const Job& job)
+{
+    auto path = filepath(job.key);
+
+    std::vector<char> header(RAW_MAGIC, RAW_MAGIC + sizeof(RAW_MAGIC));
+    write_value(header, (uint32_t)0); // header size, set below
+    auto [x, y, w, h] = job.bbox;
+    for (int32_t v : { x, y, w, h, job.level }) write_value(header, v);
+    write_value(header, (uint32_t)job.typesize);
+    write_value(header, (uint32_t)job.key.channels.size());
+    write_value(header, (uint64_t)job.bytes);
+    write_text(header, job.key.to_string());
+    for (const auto& channel : job.key.channels) write_text(header, channel);
+
+    uint32_t header_bytes = (uint32_t)((header.size() + PAGE_SIZE - 1) / PAGE_SIZE * PAGE_SIZE);
+    memcpy(header.data() + sizeof(RAW_MAGIC), &header_bytes, sizeof(header_bytes));
+    header.resize(header_bytes, 0);
+
+    // write next to the target, and rename, so other processes never map a partial frame
+    // the temporary name is unique to the writer: processes sharing the cache may write the same frame at once
+    auto tmp = path;
+    tmp += "." + std::to_string(getpid()) + "." + std::to_string(std::hash<std::thread::id>()(std::this_thread::get_id())) + ".tmp";
+    {
+        std::ofstream os(tmp, std::ios::binary);
+        os.write(header.data(), header.size());
+        os.write(job.pixels.get(), job.bytes);
+        if (!os) {
+            std::cerr << "cannot write cached frame " << tmp << "\n";
+            os.close();
+            std::error_code ec;
+            std::filesystem::remove(tmp, ec);
+            std::lock_guard<std::mutex> lock(m_mutex);
+            m_writing.erase(path.filename().string());
+            return;
+        }
+    }
+
+    // published once in place, so contains() never promises a frame open() cannot map
+    std::error_code ec;
+    std::filesystem::rename(tmp, path, ec);
+    bool written = !ec;
+    if (ec) { // eg. another process mapped the same frame
+        std::filesystem::remove(tmp, ec);
+        written = std::filesystem::exists(path, ec);
+    }
+    else {
+        m_used += header_bytes + job.bytes;
+        m_written++;
+    }
+
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_writing.erase(path.filename().string());
+    if (written) m_files.insert(path.filename().string());
+}
+
+void DiskFrameCache::cleanup()
+{
+    struct File {
+        std::filesystem::path path;
+        std::filesystem::file_time_type time;
+        size_t size;
+    };
+
+    std::vector<File> files;
+    std::unordered_set<std::string> names;
+    size_t used = 0;
+    std::error_code ec;
+    for (auto it = std::filesystem::directory_iterator(m_directory, ec); !ec && it != std::filesystem::directory_iterator(); it.increment(ec)) {
+        std::error_code file_ec;
+        if (it->path().extension() == ".tmp") {
+            // left behind by a writer that crashed
+            if (std::filesystem::file_time_type::clock::now() - it->last_write_time(file_ec) > std::chrono::hours(1) && !file_ec) {
+                std::filesystem::remove(it->path(), file_ec);
+            }
+            continue;
+        }
+        if (it->path().extension() != ".raw") continue;
+        File file{ it->path(), it->last_write_time(file_ec), it->file_size(file_ec) };
+        if (file_ec) continue;
+        used += file.size;
+        files.push_back(file);
+        names.insert(file.path.filename().string());
+    }
+
+    // other processes add and delete frames too
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_files = std::move(names);
+    }
+
+    /// delete the least recently used files, down to 90% of the capacity, so cleanup doesn't run on every write
+    if (used > capacity)
+    {
+        std::sort(files.begin(), files.end(), [](const File& a, const File& b) { return a.time < b.time; });
+        for (const auto& file : files)
+        {
+            if (used <= capacity / 10 * 9) break;
+            std::error_code remove_ec;
+            if (!std::filesystem::remove(file.path, remove_ec)) continue; // eg. mapped right now
+            used -= file.size;
+            std::lock_guard<std::mutex> lock(m_mutex);
+            m_files.erase(file.path.filename().string());
+        }
+    }
+    m_used = used;
+}
+
+void DiskFrameCache::clear()
+{
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_jobs.clear();
+        m_files.clear();
+        m_writing.clear();
+    }
+    std::error_code ec;
+    for (auto it = std::filesystem::directory_iterator(m_directory, ec); !ec && it != std::filesystem::directory_iterator(); it.increment(ec)) {
+        std::error_code remove_ec;
+        if (it->path().extension() == ".raw") std::filesystem::remove(it->path(), remove_ec);
+    }
+    m_used = 0;
+}
+
+void DiskFrameCache::onGUI()
+{
+    int capacity_mb = (int)(capacity / (1000 * 1000));
+    if (ImGui::DragInt("capacity", &capacity_mb, 100, 1000, 10 * 1000 * 1000, "%d MB")) {
+        capacity = (size_t)capacity_mb * 1000 * 1000;
+    }
+    ImGui::ProgressBar((float)m_used / std::max<size_t>(1, capacity), ImVec2(-1, 0), (std::to_string(m_used / (1000 * 1000)) + " MB").c_str());
+    ImGui::LabelText("hits", "%d", (int)m_hits);
+    ImGui::LabelText("misses", "%d", (int)m_misses);
+    ImGui::LabelText("written", "%d (%d dropped)", (int)m_written, (int)m_dropped);
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        ImGui::LabelText("pending", "%d", (int)m_jobs.size());
+    }
+    if (ImGui::Button("clear")) clear();
+    if (ImGui::IsItemHovered()) ImGui::SetTooltip("%s", m_directory.string().c_str());
+}
@@ -0,0 +1,105 @@
+#pragma once
+
+#include <vector>
+#include <string>
+#include <tuple>
+#include <memory>
+#include <filesystem>
+#include <unordered_set>
+#include <deque>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <atomic>
+#include <cstdint>
+
+#include "Readers/MemoryMappedIStream.h"
+#include "FramePool.h"
+
+/// Decoded frames spilled to a local disk, to skip decoding frames that were viewed before.
+/// Each frame is a raw file: a page sized header followed by the pixels exactly as the reader decoded them,
+/// so a later session, or another glazy process, maps the file and uploads the pixels with no decode.
+/// Files are written on a background thread. When the cache grows over its capacity,
+/// the least recently used files are deleted; a hit touches the modification time of its file.
+class DiskFrameCache
+{
+public:
+    /// a frame is identified by its source file, and what was read from it
+    struct Key {
+        std::filesystem::path source;
+        int64_t mtime; // last write time ticks of the source
+        int part;
+        std::vector<std::string> channels;
+        int level;
+
+        std::string to_string() const;
+    };
+
+    /// a cached frame, mapped into memory. pixels are valid while the entry lives
+    struct Entry {
+        std::unique_ptr<MemoryMappedIStream> file;
+        const char* pixels{ NULL };
+        std::tuple<int, int, int, int> bbox;
+        int level{ 0 };
+        std::vector<std::string> channels;
+        size_t typesize{ 0 };
+    };
+
+private:
+    struct Job {
+        Key key;
+        FramePool::Buffer pixels;
+        size_t bytes;
+        std::tuple<int, int, int, int> bbox;
+        int level;
+        size_t typesize;
+    };
+
+    std::filesystem::path m_directory;
+
+    std::mutex m_mutex;
+    std::unordered_set<std::string> m_files; // filenames written to the cache, synced with the folder on cleanup
+    std::unordered_set<std::string> m_writing; // filenames queued, or being written
+    std::deque<Job> m_jobs;
+    std::condition_variable m_cv;
+    std::thread m_writer;
+    bool m_stop{ false };
+
+    std::atomic<size_t> m_used{ 0 }; // bytes on disk
+    std::atomic<int> m_hits{ 0 };
+    std::atomic<int> m_misses{ 0 };
+    std::atomic<int> m_written{ 0 };
+    std::atomic<int> m_dropped{ 0 }; // writes skipped because the queue was full
+
+    std::filesystem::path filepath(const Key& key) const;
+    void writer_loop();
+    void write(const Job& job);
+    void cleanup();
+    /// drop a file that is not in the cache anymore eg. deleted by another process
+    void forget(const std::filesystem::path& path);
+
+public:
+    std::atomic<size_t> capacity; // bytes
+    int max_pending{ 8 }; // frames waiting to be written, further frames are not cached
+
+    /// directory: eg. cache_directory() / "frames"
+    DiskFrameCache(const std::filesystem::path& directory, size_t capacity);
+    ~DiskFrameCache();
+
+    DiskFrameCache(const DiskFrameCache&) = delete;
+    DiskFrameCache& operator=(const DiskFrameCache&) = delete;
+
+    /// the frame was written to disk, as far as this process knows. Does not touch the disk.
+    bool contains(const Key& key);
+
+    /// map a cached frame. return NULL on a miss. Thread safe
+    std::unique_ptr<Entry> open(const Key& key);
+
+    /// copy the pixels, and write them in the background. Ignored when the frame is already cached.
+    void store(const Key& key, const void* pixels, const std::tuple<int, int, int, int>& bbox, int level, size_t typesize);
+
+    /// delete every cached frame
+    void clear();
+
+    void onGUI();
+};
@@ -46,16 +46,29 @@
 #include "RenderPlates/RenderPlate.h"
 #include "RenderPlates/CorrectionPlate.h"
 #include "PBOImageStream.h"
+#include "SequencePrefetcher.h"
+#include "BandedFrameLoader.h"
 #include "ImGuiWidgets.h"
+#include "Readers/SequenceIndex.h"
+#include "DiskFrameCache.h"
+#include "ChannelArray.h"
+#include "ChannelCache.h"
+#include "AOVGrid.h"
+#include "Scopes.h"
+#include "PixelStats.h"
 
 #include "helpers.h"
+#include "FramePool.h"
+#include "PlaybackClock.h"
 
 bool is_playing = false;
+PlaybackClock playback_clock; // the frame to show while playing, from the wall clock
 int F, first_frame, last_frame;
 
 int selected_viewport_background{ 1 };//0: transparent 1: checkerboard 2:black
 
 FileSequence sequence;
+bool FOLLOW_SEQUENCE{ true }; // extend the range when frames are added on disk
 //std::unique_ptr<OIIOSequenceReader>oiio_reader;
 //std::unique_ptr<OIIOLayerManager>oiio_layermanager;
 
@@ -65,18 +78,18 @@ struct MemoryPlate {
     const int height;
     const size_t typesize;
     const int channels;
+    FramePool::Buffer buffer; // returned to the pool with the plate
     void * memory;
     MemoryPlate(int width, int height, size_t typesize, int channels) :
         width(width), 
         height(height), 
         typesize(typesize),
         channels(channels), 
-        memory(malloc(width* height* typesize* channels)) {};
-
-    // COPYABLE?
-    // DESTRUCTOR!
+        buffer(FramePool::global().acquire((size_t)width * height * typesize * channels)),
+        memory(buffer.get()) {};
 };
 
+FramePool::Buffer pixels_buffer; // backs pixels, recycled when a sequence is opened
 void* pixels=NULL;
 std::unique_ptr<MemoryPlate> memory_plate;
 std::unique_ptr<BaseSequenceReader> reader;
@@ -84,6 +97,34 @@ std::unique_ptr<EXRLayerManager2> exr_layermanager;
 
 bool USE_PBO_STREAM{false};
 std::unique_ptr<PBOImageStream> pbostream;
+
+bool USE_PREFETCH{ true };
+std::unique_ptr<PBOImageStream> prefetch_pbos; // decode targets of the prefetcher, when reading directly to PBOs
+std::unique_ptr<SequencePrefetcher> prefetcher;
+
+bool USE_BANDS{ true };
+std::unique_ptr<BandedFrameLoader> banded_loader;
+std::unique_ptr<SequenceIndex> sequence_index;
+
+bool USE_DISK_CACHE{ true };
+std::unique_ptr<DiskFrameCache> disk_cache; // decoded frames on a local disk, shared between sessions
+
+bool USE_CHANNEL_ARRAY{ false };
+std::unique_ptr<ChannelArray> channel_array; // every channel of the part on the GPU, layers switch without a read
+
+bool USE_CHANNEL_CACHE{ true };
+std::unique_ptr<ChannelCache> channel_cache; // every channel of nearby frames in memory, layers switch without a read
+ReadRequest gathered{ -1, -1, {} }; // layer shown from the channel cache, gathered once
+
+bool aov_grid_visible{ false };
+std::unique_ptr<AOVGrid> aov_grid; // every layer of the current frame, decoded in a single pass
+bool scopes_visible{ false };
+std::unique_ptr<Scopes> scopes; // histogram, waveform and vectorscope of the decoded frame
+bool stats_visible{ false };
+std::unique_ptr<PixelStats> pixel_stats; // statistics of a region, and the NaN, infinite and negative pixels of the decoded frame
+std::tuple<int, int, int, int> stats_region{ 0,0,0,0 }; // shift dragged in the viewer, in display pixels
+bool stats_dragging{ false };
+ImVec2 stats_anchor; // display pixel where the drag started
 std::unique_ptr<PixelsRenderer> renderer;
 
 ImGui::GLViewerState viewer_state;
@@ -96,8 +137,129 @@ bool READ_DIRECTLY_TO_PBO{ true };
 
 bool sidebar_visible{true};
 
-bool needs_update = false;
-bool force_update = false;
+bool needs_update = false; // read the frame again, even when the inputs are the same eg. the file changed on disk
+bool force_update = false; // read every GUI frame
+
+/// inputs of the read and upload stages: what is read, and the switches selecting how
+struct ReadInputs
+{
+    ReadRequest request{ -1, -1, {} }; // frame, part, channels, roi and level
+    std::array<bool, 9> paths{};
+
+    bool operator==(const ReadInputs& other) const = default;
+};
+ReadInputs shown; // inputs of the frame on screen, when it was shown completely
+
+/// inputs of the viewport composite
+struct CompositeInputs
+{
+    glm::mat4 view{ 0 };
+    glm::mat4 projection{ 0 };
+    GLuint target{ 0 }; // viewport texture, recreated when resized
+    float width{ 0 }, height{ 0 };
+    int background{ -1 };
+    int correction_revision{ -1 };
+
+    bool operator==(const CompositeInputs& other) const = default;
+};
+CompositeInputs composited;
+
+bool USE_ROI{ true };
+std::tuple<int, int, int, int> read_roi{ 0,0,0,0 }; // region the reader decodes, padded around the visible rect
+
+bool USE_LEVELS{ true };
+int read_level{ 0 }; // resolution level matching the zoom, for multi resolution files
+
+/// keep the read roi covering the visible part of the image
+/// the roi is padded, so small pans don't trigger a new read. It is widened when the view leaves it,
+/// and tightened when zooming in far enough to make the roi mostly hidden.
+/// return true when the roi changed
+bool update_read_roi(const std::tuple<int, int, int, int>& visible, int width, int height)
+{
+    auto [vx, vy, vw, vh] = visible;
+    if (vw <= 0 || vh <= 0) return false; // image is off screen, keep what we have
+
+    auto [rx, ry, rw, rh] = read_roi;
+    bool covered = rw > 0 && rh > 0 && vx >= rx && vy >= ry && vx + vw <= rx + rw && vy + vh <= ry + rh;
+    bool mostly_hidden = (long long)vw * vh * 4 < (long long)rw * rh;
+    if (covered && !mostly_hidden) return false;
+
+    int pad_x = vw / 4;
+    int pad_y = vh / 4;
+    int x0 = std::max(0, vx - pad_x);
+    int y0 = std::max(0, vy - pad_y);
+    int x1 = std::min(width, vx + vw + pad_x);
+    int y1 = std::min(height, vy + vh + pad_y);
+    read_roi = { x0, y0, x1 - x0, y1 - y0 };
+    return true;
+}
+
+/// identify a decoded frame in the disk cache. The roi is not part of the key, only whole frames are spilled.
+/// the source is stat'ed on every call, from the GL thread and the workers alike, so a frame rewritten in place gets a new key
+/// files: the sequence, passed by the workers as a copy taken when the prefetcher was made
+DiskFrameCache::Key disk_cache_key(const FileSequence& files, const ReadRequest& request)
+{
+    auto source = files.item(request.frame);
+    std::error_code ec;
+    int64_t mtime = std::filesystem::last_write_time(source, ec).time_since_epoch().count();
+    return { source, mtime, request.part, request.channels, request.level };
+}
+
+/// write a decoded frame to the disk cache, unless it was cropped to the roi
+void spill_to_disk(const ReadRequest& request, const void* memory, const std::tuple<int, int, int, int>& bbox, int level)
+{
+    if (!USE_DISK_CACHE) return;
+    auto [x, y, w, h] = request.roi;
+    auto [width, height] = reader->size();
+    bool whole_frame = w <= 0 || h <= 0 || (x <= 0 && y <= 0 && x + w >= width && y + h >= height);
+    if (!whole_frame) return;
+    disk_cache->store(disk_cache_key(sequence, request), memory, bbox, level, sizeof(half));
+}
+
+/// analyse a decoded frame of halves for the scopes and the statistics, in the background
+/// frames decoded straight to the GPU eg. to a PBO or the channel array, are not analysed
+void submit_for_analysis(const void* memory, const std::tuple<int, int, int, int>& bbox, int level, const std::vector<std::string>& channels)
+{
+    if (scopes_visible) scopes->submit(memory, bbox, channels);
+    if (stats_visible) pixel_stats->submit(memory, bbox, level, channels);
+}
+
+/// read ahead into pooled memory, or straight into mapped PBOs when streaming through them
+void make_prefetcher()
+{
+    prefetcher.reset(); // workers write into the ring
+    prefetch_pbos.reset();
+    auto [display_width, display_height] = reader->size();
+    if (USE_PBO_STREAM && READ_DIRECTLY_TO_PBO)
+    {
+        prefetch_pbos = std::make_unique<PBOImageStream>(display_width, display_height, 4, 8);
+        std::vector<void*> buffers;
+        for (const auto& pbo : prefetch_pbos->pbos) buffers.push_back(pbo.ptr);
+        prefetcher = std::make_unique<SequencePrefetcher>(reader.get(), first_frame, last_frame, buffers, prefetch_pbos->slot_bytes(), [](int slot) { return prefetch_pbos->acquire(slot); });
+    }
+    else
+    {
+        prefetcher = std::make_unique<SequencePrefetcher>(reader.get(), first_frame, last_frame, (size_t)display_width * display_height * 4 * sizeof(half));
+    }
+    // frames not rendered yet are not read ahead, instead of failing to open them on every update
+    if (auto scanner = sequence.scanner) {
+        prefetcher->available = [scanner](int frame) { return scanner->exists(frame); };
+    }
+    // frames cached on disk are read ahead too: the workers copy them to the ring, and fault the mapped pages in off the GL thread
+    // the workers keep their own copy of the sequence, the global one is replaced by open
+    prefetcher->load = [files = sequence](const ReadRequest& request, void* memory, std::tuple<int, int, int, int>* bbox, int* level) {
+        if (!USE_DISK_CACHE) return false;
+        auto key = disk_cache_key(files, request);
+        if (!disk_cache->contains(key)) return false;
+        auto entry = disk_cache->open(key);
+        if (!entry || entry->typesize != sizeof(half)) return false;
+        auto [x, y, w, h] = entry->bbox;
+        memcpy(memory, entry->pixels, (size_t)w * h * entry->channels.size() * entry->typesize);
+        *bbox = entry->bbox;
+        *level = entry->level;
+        return true;
+    };
+}
 
 void open(std::filesystem::path filename)
 {
@@ -105,16 +267,35 @@ void open(std::filesystem::path filename)
     if (!std::filesystem::exists(filename)) {
         std::cout << "file does not exist! " << filename << "\n";
     }
+    // stop every worker that reads the sequence or the reader, before they are replaced
+    prefetcher.reset();
+    prefetch_pbos.reset();
+    aov_grid.reset();
+    banded_loader.reset();
+    channel_cache.reset();
+
     sequence = FileSequence(filename);
+    if (sequence.scanner) sequence.scanner->set_on_change([]() { glazy::request_redraw(); }); // follow frames written while idle
     first_frame = sequence.first_frame;
     last_frame = sequence.last_frame;
     F = sequence.first_frame;
     F = sequence.first_frame;
 
+    sequence_index = std::make_unique<SequenceIndex>(sequence);
+    if (!disk_cache) {
+        disk_cache = std::make_unique<DiskFrameCache>(cache_directory() / "frames", size_t(20) * 1000 * 1000 * 1000);
+    }
+
     reader = std::make_unique<EXRSequenceReader>(sequence);
     auto [display_width, display_height] = reader->size();
 
-    pixels = malloc((size_t)display_width * display_height * 4 * sizeof(half));
+    pixels_buffer = FramePool::global().acquire((size_t)display_width * display_height * 4 * sizeof(half));
+    pixels = pixels_buffer.get();
+    make_prefetcher();
+    banded_loader = std::make_unique<BandedFrameLoader>(reader.get(), (size_t)display_width * display_height * 4 * sizeof(half));
+    banded_loader->on_finished = []() { glazy::request_redraw(); };
+    channel_cache = std::make_unique<ChannelCache>(reader.get(), first_frame, last_frame, (size_t)display_width * display_height * sizeof(half));
+    gathered = { -1, -1, {} };
     
     //oiio_layermanager = std::make_unique<OIIOLayerManager>(sequence.item(sequence.first_frame));
     exr_layermanager = std::make_unique<EXRLayerManager2>(sequence.item(sequence.first_frame));
@@ -124,11 +305,23 @@ void open(std::filesystem::path filename)
     });
 
     pbostream = std::make_unique<PBOImageStream>(display_width, display_height, 4, 3);
+    channel_array = std::make_unique<ChannelArray>(display_width, display_height);
+    aov_grid = std::make_unique<AOVGrid>(display_width, display_height);
+    aov_grid->on_finished = []() { glazy::request_redraw(); };
+    if (!scopes) {
+        scopes = std::make_unique<Scopes>();
+        scopes->on_finished = []() { glazy::request_redraw(); };
+    }
+    if (!pixel_stats) {
+        pixel_stats = std::make_unique<PixelStats>();
+        pixel_stats->on_finished = []() { glazy::request_redraw(); };
+    }
     renderer = std::make_unique<PixelsRenderer>(display_width, display_height);
     
     correction_plate = std::make_unique<CorrectionPlate>(renderer->width, renderer->height, renderer->color_attachment);
 
     viewer_state.camera.fit(renderer->width, renderer->height);
+    read_roi = { 0,0,0,0 };
 
     if (USE_PBO_STREAM && READ_DIRECTLY_TO_PBO) {
         reader->memory = pbostream->ptr;
@@ -137,6 +330,8 @@ void open(std::filesystem::path filename)
         reader->memory = pixels;
     }
     needs_update = true;
+    shown = {};
+    composited = {};
 }
 
 void drop_callback(GLFWwindow* window, int argc, const char** argv)
@@ -150,24 +345,159 @@ void drop_callback(GLFWwindow* window, int argc, const char** argv)
     }
 }
 
-void update()
+/// every channel of a part, in the order of the layers
+std::vector<std::string> part_channels(int part)
+{
+    std::vector<std::string> channels;
+    for (const auto& layer : exr_layermanager->layers()) {
+        if (layer.part != part) continue;
+        channels.insert(channels.end(), layer.channels.begin(), layer.channels.end());
+    }
+    return channels;
+}
+
+ReadInputs current_read_inputs()
+{
+    return { reader->current_request(), {
+        USE_PREFETCH, USE_BANDS, USE_DISK_CACHE, USE_CHANNEL_ARRAY, USE_CHANNEL_CACHE,
+        USE_PBO_STREAM, READ_DIRECTLY_TO_PBO, channel_array->full_float, is_playing
+    } };
+}
+
+/// read the current frame with the selected path, and draw it with the renderer
+/// return false while the frame is still arriving eg. band by band
+bool read_and_upload()
 {
     auto [display_width, display_height] = reader->size();
+    bool complete = true;
 
-    if (USE_PBO_STREAM)
+    // while stepping through layers and nearby frames, every channel of the part is kept decoded in memory
+    // another layer is gathered from it, without reading the file. playback reads a single layer per frame
+    std::shared_ptr<const ChannelCache::Frame> cached;
+    if (USE_CHANNEL_CACHE && !USE_CHANNEL_ARRAY && !is_playing)
+    {
+        ReadRequest request = reader->current_request();
+        channel_cache->update(request, part_channels(request.part));
+        cached = channel_cache->find(request);
+    }
+    if (!cached) gathered = { -1, -1, {} }; // pixels are overwritten by the other paths
+
+    // take the frame from the read-ahead ring when it is already decoded, or copied from the disk cache
+    // the cache and the read-ahead ring hold the channels of a single layer, not used with the channel array
+    const SequencePrefetcher::Slot* prefetched = NULL;
+    if (USE_PREFETCH && !USE_CHANNEL_ARRAY)
+    {
+        prefetcher->update(reader->current_request());
+        if (!cached) prefetched = prefetcher->acquire(reader->current_request());
+    }
+
+    // on a read-ahead miss, frames decoded before, in this or an earlier session, are mapped from the disk cache
+    std::unique_ptr<DiskFrameCache::Entry> spilled;
+    if (USE_DISK_CACHE && !USE_CHANNEL_ARRAY && !cached && !prefetched) {
+        spilled = disk_cache->open(disk_cache_key(sequence, reader->current_request()));
+    }
+
+    if (USE_CHANNEL_ARRAY)
+    {
+        // the part is read only when the frame, roi or level changes. a layer is a choice of slices
+        ReadRequest request = reader->current_request();
+        request.channels = part_channels(request.part);
+        channel_array->load(reader.get(), request);
+
+        const Layer* layer = exr_layermanager->selected_layer();
+        auto slices = channel_array->slices(layer ? layer->channels : reader->selected_channels());
+        renderer->update_from_array(channel_array->texture(), channel_array->bbox(), slices, channel_array->level());
+    }
+    else if (cached)
+    {
+        // the renderer keeps the texture until the layer, or the frame changes
+        ReadRequest request = reader->current_request();
+        if (!(request == gathered))
+        {
+            channel_cache->gather(*cached, request.channels, pixels);
+            renderer->update_from_data(pixels, cached->bbox, request.channels, GL_HALF_FLOAT, cached->level);
+            submit_for_analysis(pixels, cached->bbox, cached->level, request.channels);
+            gathered = request;
+        }
+    }
+    else if (spilled)
+    {
+        if (spilled->typesize == sizeof(half)) submit_for_analysis(spilled->pixels, spilled->bbox, spilled->level, spilled->channels);
+        if (USE_PBO_STREAM)
+        {
+            // mapped file to pbo
+            pbostream->write((void*)spilled->pixels, spilled->bbox, spilled->channels, spilled->typesize, spilled->level);
+
+            // pbo to texture
+            auto& pbo = pbostream->pbos[pbostream->display_index];
+            renderer->update_from_pbo(pbo.id, pbo.bbox, pbo.channels, GL_HALF_FLOAT, pbo.level);
+            pbostream->fence(pbostream->display_index);
+        }
+        else
+        {
+            renderer->update_from_data(spilled->pixels, spilled->bbox, spilled->channels, GL_HALF_FLOAT, spilled->level);
+        }
+    }
+    else if (prefetched)
+    {
+        spill_to_disk(prefetched->request, prefetched->data, prefetched->bbox, prefetched->level);
+        submit_for_analysis(prefetched->data, prefetched->bbox, prefetched->level, prefetched->request.channels);
+
+        if (prefetch_pbos)
+        {
+            // decoded straight into a mapped pbo by a worker
+            prefetch_pbos->commit(prefetched->index, prefetched->bbox, prefetched->request.channels, prefetched->level);
+            auto& pbo = prefetch_pbos->pbos[prefetched->index];
+            renderer->update_from_pbo(pbo.id, pbo.bbox, pbo.channels, GL_HALF_FLOAT, pbo.level);
+            prefetch_pbos->fence(prefetched->index);
+        }
+        else if (USE_PBO_STREAM)
+        {
+            // memory to pbo
+            pbostream->write(prefetched->data, prefetched->bbox, prefetched->request.channels, sizeof(half), prefetched->level);
+
+            // pbo to texture
+            auto& pbo = pbostream->pbos[pbostream->display_index];
+            renderer->update_from_pbo(pbo.id, pbo.bbox, pbo.channels, GL_HALF_FLOAT, pbo.level);
+            pbostream->fence(pbostream->display_index);
+        }
+        else
+        {
+            renderer->update_from_data(prefetched->data, prefetched->bbox, prefetched->request.channels, GL_HALF_FLOAT, prefetched->level);
+        }
+        prefetcher->release(prefetched);
+    }
+    else if (USE_BANDS && !is_playing)
+    {
+        // decode in the background, and show the bands as they arrive
+        // playback keeps reading whole frames, so every frame is shown complete
+        if (!(banded_loader->request() == reader->current_request())) {
+            banded_loader->start(reader->current_request());
+        }
+        banded_loader->upload(renderer.get());
+        if (banded_loader->done() && banded_loader->success()) {
+            spill_to_disk(banded_loader->request(), banded_loader->memory(), banded_loader->bbox(), banded_loader->level());
+            submit_for_analysis(banded_loader->memory(), banded_loader->bbox(), banded_loader->level(), banded_loader->request().channels);
+        }
+        complete = banded_loader->done();
+    }
+    else if (USE_PBO_STREAM)
     {
         if (!READ_DIRECTLY_TO_PBO)
         {
             // read to memory
             //reader->memory = pixels;
             reader->read();
+            spill_to_disk(reader->current_request(), pixels, reader->bbox(), reader->level());
+            submit_for_analysis(pixels, reader->bbox(), reader->level(), reader->selected_channels());
 
             // memory to pbo
-            pbostream->write(pixels, reader->bbox(), reader->selected_channels(), sizeof(half));
+            pbostream->write(pixels, reader->bbox(), reader->selected_channels(), sizeof(half), reader->level());
 
             // pbo to texture
             auto& pbo = pbostream->pbos[pbostream->display_index];
-            renderer->update_from_pbo(pbo.id, pbo.bbox, pbo.channels, GL_HALF_FLOAT);
+            renderer->update_from_pbo(pbo.id, pbo.bbox, pbo.channels, GL_HALF_FLOAT, pbo.level);
+            pbostream->fence(pbostream->display_index);
         }
         else
         {
@@ -175,26 +505,50 @@ void update()
             pbostream->begin();
             if (pbostream->ptr)
             {
-                reader->memory = pbostream->ptr; // ptr is not persistent, but changing when mapped. so must update each frame
+                reader->memory = pbostream->ptr; // the mapping is persistent, but each frame goes to the next free slot
                 reader->read();
             }
 
-            pbostream->end(reader->bbox(), reader->selected_channels());
+            pbostream->end(reader->bbox(), reader->selected_channels(), reader->level());
 
             // pbo to texture
             auto& display_pbo = pbostream->pbos[pbostream->display_index];
-            renderer->update_from_pbo(display_pbo.id, display_pbo.bbox, display_pbo.channels, GL_HALF_FLOAT);
+            renderer->update_from_pbo(display_pbo.id, display_pbo.bbox, display_pbo.channels, GL_HALF_FLOAT, display_pbo.level);
+            pbostream->fence(pbostream->display_index);
         }
     }
     else
     {
         //reader->memory = pixels;
         reader->read();
-        
-        renderer->update_from_data(pixels, reader->bbox(), reader->selected_channels(), GL_HALF_FLOAT);
+        spill_to_disk(reader->current_request(), pixels, reader->bbox(), reader->level());
+        submit_for_analysis(pixels, reader->bbox(), reader->level(), reader->selected_channels());
+
+        renderer->update_from_data(pixels, reader->bbox(), reader->selected_channels(), GL_HALF_FLOAT, reader->level());
     }
+    return complete;
+}
 
-    correction_plate->set_input_tex(renderer->color_attachment);
+void update()
+{
+    reader->roi = USE_ROI ? read_roi : std::tuple<int, int, int, int>{ 0,0,0,0 };
+    reader->requested_level = USE_LEVELS ? read_level : 0;
+
+    // each stage runs only when one of its inputs changed: an idle viewer reads, uploads and corrects nothing
+    // read and upload: the frame, layer, roi, level and read path
+    const ReadInputs inputs = current_read_inputs();
+    if (needs_update || force_update || !(inputs == shown))
+    {
+        shown = read_and_upload() ? inputs : ReadInputs{};
+        needs_update = false;
+    }
+    else if (USE_PREFETCH && !USE_CHANNEL_ARRAY)
+    {
+        prefetcher->update(inputs.request); // refill the slots the GPU has finished with
+    }
+
+    // correct: the drawn frame, gain, gamma and device
+    correction_plate->set_input_tex(renderer->color_attachment, renderer->revision);
     correction_plate->evaluate();
 }
 
@@ -250,16 +604,52 @@ int main(int argc, char* argv[])
     /// Run main loop
     while (glazy::is_running())
     {
-        glazy::new_frame();
+        glazy::new_frame(true); // sleep while idle
 
         try {
 
+            // follow frames appearing on disk eg. while the sequence is rendering
+            if (FOLLOW_SEQUENCE && sequence.update_range())
+            {
+                first_frame = sequence.first_frame;
+                last_frame = sequence.last_frame;
+                if (prefetcher) prefetcher->set_range(first_frame, last_frame);
+                if (channel_cache) channel_cache->set_range(first_frame, last_frame);
+                sequence_index = std::make_unique<SequenceIndex>(sequence, sequence_index.get()); // only the new frames are parsed
+            }
+
+            // frames rewritten in place eg. by a render started again: drop their decoded pixels
+            if (sequence.scanner)
+            {
+                auto modified = sequence.scanner->take_modified();
+                if (!modified.empty()) sequence_index = std::make_unique<SequenceIndex>(sequence, sequence_index.get()); // only the rewritten frames are parsed again
+                for (int frame : modified)
+                {
+                    if (prefetcher) prefetcher->invalidate(frame);
+                    if (channel_array) channel_array->invalidate(frame);
+                    if (aov_grid) aov_grid->invalidate(frame);
+                    if (banded_loader && banded_loader->request().frame == frame) banded_loader->start(banded_loader->request());
+                    if (frame == F) needs_update = true;
+                }
+                if (!modified.empty() && channel_cache) {
+                    channel_cache->clear(); // nearby frames only, read again in the background
+                    gathered = { -1, -1, {} };
+                }
+            }
+
             if (is_playing)
             {
-                F++;
-                if (F > last_frame) F = first_frame;
-                reader->set_current_frame(F);
-                needs_update = true;
+                const auto now = std::chrono::steady_clock::now();
+                if (!playback_clock.running()) playback_clock.start(F, now);
+                const int due = playback_clock.due(now, first_frame, last_frame);
+                if (due != F) {
+                    F = due;
+                    reader->set_current_frame(F);
+                }
+            }
+            else if (playback_clock.running())
+            {
+                playback_clock.stop();
             }
 
             if (ImGui::IsKeyPressed('F')) {
@@ -287,6 +677,13 @@ int main(int argc, char* argv[])
 
                 if (ImGui::BeginMenu("Windows")) {
                     ImGui::MenuItem("sidebar", "", &sidebar_visible);
+                    ImGui::MenuItem("AOV grid", "", &aov_grid_visible);
+                    if (ImGui::MenuItem("scopes", "", &scopes_visible) && scopes_visible) {
+                        needs_update = true; // analyse the frame on screen
+                    }
+                    if (ImGui::MenuItem("statistics", "", &stats_visible) && stats_visible) {
+                        needs_update = true;
+                    }
                     ImGui::EndMenu();
                 }
 
@@ -389,44 +786,54 @@ int main(int argc, char* argv[])
 
                 ImGui::BeginGLViewer(&viewer_state.viewport_fbo, &viewer_state.viewport_color_attachment, &viewer_state.camera, { -1,-1 });
                 {
-                    glClearColor(0, 0, 0, 0);
-                    glClear(GL_COLOR_BUFFER_BIT);
-                    imdraw::set_projection(viewer_state.camera.getProjection());
-                    imdraw::set_view(viewer_state.camera.getView());
-                    glm::mat4 M{ 1 };
-                    M = glm::scale(M, { renderer->width / 2, renderer->height / 2, 1 });
-                    M = glm::translate(M, { 1,1, 0 });
-
-                    if (selected_viewport_background == 1)
+                    // composite: redrawn when the camera, the viewport size, the background or the corrected frame changed
+                    const CompositeInputs composite_inputs{
+                        viewer_state.camera.getView(), viewer_state.camera.getProjection(),
+                        viewer_state.viewport_color_attachment, ImGui::GetItemRectSize().x, ImGui::GetItemRectSize().y,
+                        selected_viewport_background, correction_plate->revision()
+                    };
+                    if (force_update || !(composite_inputs == composited))
                     {
-                        checker_plate->set_uniforms({
-                            {"projection", viewer_state.camera.getProjection()},
-                            {"view", viewer_state.camera.getView()},
-                            {"model", M},
-                            {"tile_size", 8}
-                            });
-                        checker_plate->render();
-                    }
+                        composited = composite_inputs;
+                        glClearColor(0, 0, 0, 0);
+                        glClear(GL_COLOR_BUFFER_BIT);
+                        imdraw::set_projection(viewer_state.camera.getProjection());
+                        imdraw::set_view(viewer_state.camera.getView());
+                        glm::mat4 M{ 1 };
+                        M = glm::scale(M, { renderer->width / 2, renderer->height / 2, 1 });
+                        M = glm::translate(M, { 1,1, 0 });
+
+                        if (selected_viewport_background == 1)
+                        {
+                            checker_plate->set_uniforms({
+                                {"projection", viewer_state.camera.getProjection()},
+                                {"view", viewer_state.camera.getView()},
+                                {"model", M},
+                                {"tile_size", 8}
+                                });
+                            checker_plate->render();
+                        }
 
-                    if (selected_viewport_background == 0)
-                    {
-                        black_plate->set_uniforms({
-                            {"projection", viewer_state.camera.getProjection()},
-                            {"view", viewer_state.camera.getView()},
-                            {"model", M},
-                            {"uColor", glm::vec3(0,0,0)}
-                            });
-                        black_plate->render();
-                    }
+                        if (selected_viewport_background == 0)
+                        {
+                            black_plate->set_uniforms({
+                                {"projection", viewer_state.camera.getProjection()},
+                                {"view", viewer_state.camera.getView()},
+                                {"model", M},
+                                {"uColor", glm::vec3(0,0,0)}
+                                });
+                            black_plate->render();
+                        }
 
-                    //polka_plate->set_uniforms({
-                    //    {"projection", viewer_state.camera.getProjection()},
-                    //    {"view", viewer_state.camera.getView()},
-                    //    {"model", glm::mat4(1)},
-                    //    {"radius", 0.01f}
-                    //});
-                    //polka_plate->render();
-                    correction_plate->render();
+                        //polka_plate->set_uniforms({
+                        //    {"projection", viewer_state.camera.getProjection()},
+                        //    {"view", viewer_state.camera.getView()},
+                        //    {"model", glm::mat4(1)},
+                        //    {"radius", 0.01f}
+                        //});
+                        //polka_plate->render();
+                        correction_plate->render();
+                    }
 
                     // display spec
                     
@@ -466,6 +873,8 @@ int main(int argc, char* argv[])
                         }
                         {
                             auto [x, y, w, h] = renderer->m_bbox;
+                            const int scale = 1 << renderer->m_level; // bbox is in level pixels
+                            x *= scale; y *= scale; w *= scale; h *= scale;
                             glm::vec2 pos = { x, height-y };
 
                             glm::vec3 screen_pos = glm::project(glm::vec3(pos, 0.0), viewer_state.camera.getView(), viewer_state.camera.getProjection(), glm::vec4(0, 0, item_size.x, item_size.y));
@@ -477,6 +886,8 @@ int main(int argc, char* argv[])
 
                         {
                             auto [x, y, w, h] = renderer->m_bbox;
+                            const int scale = 1 << renderer->m_level; // bbox is in level pixels
+                            x *= scale; y *= scale; w *= scale; h *= scale;
                             glm::vec2 pos = { x+w, height- (y+h) };
                             
                             glm::vec3 screen_pos = glm::project(glm::vec3(pos, 0.0), viewer_state.camera.getView(), viewer_state.camera.getProjection(), glm::vec4(0, 0, item_size.x, item_size.y));
@@ -489,9 +900,106 @@ int main(int argc, char* argv[])
                         ImGui::PopStyleColor();
                     }                }
                 ImGui::EndGLViewer();
+
+                if (stats_visible) {
+                    const auto viewer_pos = ImGui::GetItemRectMin();
+                    const auto viewer_size = ImGui::GetItemRectSize();
+                    const auto& camera = viewer_state.camera;
+                    const int height = renderer->height;
+
+                    // shift drag a region, the camera control keeps the mouse
+                    ImVec2 mouse_pos;
+                    const bool on_image = ImGui::GLViewerImagePos(camera, viewer_size, height, ImGui::GetIO().MousePos - viewer_pos, &mouse_pos);
+                    if (ImGui::IsItemHovered(ImGuiHoveredFlags_AllowWhenBlockedByActiveItem) && ImGui::IsMouseClicked(0) && ImGui::GetIO().KeyShift && on_image) {
+                        stats_dragging = true;
+                        stats_anchor = mouse_pos;
+                    }
+                    if (stats_dragging) {
+                        if (on_image) {
+                            const int x0 = (int)std::floor(std::min(stats_anchor.x, mouse_pos.x)), x1 = (int)std::ceil(std::max(stats_anchor.x, mouse_pos.x));
+                            const int y0 = (int)std::floor(std::min(stats_anchor.y, mouse_pos.y)), y1 = (int)std::ceil(std::max(stats_anchor.y, mouse_pos.y));
+                            stats_region = { x0, y0, x1 - x0, y1 - y0 };
+                        }
+                        if (!ImGui::IsMouseDown(0)) stats_dragging = false;
+                    }
+
+                    auto draw_list = ImGui::GetWindowDrawList();
+                    draw_list->PushClipRect(viewer_pos, viewer_pos + viewer_size, true);
+                    if (GLuint overlay = pixel_stats->overlay_texture())
+                    {
+                        // over the data window of the measured frame
+                        auto [x, y, w, h] = pixel_stats->tables()->bbox;
+                        const int scale = 1 << pixel_stats->tables()->level;
+                        auto top_left = ImGui::GLViewerViewportPos(camera, viewer_size, height, ImVec2(x * scale, y * scale));
+                        auto bottom_right = ImGui::GLViewerViewportPos(camera, viewer_size, height, ImVec2((x + w) * scale, (y + h) * scale));
+                        draw_list->AddImage((ImTextureID)overlay, viewer_pos + top_left, viewer_pos + bottom_right);
+                    }
+                    auto [x, y, w, h] = stats_region;
+                    if (w > 0 && h > 0)
+                    {
+                        auto top_left = ImGui::GLViewerViewportPos(camera, viewer_size, height, ImVec2(x, y));
+                        auto bottom_right = ImGui::GLViewerViewportPos(camera, viewer_size, height, ImVec2(x + w, y + h));
+                        draw_list->AddRect(viewer_pos + top_left, viewer_pos + bottom_right, ImColor(1.0f, 1.0f, 1.0f, 0.8f));
+                    }
+                    draw_list->PopClipRect();
+                }
+
+                if (USE_ROI) {
+                    auto visible = ImGui::GLViewerVisibleRect(viewer_state.camera, ImGui::GetItemRectSize(), renderer->width, renderer->height);
+                    if (update_read_roi(visible, renderer->width, renderer->height)) {
+                        needs_update = true;
+                    }
+                }
+
+                if (USE_LEVELS) {
+                    // lowest resolution level that still has at least one texel per screen pixel
+                    float pixel_scale = ImGui::GLViewerPixelScale(viewer_state.camera, ImGui::GetItemRectSize());
+                    int level = pixel_scale > 0 ? std::max(0, (int)std::floor(std::log2(1.0f / pixel_scale))) : 0;
+                    if (level != read_level) {
+                        read_level = level;
+                        needs_update = true;
+                    }
+                }
             }
             ImGui::End();
 
+            if (aov_grid_visible)
+            {
+                if (ImGui::Begin("AOV grid", &aov_grid_visible))
+                {
+                    // follows the current frame, decoded in the background. not during playback, while the workers read ahead
+                    if (!is_playing) {
+                        aov_grid->load(reader.get(), reader->current_frame(), exr_layermanager->layers());
+                    }
+                    int clicked = aov_grid->onGUI(exr_layermanager->selected_layer());
+                    if (clicked >= 0) {
+                        exr_layermanager->set_selected_layer(clicked);
+                        reader->set_selected_part_idx(exr_layermanager->selected_layer()->part);
+                        reader->set_selected_channels(exr_layermanager->selected_layer()->channels);
+                        needs_update = true;
+                    }
+                }
+                ImGui::End();
+            }
+
+            if (scopes_visible)
+            {
+                if (ImGui::Begin("Scopes", &scopes_visible))
+                {
+                    scopes->onGUI();
+                }
+                ImGui::End();
+            }
+
+            if (stats_visible)
+            {
+                if (ImGui::Begin("Statistics", &stats_visible))
+                {
+                    pixel_stats->onGUI(stats_region);
+                }
+                ImGui::End();
+            }
+
             {
                 auto viewsize = ImGui::GetMainViewport()->WorkSize;
                 ImGui::SetNextWindowSize({ 300, viewsize.y * 2 / 3 });
@@ -505,8 +1013,53 @@ int main(int argc, char* argv[])
                         {
                             if (ImGui::BeginTabItem("Info (current file)"))
                             {
-                                auto file = Imf::MultiPartInputFile(sequence.item(reader->current_frame()).string().c_str());
-                                ImGui::TextWrapped(get_infostring(file).c_str());
+                                if (auto info = sequence_index->frame(reader->current_frame()))
+                                {
+                                    if (!info->valid) ImGui::TextColored(ImVec4(1, 0, 0, 1), "missing or invalid frame");
+                                    for (const auto& part : info->parts)
+                                    {
+                                        ImGui::Text("part: %s", part.name.c_str());
+                                        auto [dx, dy, dw, dh] = part.data_window;
+                                        auto [ox, oy, ow, oh] = part.display_window;
+                                        ImGui::Text("  dataWindow: %d %d %dx%d", dx, dy, dw, dh);
+                                        ImGui::Text("  displayWindow: %d %d %dx%d", ox, oy, ow, oh);
+                                        ImGui::Text("  compression: %s", printCompression((Imf::Compression)part.compression).c_str());
+                                        ImGui::Text("  %s, %d chunks", part.tiled ? "tiled" : "scanline", (int)part.chunk_offsets.size());
+                                        ImGui::TextWrapped("  channels: %s", join_string(part.channels, ", ").c_str());
+                                    }
+                                }
+                                else {
+                                    ImGui::Text("indexing...");
+                                }
+
+                                if (ImGui::CollapsingHeader("Sequence index")) {
+                                    sequence_index->onGUI();
+                                }
+
+                                if (ImGui::CollapsingHeader("All attributes"))
+                                {
+                                    // opening the file is slow, parse once per file. the attributes of every part are listed
+                                    // keyed by path and write time: frame numbers repeat across sequences, and frames are rewritten
+                                    static std::filesystem::path infostring_path;
+                                    static std::filesystem::file_time_type infostring_mtime;
+                                    static std::string infostring;
+                                    const auto path = sequence.item(reader->current_frame());
+                                    std::error_code ec;
+                                    const auto mtime = std::filesystem::last_write_time(path, ec);
+                                    if (infostring_path != path || infostring_mtime != mtime)
+                                    {
+                                        infostring_path = path;
+                                        infostring_mtime = mtime;
+                                        try {
+                                            auto file = Imf::MultiPartInputFile(path.string().c_str());
+                                            infostring = get_infostring(file);
+                                        }
+                                        catch (const std::exception& ex) {
+                                            infostring = ex.what();
+                                        }
+                                    }
+                                    ImGui::TextWrapped(infostring.c_str());
+                                }
                                 ImGui::EndTabItem();
                             }
 
@@ -520,12 +1073,20 @@ int main(int argc, char* argv[])
                                     }
                                     ImGui::LabelText("range", "%d-%d", sequence.first_frame, sequence.last_frame);
 
+                                    ImGui::Checkbox("follow", &FOLLOW_SEQUENCE);
+                                    if (ImGui::IsItemHovered()) ImGui::SetTooltip("extend the range when frames are added on disk");
+                                    if (sequence.scanner && !sequence.scanner->watching()) {
+                                        ImGui::SameLine();
+                                        if (ImGui::Button("rescan")) sequence.scanner->rescan();
+                                        if (ImGui::IsItemHovered() && sequence.scanner->polling()) ImGui::SetTooltip("no file system notifications eg. on a network share, listed every %d s", SequenceScanner::poll_interval_ms / 1000);
+                                    }
+
                                     const auto& missing_frames = sequence.missing_frames();
                                     if (!missing_frames.empty())
                                     {
                                         ImGui::PushStyleColor(ImGuiCol_Text, ImVec4(1, 0, 0,1));
                                         std::string missing_frames_string;
-                                        for (auto F : sequence.missing_frames()) {
+                                        for (auto F : missing_frames) {
                                             missing_frames_string += std::to_string(F) + ", ";
                                         }
                                         ImGui::LabelText("missing frames", "%s", missing_frames_string.c_str());
@@ -549,16 +1110,101 @@ int main(int argc, char* argv[])
                                     };
                                     if (ImGui::Combo("using", &current, {"<None>", "EXR", "OIIO" }))
                                     {
+                                        prefetcher.reset(); // workers hold the old reader
+                                        banded_loader.reset();
+                                        channel_cache.reset();
                                         if (current == 1) {
                                             reader = std::make_unique<EXRSequenceReader>(sequence);
                                         }
                                         else {
                                             reader = std::make_unique<OIIOSequenceReader>(sequence);
                                         }
-                                        
+                                        auto [display_width, display_height] = reader->size();
+                                        make_prefetcher();
+                                        banded_loader = std::make_unique<BandedFrameLoader>(reader.get(), (size_t)display_width * display_height * 4 * sizeof(half));
+                                        banded_loader->on_finished = []() { glazy::request_redraw(); };
+                                        channel_cache = std::make_unique<ChannelCache>(reader.get(), first_frame, last_frame, (size_t)display_width * display_height * sizeof(half));
+                                        gathered = { -1, -1, {} };
+                                        needs_update = true;
                                     }
                                     reader->onGUI();
                                 }
+                                if (ImGui::CollapsingHeader("Region of interest", ImGuiTreeNodeFlags_DefaultOpen))
+                                {
+                                    ImGui::Checkbox("read visible region only", &USE_ROI);
+                                    ImGui::Checkbox("read lower levels when zoomed out", &USE_LEVELS);
+                                    auto [x, y, w, h] = read_roi;
+                                    ImGui::LabelText("roi", "%d, %d, %dx%d", x, y, w, h);
+                                    ImGui::LabelText("level", "%d (decoded: %d)", read_level, renderer->m_level);
+                                    auto [bx, by, bw, bh] = renderer->m_bbox;
+                                    ImGui::LabelText("decoded", "%d, %d, %dx%d", bx, by, bw, bh);
+                                }
+                                if (ImGui::CollapsingHeader("Prefetch", ImGuiTreeNodeFlags_DefaultOpen))
+                                {
+                                    ImGui::Checkbox("read ahead", &USE_PREFETCH);
+                                    if (USE_PREFETCH) {
+                                        prefetcher->onGUI();
+                                        if (prefetch_pbos) {
+                                            prefetch_pbos->onGUI();
+                                        }
+                                    }
+                                }
+                                if (ImGui::CollapsingHeader("Playback", ImGuiTreeNodeFlags_DefaultOpen))
+                                {
+                                    static const std::array<double, 6> rates{ 24000.0 / 1001, 24, 25, 30, 48, 60 };
+                                    static const std::array<const char*, 6> rate_labels{ "23.976", "24", "25", "30", "48", "60" };
+                                    int rate = std::distance(rates.begin(), std::find(rates.begin(), rates.end(), playback_clock.fps));
+                                    if (ImGui::Combo("fps", &rate, rate_labels.data(), rate_labels.size())) {
+                                        playback_clock.fps = rates[rate];
+                                        if (is_playing) playback_clock.start(F, std::chrono::steady_clock::now());
+                                    }
+                                    ImGui::Checkbox("drop frames", &playback_clock.drop_frames);
+                                    if (ImGui::IsItemHovered()) ImGui::SetTooltip("skip frames that are not decoded in time, instead of slowing down");
+
+                                    ImGui::LabelText("achieved", "%.2f fps", playback_clock.achieved_fps());
+                                    ImGui::LabelText("dropped", "%d", playback_clock.dropped());
+                                    ImGui::LabelText("late", "%d", playback_clock.late());
+                                    ImGui::LabelText("jitter", "%.2f ms", playback_clock.jitter());
+
+                                    const auto intervals = playback_clock.intervals();
+                                    ImGui::PlotLines("intervals", intervals.data(), intervals.size(), 0, "ms between frames", 0, 2000 / playback_clock.fps, { 0, 40 });
+                                    const auto& histogram = playback_clock.histogram();
+                                    ImGui::PlotHistogram("error", histogram.data(), histogram.size(), 0, "-16 .. +16 ms", 0, FLT_MAX, { 0, 40 });
+                                }
+                                if (ImGui::CollapsingHeader("Progressive", ImGuiTreeNodeFlags_DefaultOpen))
+                                {
+                                    ImGui::Checkbox("show frames while decoding", &USE_BANDS);
+                                    if (USE_BANDS) {
+                                        banded_loader->onGUI();
+                                    }
+                                }
+                                if (ImGui::CollapsingHeader("Channel cache"))
+                                {
+                                    if (ImGui::Checkbox("keep every channel of nearby frames", &USE_CHANNEL_CACHE)) {
+                                        channel_cache->clear();
+                                    }
+                                    if (ImGui::IsItemHovered()) ImGui::SetTooltip("decode all the channels of the part, and switch layers without reading");
+                                    if (USE_CHANNEL_CACHE) {
+                                        channel_cache->onGUI();
+                                    }
+                                }
+                                if (ImGui::CollapsingHeader("Channel array"))
+                                {
+                                    ImGui::Checkbox("keep every channel on the GPU", &USE_CHANNEL_ARRAY);
+                                    if (ImGui::IsItemHovered()) ImGui::SetTooltip("read all the channels of the part at once, and switch layers without reading");
+                                    if (USE_CHANNEL_ARRAY) {
+                                        channel_array->onGUI();
+                                    }
+                                }
+                                if (ImGui::CollapsingHeader("Disk cache"))
+                                {
+                                    if (ImGui::Checkbox("spill decoded frames to disk", &USE_DISK_CACHE)) {
+                                        needs_update = true;
+                                    }
+                                    if (USE_DISK_CACHE) {
+                                        disk_cache->onGUI();
+                                    }
+                                }
                                 if (ImGui::CollapsingHeader("PBO Stream", ImGuiTreeNodeFlags_DefaultOpen))
                                 {
                                     if (ImGui::Checkbox("use pbostream", &USE_PBO_STREAM)) {
@@ -568,6 +1214,7 @@ int main(int argc, char* argv[])
                                         else {
                                             reader->memory = pixels;
                                         }
+                                        make_prefetcher();
                                     };
                                     if (USE_PBO_STREAM)
                                     {
@@ -578,7 +1225,12 @@ int main(int argc, char* argv[])
                                             else {
                                                 reader->memory = pixels;
                                             }
+                                            make_prefetcher();
                                         };
+                                        int buffer_size = pbostream->pbos.size();
+                                        if (ImGui::InputInt("buffer size", &buffer_size) && buffer_size > 0) {
+                                            pbostream->reformat(pbostream->m_width, pbostream->m_height, 4, buffer_size);
+                                        }
                                         pbostream->onGUI();
                                     }
                                     else {
@@ -607,12 +1259,24 @@ int main(int argc, char* argv[])
                     if (ImGui::Frameslider("timeslider", &is_playing, &F, first_frame, last_frame)) {
                         reader->set_current_frame(F);
                         needs_update = true;
+                        if (is_playing) playback_clock.start(F, std::chrono::steady_clock::now()); // continue from the picked frame
                     }
                 }
                 ImGui::End();
             }
 
             update();
+            if (is_playing && shown.request.frame == F) {
+                playback_clock.presented(std::chrono::steady_clock::now());
+            }
+
+            // wake from the idle wait for the next frame of the playback, and the bands of a progressive read
+            if (is_playing) {
+                glazy::wake_at(playback_clock.next_tick());
+            }
+            if (!(shown == current_read_inputs())) { // still arriving
+                glazy::wake_at(std::chrono::steady_clock::now() + std::chrono::milliseconds(30));
+            }
 
             glazy::end_frame();
             FrameMark;
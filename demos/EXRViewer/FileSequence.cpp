@@ -7,9 +7,10 @@ FileSequence::FileSequence(std::filesystem::path filepath) {
     pattern = format.string();
     first_frame = begin;
     last_frame = end;
+    scanner = std::make_shared<SequenceScanner>(format, begin, end);
 }
 
-std::filesystem::path FileSequence::item(int F)
+std::filesystem::path FileSequence::item(int F) const
 {
     if (pattern.empty()) return std::filesystem::path();
 
@@ -28,14 +29,16 @@ std::filesystem::path FileSequence::item(int F)
 
 std::vector<int> FileSequence::missing_frames()
 {
-    std::vector<int> missing_frames;
-    for (int F = first_frame; F <= last_frame; F++) {
-        auto framepath = this->item(F);
-        bool exists = std::filesystem::exists(framepath);
-        if (!exists)
-        {
-            missing_frames.push_back(F);
-        }
-    }
-    return missing_frames;
-}
\ No newline at end of file
+    if (!scanner) return {};
+    return scanner->missing_frames();
+}
+
+bool FileSequence::update_range()
+{
+    if (!scanner) return false;
+    auto [begin, end] = scanner->range();
+    if (begin == first_frame && end == last_frame) return false;
+    first_frame = begin;
+    last_frame = end;
+    return true;
+}
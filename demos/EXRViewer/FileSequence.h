@@ -1,6 +1,10 @@
 #pragma once
 #include <filesystem>
 #include <string>
+#include <vector>
+#include <memory>
+
+class SequenceScanner;
 
 class FileSequence
 {
@@ -13,7 +17,10 @@ public:
 
     FileSequence(std::filesystem::path filepath);
 
-    std::filesystem::path item(int F);
+    std::filesystem::path item(int F) const;
+
+    /// printf pattern of the frame paths eg. "render.%04d.exr"
+    const std::string& get_pattern() const { return pattern; }
 
     
     int first_frame;
@@ -24,4 +31,11 @@ public:
     }
 
     std::vector<int> missing_frames();
+
+    /// follow frames appearing on disk: extend first_frame and last_frame to the frames found by the scanner
+    /// return true when the range changed
+    bool update_range();
+
+    /// frames on disk, shared between copies of the sequence
+    std::shared_ptr<SequenceScanner> scanner;
 };
\ No newline at end of file
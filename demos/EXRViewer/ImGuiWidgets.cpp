@@ -11,6 +11,10 @@
 #include "imdraw/imdraw.h"
 #include "imdraw/imdraw_internal.h"
 
+#include <glm/gtc/matrix_transform.hpp> // unProject
+#include <algorithm>
+#include <cfloat>
+
 bool ImGui::Frameslider(const char* label, bool* is_playing, int* v, int v_min, int v_max, const char* format, ImGuiSliderFlags flags)
 {
     bool changed = false;
@@ -105,7 +109,7 @@ bool ImGui::CameraControl(Camera* camera, ImVec2 item_size)
             camera->orbit(-ImGui::GetIO().MouseDelta.x * 0.006, -ImGui::GetIO().MouseDelta.y * 0.006);
             changed = true;
         }
-        else if (ImGui::IsMouseDragging(0) || ImGui::IsMouseDragging(2))// && !ImGui::GetIO().KeyMods)
+        else if ((ImGui::IsMouseDragging(0) && !ImGui::GetIO().KeyShift) || ImGui::IsMouseDragging(2)) // shift drag is left to the viewer eg. to select a region
         {
             camera->pan(-ImGui::GetIO().MouseDelta.x / item_size.x, -ImGui::GetIO().MouseDelta.y / item_size.y);
             changed = true;
@@ -179,4 +183,81 @@ void ImGui::BeginGLViewer(GLuint* fbo, GLuint* color_attachment, Camera* camera,
 void ImGui::EndGLViewer() {
     EndRenderToTexture();
     ImGui::EndGroup();
-}
\ No newline at end of file
+}
+
+/// cast a viewport position to the image plane (z=0)
+/// return false when the ray does not hit the plane
+static bool unproject_to_image_plane(const glm::vec2& screen_pos, const glm::mat4& view, const glm::mat4& projection, const glm::vec4& viewport, glm::vec3* P)
+{
+    auto near_point = glm::unProject(glm::vec3(screen_pos, 0.0f), view, projection, viewport);
+    auto far_point = glm::unProject(glm::vec3(screen_pos, 1.0f), view, projection, viewport);
+    auto dir = far_point - near_point;
+    float t = std::abs(dir.z) > 1e-6 ? -near_point.z / dir.z : -1;
+    if (t < 0) return false;
+    *P = near_point + dir * t;
+    return true;
+}
+
+std::tuple<int, int, int, int> ImGui::GLViewerVisibleRect(const Camera& camera, const ImVec2& viewport_size, int width, int height)
+{
+    const auto view = camera.getView();
+    const auto projection = camera.getProjection();
+    const glm::vec4 viewport(0, 0, viewport_size.x, viewport_size.y);
+
+    // cast the viewport corners to the image plane
+    float xmin{ FLT_MAX }, ymin{ FLT_MAX }, xmax{ -FLT_MAX }, ymax{ -FLT_MAX };
+    for (const auto& corner : { glm::vec2(0, 0), glm::vec2(viewport_size.x, 0), glm::vec2(0, viewport_size.y), glm::vec2(viewport_size.x, viewport_size.y) })
+    {
+        glm::vec3 P;
+        if (!unproject_to_image_plane(corner, view, projection, viewport, &P)) {
+            return { 0, 0, width, height }; // corner does not hit the plate eg. orbited camera: everything may be visible
+        }
+        xmin = std::min(xmin, P.x);
+        xmax = std::max(xmax, P.x);
+        ymin = std::min(ymin, P.y);
+        ymax = std::max(ymax, P.y);
+    }
+
+    // world y goes up, image rows go down
+    int x0 = std::clamp((int)std::floor(xmin), 0, width);
+    int x1 = std::clamp((int)std::ceil(xmax), 0, width);
+    int y0 = std::clamp((int)std::floor(height - ymax), 0, height);
+    int y1 = std::clamp((int)std::ceil(height - ymin), 0, height);
+    return { x0, y0, x1 - x0, y1 - y0 };
+}
+
+float ImGui::GLViewerPixelScale(const Camera& camera, const ImVec2& viewport_size)
+{
+    const auto view = camera.getView();
+    const auto projection = camera.getProjection();
+    const glm::vec4 viewport(0, 0, viewport_size.x, viewport_size.y);
+
+    // measure an image pixel under the center of the viewport
+    glm::vec3 P;
+    if (!unproject_to_image_plane({ viewport_size.x / 2, viewport_size.y / 2 }, view, projection, viewport, &P)) {
+        return 1.0f;
+    }
+    auto a = glm::project(P, view, projection, viewport);
+    auto b = glm::project(P + glm::vec3(1, 0, 0), view, projection, viewport);
+    return glm::length(glm::vec2(b - a));
+}
+
+bool ImGui::GLViewerImagePos(const Camera& camera, const ImVec2& viewport_size, int height, const ImVec2& viewport_pos, ImVec2* image_pos)
+{
+    const glm::vec4 viewport(0, 0, viewport_size.x, viewport_size.y);
+
+    // viewport y goes down, gl window y goes up
+    glm::vec3 P;
+    if (!unproject_to_image_plane({ viewport_pos.x, viewport_size.y - viewport_pos.y }, camera.getView(), camera.getProjection(), viewport, &P)) {
+        return false;
+    }
+    *image_pos = ImVec2(P.x, height - P.y);
+    return true;
+}
+
+ImVec2 ImGui::GLViewerViewportPos(const Camera& camera, const ImVec2& viewport_size, int height, const ImVec2& image_pos)
+{
+    const glm::vec4 viewport(0, 0, viewport_size.x, viewport_size.y);
+    auto screen_pos = glm::project(glm::vec3(image_pos.x, height - image_pos.y, 0.0), camera.getView(), camera.getProjection(), viewport);
+    return ImVec2(screen_pos.x, viewport_size.y - screen_pos.y);
+}
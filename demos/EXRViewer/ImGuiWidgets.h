@@ -4,6 +4,7 @@
 #include "imgui.h"
 #include <vector>
 #include <string>
+#include <tuple>
 #include "Camera.h"
 #include "glad/glad.h"
 
@@ -24,4 +25,18 @@ namespace ImGui
     void BeginGLViewer(GLuint* fbo, GLuint* color_attachment, Camera* camera, const ImVec2& size_arg = ImVec2(0, 0));
 
     void EndGLViewer();
+
+    /// part of a width x height image visible through the camera, as x,y,w,h in image pixels (rows from the top, like a data window)
+    /// the image plate is drawn from the world origin to width, height
+    std::tuple<int, int, int, int> GLViewerVisibleRect(const Camera& camera, const ImVec2& viewport_size, int width, int height);
+
+    /// screen pixels per image pixel, at the center of the viewport
+    float GLViewerPixelScale(const Camera& camera, const ImVec2& viewport_size);
+
+    /// image pixel under a position of the viewport (rows from the top, like a data window)
+    /// return false when the position does not hit the image plane
+    bool GLViewerImagePos(const Camera& camera, const ImVec2& viewport_size, int height, const ImVec2& viewport_pos, ImVec2* image_pos);
+
+    /// position in the viewport of an image pixel, the inverse of GLViewerImagePos
+    ImVec2 GLViewerViewportPos(const Camera& camera, const ImVec2& viewport_size, int height, const ImVec2& image_pos);
 }
\ No newline at end of file
@@ -1,86 +1,98 @@
 #include "PBOImageStream.h"
 #include <iostream>
+#include <algorithm>
 #include "OpenEXR/half.h"
 #include "imgui.h"
 
 PBOImageStream::PBOImageStream(int width, int height, int channels, int n)
 {
     //ZoneScoped;
+    create(width, height, channels, n);
+}
+
+void PBOImageStream::create(int width, int height, int channels, int n)
+{
+    m_width = width;
+    m_height = height;
+    m_channels = channels;
     pbos.resize(n);
 
+    // only ever written by the CPU: reading a mapping back is uncached, the pixels are read from the decoded memory instead
+    const GLbitfield flags = GL_MAP_WRITE_BIT | GL_MAP_PERSISTENT_BIT | GL_MAP_COHERENT_BIT;
+    const GLsizeiptr bytes = std::max<size_t>(slot_bytes(), 1);
     for (auto i = 0; i < n; i++)
     {
         GLuint pbo;
         glGenBuffers(1, &pbo);
         glBindBuffer(GL_PIXEL_UNPACK_BUFFER, pbo);
-        glBufferData(GL_PIXEL_UNPACK_BUFFER, width * height * channels * sizeof(half), 0, GL_STREAM_DRAW);
+        glBufferStorage(GL_PIXEL_UNPACK_BUFFER, bytes, 0, flags);
         pbos[i].id = pbo;
+        pbos[i].ptr = (char*)glMapBufferRange(GL_PIXEL_UNPACK_BUFFER, 0, bytes, flags);
+        pbos[i].fence = NULL;
+        pbos[i].state = PBOState::Free;
         pbos[i].bbox = { 0,0, 0,0 };
+        if (!pbos[i].ptr) {
+            std::cerr << "cannot map PBO" << "\n";
+        }
     }
     glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
 
     display_index = 0;
-    write_index = (display_index + 1) % pbos.size();
+    write_index = -1;
+    ptr = NULL;
+}
 
-    m_width = width;
-    m_height = height;
+void PBOImageStream::destroy()
+{
+    // persistently mapped buffers are unmapped when deleted.
+    // the driver keeps the storage alive until pending uploads are done
+    for (auto i = 0; i < pbos.size(); i++) {
+        if (pbos[i].fence) glDeleteSync(pbos[i].fence);
+        glDeleteBuffers(1, &pbos[i].id);
+    }
+    pbos.clear();
 }
 
 void PBOImageStream::onGUI()
 {
-    int buffer_size = pbos.size();
-    if (ImGui::InputInt("buffer size", &buffer_size)) {
-        reformat(m_width, m_height, 4, buffer_size);
-    }
+    ImGui::LabelText("slots", "%d x %.1f MB", (int)pbos.size(), slot_bytes() / 1024.0 / 1024.0);
+    ImGui::LabelText("stalls", "%d", m_stalls);
+    if (ImGui::IsItemHovered()) ImGui::SetTooltip("writes that waited for the GPU to finish reading a slot");
 
+    // slot states
     for (auto i = 0; i < pbos.size(); i++)
     {
-
-        if (write_index == i) {
-            ImGui::PushStyleColor(ImGuiCol_Text, ImVec4(1, 0, 0, 1));
-        }
-        if (display_index == i) {
-            ImGui::PushStyleColor(ImGuiCol_Text, ImVec4(0, 1, 0, 1));
+        wait(i, 0); // show uploads as soon as they are done
+        const auto& pbo = pbos[i];
+        ImVec4 color;
+        const char* state = "";
+        switch (pbo.state) {
+        case PBOState::Free: color = ImVec4(0.5, 0.5, 0.5, 1); state = "free"; break;
+        case PBOState::Writing: color = ImVec4(1, 0, 0, 1); state = "writing"; break;
+        case PBOState::Ready: color = ImVec4(0, 1, 0, 1); state = "ready"; break;
+        case PBOState::Uploading: color = ImVec4(0, 0.5, 1, 1); state = "uploading"; break;
         }
-        ImGui::Text("%d", pbos[i].id); ImGui::SameLine();
-
-        if (i == write_index || i == display_index) {
-            ImGui::PopStyleColor();
+        ImGui::PushStyleColor(ImGuiCol_Text, color);
+        ImGui::Text(i == display_index ? "[%d]" : "%d", pbo.id);
+        ImGui::PopStyleColor();
+        if (ImGui::IsItemHovered()) {
+            auto [x, y, w, h] = pbo.bbox;
+            ImGui::SetTooltip("%s%s\n%d, %d, %dx%d level %d", state, i == display_index ? ", displayed" : "", x, y, w, h, pbo.level);
         }
+        ImGui::SameLine();
     }
     ImGui::NewLine();
 }
 
 void PBOImageStream::reformat(int width, int height, int channels, int n)
 {
-    m_width = width;
-    m_height = height;
-    for (auto i = 0; i < pbos.size(); i++) {
-        glDeleteBuffers(1, &pbos[i].id);
-    }
-
-    pbos.resize(n);
-
-    for (auto i = 0; i < n; i++)
-    {
-        GLuint pbo;
-        glGenBuffers(1, &pbo);
-        glBindBuffer(GL_PIXEL_UNPACK_BUFFER, pbo);
-        glBufferData(GL_PIXEL_UNPACK_BUFFER, width * height * channels * sizeof(half), 0, GL_STREAM_DRAW);
-        pbos[i].id = pbo;
-        pbos[i].bbox = { 0,0, 0,0 };
-    }
-    glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
-
-    display_index = 0;
-    write_index = (display_index + 1) % pbos.size();
+    destroy();
+    create(width, height, channels, n);
 }
 
 PBOImageStream::~PBOImageStream()
 {
-    for (auto i = 0; i < pbos.size(); i++) {
-        glDeleteBuffers(1, &pbos[i].id);
-    }
+    destroy();
 }
 
 // display PBO bbox
@@ -89,56 +101,121 @@ std::tuple<int, int, int, int> PBOImageStream::bbox() const
     return pbos.at(display_index).bbox;
 }
 
-void PBOImageStream::write(void* pixels, const std::tuple<int, int, int, int>& bbox, const std::vector<std::string>& channels, unsigned long long typesize)
+size_t PBOImageStream::slot_bytes() const
 {
-    display_index = (display_index + 1) % pbos.size();
-    write_index = (display_index + 1) % pbos.size();
+    return (size_t)m_width * m_height * m_channels * sizeof(half);
+}
 
-    auto& write_pbo = pbos[write_index];
+bool PBOImageStream::wait(int index, GLuint64 timeout)
+{
+    auto& pbo = pbos[index];
+    if (pbo.state != PBOState::Uploading) return true;
+
+    // flush when blocking, or a fence that was never submitted is never signaled
+    GLenum result = glClientWaitSync(pbo.fence, timeout > 0 ? GL_SYNC_FLUSH_COMMANDS_BIT : 0, timeout);
+    if (result == GL_TIMEOUT_EXPIRED) return false;
+
+    // signaled, or failed eg. the context is gone. Either way the GPU is not reading the slot anymore.
+    glDeleteSync(pbo.fence);
+    pbo.fence = NULL;
+    pbo.state = PBOState::Free;
+    return true;
+}
+
+int PBOImageStream::acquire()
+{
+    const int n = pbos.size();
 
-    glBindBuffer(GL_PIXEL_UNPACK_BUFFER, write_pbo.id);
-    void* ptr = (void*)glMapBuffer(GL_PIXEL_UNPACK_BUFFER, GL_WRITE_ONLY);
-    if (ptr)
+    // take the slots after the displayed one first, they were uploaded longest ago
+    for (auto i = 1; i <= n; i++)
     {
-        auto [x, y, w, h] = bbox;
-        memcpy(ptr, pixels, w * h * channels.size() * typesize);
-        write_pbo.bbox = bbox;
-        write_pbo.channels = channels;
-        glUnmapBuffer(GL_PIXEL_UNPACK_BUFFER); // release the mapped buffer
-        glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+        int index = (display_index + i) % n;
+        wait(index, 0);
+        auto& pbo = pbos[index];
+        if (pbo.state == PBOState::Free || (pbo.state == PBOState::Ready && index != display_index)) {
+            pbo.state = PBOState::Writing;
+            return index;
+        }
     }
-    else {
-        std::cerr << "cannot map PBO" << "\n";
-        glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+
+    // every slot is being uploaded, or written
+    for (auto i = 1; i <= n; i++)
+    {
+        int index = (display_index + i) % n;
+        if (pbos[index].state != PBOState::Uploading) continue;
+        m_stalls++;
+        if (!wait(index, 1000 * 1000 * 1000)) break; // one second
+        pbos[index].state = PBOState::Writing;
+        return index;
     }
+    return -1;
 }
 
-void PBOImageStream::begin() { // BEGIN
-    display_index = (display_index + 1) % pbos.size();
-    write_index = (display_index + 1) % pbos.size();
+bool PBOImageStream::acquire(int index)
+{
+    if (!wait(index, 0)) return false;
+    pbos[index].state = PBOState::Writing;
+    return true;
+}
 
-    auto& write_pbo = pbos[write_index];
+void PBOImageStream::commit(int index, const std::tuple<int, int, int, int>& bbox, const std::vector<std::string>& channels, int level)
+{
+    auto& pbo = pbos[index];
+    pbo.bbox = bbox;
+    pbo.level = level;
+    pbo.channels = channels;
+    if (pbo.state != PBOState::Uploading) pbo.state = PBOState::Ready; // a redraw may commit a slot while it uploads
+    display_index = index;
+}
 
-    glBindBuffer(GL_PIXEL_UNPACK_BUFFER, write_pbo.id);
-    ptr = (void*)glMapBuffer(GL_PIXEL_UNPACK_BUFFER, GL_WRITE_ONLY);
+void PBOImageStream::fence(int index)
+{
+    auto& pbo = pbos[index];
+    if (pbo.fence) glDeleteSync(pbo.fence); // uploaded again, the last fence covers both
+    pbo.fence = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+    pbo.state = PBOState::Uploading;
+}
+
+void PBOImageStream::write(void* pixels, const std::tuple<int, int, int, int>& bbox, const std::vector<std::string>& channels, unsigned long long typesize, int level)
+{
+    auto [x, y, w, h] = bbox;
+    const size_t bytes = (size_t)w * h * channels.size() * typesize;
+    if (bytes > slot_bytes()) {
+        std::cerr << "image does not fit the PBO" << "\n";
+        return;
+    }
+
+    int index = acquire();
+    if (index < 0 || !pbos[index].ptr) {
+        std::cerr << "cannot map PBO" << "\n";
+        if (index >= 0) pbos[index].state = PBOState::Free;
+        return;
+    }
+    memcpy(pbos[index].ptr, pixels, bytes);
+    commit(index, bbox, channels, level);
+}
+
+void PBOImageStream::begin() { // BEGIN
+    write_index = acquire();
+    ptr = write_index >= 0 ? pbos[write_index].ptr : NULL;
 
     if (ptr) {
     }
     else {
         std::cerr << "cannot map PBO" << "\n";
     }
-
 }
 
-void PBOImageStream::end(std::tuple<int, int, int, int> bbox, std::vector<std::string> channels) {
-    if (ptr)
+void PBOImageStream::end(std::tuple<int, int, int, int> bbox, std::vector<std::string> channels, int level) {
+    if (write_index >= 0)
     {
-        auto& write_pbo = pbos[write_index];
-        write_pbo.bbox = bbox;
-        write_pbo.channels = channels;
-        glUnmapBuffer(GL_PIXEL_UNPACK_BUFFER); // release the mapped buffer
-        glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
-        ptr = NULL;
-        glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+        if (ptr) {
+            commit(write_index, bbox, channels, level);
+        }
+        else {
+            pbos[write_index].state = PBOState::Free;
+        }
     }
-}
\ No newline at end of file
+    write_index = -1;
+    ptr = NULL;
+}
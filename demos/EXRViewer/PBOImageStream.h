@@ -6,25 +6,55 @@
 #include <string>
 #include <OpenEXR/ImfPixelType.h>
 
+/// who owns a slot of the ring
+enum class PBOState : int {
+    Free,      // can be written
+    Writing,   // owned by a writer on the CPU, possibly a worker thread
+    Ready,     // holds a complete image, not uploaded yet
+    Uploading  // read by the GPU, until its fence is signaled
+};
+
 struct PBOImage {
     GLuint id;
+    char* ptr{ NULL }; // persistently mapped, valid as long as the stream
+    GLsync fence{ NULL }; // placed after the last upload from this slot
+    PBOState state{ PBOState::Free };
     std::vector<std::string> channels;
     std::tuple<int, int, int, int> bbox;
+    int level{ 0 }; // resolution level of bbox
     Imf::PixelType pixeltype;
 };
 
+/// Ring of pixel unpack buffers, created with glBufferStorage and mapped once for their whole lifetime
+/// (GL_MAP_PERSISTENT_BIT | GL_MAP_COHERENT_BIT). The pointers never change, so decoders on any thread can
+/// write straight into GPU visible memory. Each upload from a slot is followed by a fence, and the slot is
+/// only handed out again when the GPU signaled it, so a write never stalls the driver behind a pending transfer.
+/// State changes happen on the GL thread; only writing the pixels of an acquired slot may happen elsewhere.
 class PBOImageStream {
 public:
     std::vector<PBOImage> pbos;
-    int display_index;
-    int write_index;
+    int display_index; // last committed slot
+    int write_index; // slot between begin and end, -1 otherwise
     int m_width, m_height;
+    int m_channels;
+
+    void* ptr; // mapped memory of write_index between begin and end
 
-    void* ptr;
+private:
+    int m_stalls{ 0 }; // acquires that had to wait for the GPU
+
+    void create(int width, int height, int channels, int n);
+    void destroy();
+
+    /// turn an uploaded slot free when the GPU is done with it. timeout in nanoseconds, 0 to poll
+    bool wait(int index, GLuint64 timeout);
 
 public:
     PBOImageStream(int width, int height, int channels, int n);
 
+    PBOImageStream(const PBOImageStream&) = delete;
+    PBOImageStream& operator=(const PBOImageStream&) = delete;
+
     void onGUI();
 
     void reformat(int width, int height, int channels, int n);
@@ -34,10 +64,27 @@ public:
     // display PBO bbox
     std::tuple<int, int, int, int> bbox() const;
 
+    /// capacity of a single slot in bytes
+    size_t slot_bytes() const;
 
-    void write(void* pixels, const std::tuple<int, int, int, int>& bbox, const std::vector<std::string>& channels, unsigned long long typesize);
+    /// take a free slot to write to. Waits for the GPU when every other slot is still uploading.
+    /// return -1 when no slot can be taken eg. all are being written
+    int acquire();
 
+    /// take a specific slot to write to. return false while the GPU still reads it
+    bool acquire(int index);
+
+    /// the slot holds a complete image, and is displayed next
+    void commit(int index, const std::tuple<int, int, int, int>& bbox, const std::vector<std::string>& channels, int level = 0);
+
+    /// call after a texture was updated from the slot
+    void fence(int index);
+
+    /// copy pixels to a free slot and commit it
+    void write(void* pixels, const std::tuple<int, int, int, int>& bbox, const std::vector<std::string>& channels, unsigned long long typesize, int level = 0);
+
+    /// acquire a slot, and expose it as ptr to decode into
     void begin();
 
-    void end(std::tuple<int, int, int, int> bbox, std::vector<std::string> channels);
-};
\ No newline at end of file
+    void end(std::tuple<int, int, int, int> bbox, std::vector<std::string> channels, int level = 0);
+};
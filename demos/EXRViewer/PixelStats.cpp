@@ -0,0 +1,426 @@
+#include "PixelStats.h"
+
+#include <iostream>
+#include <algorithm>
+#include <chrono>
+#include <future>
+#include <cstring>
+#include <cmath>
+#include <climits>
+
+#include "imgui.h"
+#include <OpenEXR/half.h>
+
+/// run fn(begin, end, band) on bands of count, in parallel
+template <typename Fn>
+static void parallel_bands(int count, int threads, Fn fn)
+{
+    threads = std::max(1, std::min(threads, count));
+    std::vector<std::future<void>> bands;
+    for (auto t = 1; t < threads; t++) {
+        bands.push_back(std::async(std::launch::async, fn, count * t / threads, count * (t + 1) / threads, t));
+    }
+    fn(0, count / threads, 0);
+    for (auto& band : bands) band.get();
+}
+
+static constexpr uint32_t rgba(uint8_t r, uint8_t g, uint8_t b, uint8_t a)
+{
+    return r | (g << 8) | (b << 16) | ((uint32_t)a << 24);
+}
+
+/// sums, finite pixels, min and max of the finite pixels of a rectangle, by channel
+struct Accumulator {
+    std::vector<double> sums, squares;
+    std::vector<float> mins, maxs; // NaN until a finite pixel
+    size_t finite{ 0 };
+
+    explicit Accumulator(int C) : sums(C, 0.0), squares(C, 0.0), mins(C, NAN), maxs(C, NAN) {}
+
+    /// the C channels of a pixel. return false when it has a NaN or infinite channel, and is left out
+    bool add(const half* pixel, int C)
+    {
+        for (int c = 0; c < C; c++) {
+            if (!pixel[c].isFinite()) return false;
+        }
+        for (int c = 0; c < C; c++) {
+            const float v = pixel[c];
+            sums[c] += v;
+            squares[c] += (double)v * v;
+            mins[c] = std::fmin(mins[c], v); // fmin and fmax skip the NaN of an empty accumulator
+            maxs[c] = std::fmax(maxs[c], v);
+        }
+        finite++;
+        return true;
+    }
+};
+
+std::shared_ptr<PixelStats::Tables> PixelStats::build(FramePool::Buffer pixels, const std::tuple<int, int, int, int>& bbox, int level, const std::vector<std::string>& channels, int threads)
+{
+    auto start = std::chrono::steady_clock::now();
+    auto tables = std::make_shared<Tables>();
+    auto [bx, by, w, h] = bbox;
+    const int C = (int)channels.size();
+    tables->channels = channels;
+    tables->bbox = bbox;
+    tables->level = level;
+    if (w <= 0 || h <= 0 || C == 0) return tables;
+    tables->width = w;
+    tables->height = h;
+    tables->pixels = std::move(pixels);
+
+    const int TX = (w + tile - 1) / tile, TY = (h + tile - 1) / tile;
+    const size_t W = (size_t)TX + 1;
+    tables->tiles_x = TX;
+    tables->tiles_y = TY;
+    tables->sums.assign(C, std::vector<double>(W * (TY + 1), 0.0));
+    tables->squares.assign(C, std::vector<double>(W * (TY + 1), 0.0));
+    tables->finite.assign(W * (TY + 1), 0);
+    tables->mins.assign(C, std::vector<float>((size_t)TX * TY, NAN));
+    tables->maxs.assign(C, std::vector<float>((size_t)TX * TY, NAN));
+    tables->overlay.assign((size_t)w * h, 0);
+
+    /// the tiles and the overlay, by bands of tile rows
+    struct Counts {
+        size_t nans{ 0 }, infs{ 0 }, negatives{ 0 };
+        int x0{ INT_MAX }, y0{ INT_MAX }, x1{ INT_MIN }, y1{ INT_MIN }; // invalid pixels
+    };
+    std::vector<Counts> counts(std::max(1, std::min(threads, TY)));
+    const half* src = (const half*)tables->pixels.get();
+    parallel_bands(TY, threads, [&](int tile_row_begin, int tile_row_end, int band) {
+        auto& count = counts[band];
+        std::vector<Accumulator> row_tiles(TX, Accumulator(C));
+        for (int ty = tile_row_begin; ty < tile_row_end; ty++)
+        {
+            std::fill(row_tiles.begin(), row_tiles.end(), Accumulator(C));
+            for (int y = ty * tile; y < std::min((ty + 1) * tile, h); y++)
+            {
+                const half* row = src + (size_t)y * w * C;
+                for (int x = 0; x < w; x++)
+                {
+                    const half* pixel = row + (size_t)x * C;
+                    if (row_tiles[x / tile].add(pixel, C)) {
+                        bool negative = false;
+                        for (int c = 0; c < C; c++) negative |= pixel[c] < 0;
+                        if (negative) {
+                            count.negatives++;
+                            tables->overlay[(size_t)y * w + x] = rgba(0, 255, 255, 160);
+                        }
+                        continue;
+                    }
+
+                    bool nan = false;
+                    for (int c = 0; c < C; c++) nan |= pixel[c].isNan();
+                    if (nan) count.nans++;
+                    else count.infs++;
+                    count.x0 = std::min(count.x0, x);
+                    count.y0 = std::min(count.y0, y);
+                    count.x1 = std::max(count.x1, x + 1);
+                    count.y1 = std::max(count.y1, y + 1);
+                    tables->overlay[(size_t)y * w + x] = nan ? rgba(255, 0, 255, 255) : rgba(255, 255, 0, 255);
+                }
+            }
+
+            // the sums along the row of tiles
+            const size_t S = (ty + 1) * W;
+            for (int tx = 0; tx < TX; tx++)
+            {
+                const auto& acc = row_tiles[tx];
+                for (int c = 0; c < C; c++) {
+                    tables->sums[c][S + tx + 1] = tables->sums[c][S + tx] + acc.sums[c];
+                    tables->squares[c][S + tx + 1] = tables->squares[c][S + tx] + acc.squares[c];
+                    tables->mins[c][(size_t)ty * TX + tx] = acc.mins[c];
+                    tables->maxs[c][(size_t)ty * TX + tx] = acc.maxs[c];
+                }
+                tables->finite[S + tx + 1] = tables->finite[S + tx] + (uint32_t)acc.finite;
+            }
+        }
+    });
+
+    /// sums down the columns of tiles, a table of a few thousand cells
+    for (int ty = 2; ty <= TY; ty++) {
+        const size_t S = ty * W, above = (ty - 1) * W;
+        for (int c = 0; c < C; c++) {
+            for (size_t x = 0; x < W; x++) {
+                tables->sums[c][S + x] += tables->sums[c][above + x];
+                tables->squares[c][S + x] += tables->squares[c][above + x];
+            }
+        }
+        for (size_t x = 0; x < W; x++) tables->finite[S + x] += tables->finite[above + x];
+    }
+
+    /// totals
+    Counts total;
+    for (const auto& count : counts) {
+        total.nans += count.nans;
+        total.infs += count.infs;
+        total.negatives += count.negatives;
+        total.x0 = std::min(total.x0, count.x0);
+        total.y0 = std::min(total.y0, count.y0);
+        total.x1 = std::max(total.x1, count.x1);
+        total.y1 = std::max(total.y1, count.y1);
+    }
+    tables->nans = total.nans;
+    tables->infs = total.infs;
+    tables->negatives = total.negatives;
+    if (total.x1 > total.x0) tables->invalid_bbox = { total.x0, total.y0, total.x1 - total.x0, total.y1 - total.y0 };
+
+    size_t bytes = (size_t)w * h * C * sizeof(half) + tables->finite.size() * sizeof(uint32_t) + tables->overlay.size() * sizeof(uint32_t);
+    for (int c = 0; c < C; c++) {
+        bytes += (tables->sums[c].size() + tables->squares[c].size()) * sizeof(double);
+        bytes += (tables->mins[c].size() + tables->maxs[c].size()) * sizeof(float);
+    }
+    tables->bytes = bytes;
+    tables->seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    return tables;
+}
+
+PixelStats::Region PixelStats::region(const Tables& tables, int x, int y, int w, int h)
+{
+    Region result;
+    const int x0 = std::clamp(x, 0, tables.width), x1 = std::clamp(x + w, 0, tables.width);
+    const int y0 = std::clamp(y, 0, tables.height), y1 = std::clamp(y + h, 0, tables.height);
+    if (x1 <= x0 || y1 <= y0) return result;
+    result.pixels = (size_t)(x1 - x0) * (y1 - y0);
+
+    const int C = (int)tables.channels.size();
+    Accumulator acc(C);
+
+    /// the whole tiles inside the rectangle
+    // a tile on the right or bottom edge of the frame is whole when the rectangle reaches the edge
+    const int tx0 = (x0 + tile - 1) / tile, ty0 = (y0 + tile - 1) / tile;
+    const int tx1 = x1 == tables.width ? tables.tiles_x : x1 / tile, ty1 = y1 == tables.height ? tables.tiles_y : y1 / tile;
+    const bool inner = tx0 < tx1 && ty0 < ty1;
+    if (inner)
+    {
+        const size_t W = (size_t)tables.tiles_x + 1;
+        auto area = [&](const auto& table) {
+            return table[ty1 * W + tx1] - table[ty0 * W + tx1] - table[ty1 * W + tx0] + table[ty0 * W + tx0];
+        };
+        acc.finite = area(tables.finite);
+        for (int c = 0; c < C; c++) {
+            acc.sums[c] = area(tables.sums[c]);
+            acc.squares[c] = area(tables.squares[c]);
+            for (int ty = ty0; ty < ty1; ty++) {
+                for (int tx = tx0; tx < tx1; tx++) {
+                    acc.mins[c] = std::fmin(acc.mins[c], tables.mins[c][(size_t)ty * tables.tiles_x + tx]);
+                    acc.maxs[c] = std::fmax(acc.maxs[c], tables.maxs[c][(size_t)ty * tables.tiles_x + tx]);
+                }
+            }
+        }
+    }
+
+    /// the pixels around them
+    const half* src = (const half*)tables.pixels.get();
+    const int inner_x0 = tx0 * tile, inner_x1 = std::min(tx1 * tile, tables.width);
+    const int inner_y0 = ty0 * tile, inner_y1 = std::min(ty1 * tile, tables.height);
+    for (int py = y0; py < y1; py++)
+    {
+        const half* row = src + (size_t)py * tables.width * C;
+        if (inner && py >= inner_y0 && py < inner_y1) {
+            for (int px = x0; px < inner_x0; px++) acc.add(row + (size_t)px * C, C);
+            for (int px = inner_x1; px < x1; px++) acc.add(row + (size_t)px * C, C);
+        }
+        else {
+            for (int px = x0; px < x1; px++) acc.add(row + (size_t)px * C, C);
+        }
+    }
+
+    result.finite_pixels = acc.finite;
+    for (int c = 0; c < C; c++)
+    {
+        const double n = (double)acc.finite;
+        const double mean = n > 0 ? acc.sums[c] / n : NAN;
+        const double variance = n > 0 ? acc.squares[c] / n - mean * mean : NAN;
+        result.mean.push_back(mean);
+        result.stddev.push_back(std::sqrt(std::max(0.0, variance)));
+        result.min.push_back(acc.mins[c]);
+        result.max.push_back(acc.maxs[c]);
+    }
+    return result;
+}
+
+PixelStats::PixelStats()
+{
+    m_worker = std::thread(&PixelStats::worker_loop, this);
+}
+
+PixelStats::~PixelStats()
+{
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_stop = true;
+    }
+    m_cv.notify_all();
+    m_worker.join();
+
+    if (m_overlay_texture) glDeleteTextures(1, &m_overlay_texture);
+}
+
+void PixelStats::worker_loop()
+{
+    while (true)
+    {
+        std::unique_lock<std::mutex> lock(m_mutex);
+        m_cv.wait(lock, [&] { return m_stop || m_pending; });
+        if (m_stop) return;
+
+        // the frame is not touched by submit while busy
+        m_pending = false;
+        m_busy = true;
+        const int thread_count = m_threads;
+        lock.unlock();
+
+        std::shared_ptr<const Tables> tables;
+        try {
+            tables = build(std::move(m_memory), m_bbox, m_level, m_channels, thread_count);
+        }
+        catch (const std::bad_alloc&) {
+            std::cerr << "not enough memory for the statistics tables of the frame" << "\n";
+        }
+
+        lock.lock();
+        if (tables) {
+            m_tables = tables;
+            m_tables_changed = true;
+        }
+        m_busy = false;
+        lock.unlock();
+
+        if (on_finished) on_finished();
+    }
+}
+
+bool PixelStats::submit(const void* memory, const std::tuple<int, int, int, int>& bbox, int level, const std::vector<std::string>& channels)
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    if (m_busy) {
+        m_skipped++;
+        return false;
+    }
+
+    auto [x, y, w, h] = bbox;
+    const size_t bytes = (size_t)w * h * channels.size() * sizeof(half);
+    if (m_memory.capacity() < bytes) {
+        m_memory.reset(); // the pool may hand back the same buffer
+        m_memory = FramePool::global().acquire(bytes);
+    }
+    std::memcpy(m_memory.get(), memory, bytes);
+
+    m_bbox = bbox;
+    m_level = level;
+    m_channels = channels;
+    m_threads = threads;
+    m_pending = true;
+    m_cv.notify_one();
+    return true;
+}
+
+std::shared_ptr<const PixelStats::Tables> PixelStats::tables()
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    if (m_tables_changed) {
+        m_shown = m_tables;
+        m_tables_changed = false;
+
+        // the overlay of the new tables
+        if (m_shown->width > 0)
+        {
+            if (!m_overlay_texture) {
+                glGenTextures(1, &m_overlay_texture);
+                glBindTexture(GL_TEXTURE_2D, m_overlay_texture);
+                glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+                glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+                glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+                glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+            }
+            glBindTexture(GL_TEXTURE_2D, m_overlay_texture);
+            glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA8, m_shown->width, m_shown->height, 0, GL_RGBA, GL_UNSIGNED_BYTE, m_shown->overlay.data());
+            glBindTexture(GL_TEXTURE_2D, 0);
+        }
+    }
+    return m_shown;
+}
+
+GLuint PixelStats::overlay_texture()
+{
+    auto shown = tables();
+    if (!show_overlay || !shown || shown->width <= 0) return 0;
+    return m_overlay_texture;
+}
+
+bool PixelStats::region(int x, int y, int w, int h, Region* result)
+{
+    auto shown = tables();
+    if (!shown || shown->width <= 0) return false;
+
+    // display to level pixels, in the data window
+    auto [bx, by, bw, bh] = shown->bbox;
+    const int scale = 1 << shown->level;
+    const int x0 = (int)std::floor((float)x / scale) - bx, y0 = (int)std::floor((float)y / scale) - by;
+    const int x1 = (int)std::ceil((float)(x + w) / scale) - bx, y1 = (int)std::ceil((float)(y + h) / scale) - by;
+    const std::tuple<int, int, int, int> rect{ x0, y0, x1 - x0, y1 - y0 };
+    if (shown != m_region_tables || rect != m_region_rect) {
+        m_region = region(*shown, x0, y0, x1 - x0, y1 - y0);
+        m_region_tables = shown;
+        m_region_rect = rect;
+    }
+    *result = m_region;
+    return result->pixels > 0;
+}
+
+void PixelStats::onGUI(const std::tuple<int, int, int, int>& rect)
+{
+    ImGui::SliderInt("threads", &threads, 1, (int)std::thread::hardware_concurrency());
+    ImGui::Checkbox("highlight invalid pixels", &show_overlay);
+    if (ImGui::IsItemHovered()) ImGui::SetTooltip("NaN: magenta, infinite: yellow, negative: cyan");
+
+    auto shown = tables();
+    if (!shown) {
+        ImGui::TextDisabled("no frame measured yet");
+        return;
+    }
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        ImGui::LabelText("skipped", "%d", m_skipped);
+    }
+    ImGui::LabelText("built", "%.1f ms", shown->seconds * 1000);
+    ImGui::LabelText("memory", "%.1f MB", shown->bytes / 1024.0 / 1024.0);
+    ImGui::LabelText("NaN", "%zu", shown->nans);
+    ImGui::LabelText("infinite", "%zu", shown->infs);
+    ImGui::LabelText("negative", "%zu", shown->negatives);
+    if (shown->nans + shown->infs > 0) {
+        auto [ix, iy, iw, ih] = shown->invalid_bbox;
+        auto [bx, by, bw, bh] = shown->bbox;
+        const int scale = 1 << shown->level;
+        ImGui::LabelText("invalid within", "%d, %d, %dx%d", (ix + bx) * scale, (iy + by) * scale, iw * scale, ih * scale);
+    }
+
+    /// the dragged region
+    auto [x, y, w, h] = rect;
+    Region stats;
+    if (w <= 0 || h <= 0 || !region(x, y, w, h, &stats)) {
+        ImGui::TextDisabled("shift drag a region in the viewer");
+        return;
+    }
+    ImGui::Text("%d, %d, %dx%d: %zu pixels, %zu finite", x, y, w, h, stats.pixels, stats.finite_pixels);
+    if (ImGui::BeginTable("region statistics", 5, ImGuiTableFlags_RowBg | ImGuiTableFlags_Borders | ImGuiTableFlags_SizingFixedFit))
+    {
+        ImGui::TableSetupColumn("channel");
+        ImGui::TableSetupColumn("min");
+        ImGui::TableSetupColumn("max");
+        ImGui::TableSetupColumn("mean");
+        ImGui::TableSetupColumn("stddev");
+        ImGui::TableHeadersRow();
+        for (auto c = 0; c < shown->channels.size(); c++)
+        {
+            ImGui::TableNextRow();
+            ImGui::TableNextColumn(); ImGui::TextUnformatted(shown->channels[c].c_str());
+            ImGui::TableNextColumn(); ImGui::Text("%.5g", stats.min[c]);
+            ImGui::TableNextColumn(); ImGui::Text("%.5g", stats.max[c]);
+            ImGui::TableNextColumn(); ImGui::Text("%.5g", stats.mean[c]);
+            ImGui::TableNextColumn(); ImGui::Text("%.5g", stats.stddev[c]);
+        }
+        ImGui::EndTable();
+    }
+}
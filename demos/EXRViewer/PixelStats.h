@@ -0,0 +1,116 @@
+#pragma once
+
+#include <vector>
+#include <string>
+#include <tuple>
+#include <memory>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <functional>
+#include <cstdint>
+
+#include "glad/glad.h"
+#include "FramePool.h"
+
+/// Statistics of rectangles of the decoded frame, while a region is dragged in the viewer.
+/// When a frame is submitted, tables are built on a worker thread in a single pass over the pixels:
+/// - partial sums of each tile of the frame: the values and their squares, the finite pixels, and the min and max.
+///   summed-area tables of the tile sums make the sums of the whole tiles inside a rectangle four lookups,
+///   only the pixels along its border are read again
+/// - an overlay of the NaN, infinite and negative pixels
+/// The tables keep the submitted pixels, and are a fraction of their size, so they are cheap to build during playback.
+/// Statistics are over the finite values: a pixel with a NaN or infinite channel is left out of every channel.
+class PixelStats
+{
+public:
+    static constexpr int tile{ 16 }; // pixels per side of a tile
+
+    struct Region {
+        std::vector<double> min, max, mean, stddev; // by channel
+        size_t pixels{ 0 };
+        size_t finite_pixels{ 0 };
+    };
+
+    struct Tables {
+        std::vector<std::string> channels;
+        std::tuple<int, int, int, int> bbox; // data window, in level pixels
+        int level{ 0 };
+        int width{ 0 }, height{ 0 };
+        FramePool::Buffer pixels; // halves, interleaved like channels, for the pixels on the border of a region
+
+        int tiles_x{ 0 }, tiles_y{ 0 };
+        std::vector<std::vector<double>> sums; // [channel][(tiles_y + 1) * (tiles_x + 1)] summed over the tiles, with a zero first row and column
+        std::vector<std::vector<double>> squares;
+        std::vector<uint32_t> finite; // pixels with finite channels only, same layout
+        std::vector<std::vector<float>> mins, maxs; // [channel][tile], NaN for a tile without finite pixels
+
+        std::vector<uint32_t> overlay; // rgba8, width x height
+        size_t nans{ 0 }, infs{ 0 }, negatives{ 0 };
+        std::tuple<int, int, int, int> invalid_bbox{ 0,0,0,0 }; // of the NaN and infinite pixels, in level pixels
+        size_t bytes{ 0 };
+        double seconds{ 0 };
+    };
+
+    /// build the tables of half pixels, interleaved like channels. the tables keep the pixels
+    static std::shared_ptr<Tables> build(FramePool::Buffer pixels, const std::tuple<int, int, int, int>& bbox, int level, const std::vector<std::string>& channels, int threads);
+
+    /// statistics of the x, y, w, h rectangle of tables, in pixels of the tables
+    static Region region(const Tables& tables, int x, int y, int w, int h);
+
+private:
+    std::mutex m_mutex;
+    std::condition_variable m_cv;
+    std::thread m_worker;
+    bool m_stop{ false };
+
+    // submitted frame, handed to its tables
+    FramePool::Buffer m_memory;
+    std::tuple<int, int, int, int> m_bbox;
+    int m_level{ 0 };
+    std::vector<std::string> m_channels;
+    int m_threads{ 1 };
+    bool m_pending{ false };
+    bool m_busy{ false };
+    int m_skipped{ 0 };
+
+    std::shared_ptr<const Tables> m_tables; // guarded by m_mutex
+    bool m_tables_changed{ false };
+
+    // GL thread
+    std::shared_ptr<const Tables> m_shown;
+    GLuint m_overlay_texture{ 0 };
+    std::shared_ptr<const Tables> m_region_tables; // of the last region, asked again on every draw while the rectangle stays
+    std::tuple<int, int, int, int> m_region_rect{ 0,0,0,0 };
+    Region m_region;
+
+    void worker_loop();
+
+public:
+    int threads{ (int)std::thread::hardware_concurrency() };
+    bool show_overlay{ true };
+    std::function<void()> on_finished; // called on the worker thread when the tables are built eg. to wake an idle main loop
+
+    PixelStats();
+    ~PixelStats();
+
+    PixelStats(const PixelStats&) = delete;
+    PixelStats& operator=(const PixelStats&) = delete;
+
+    /// copy a decoded frame of halves, and build its tables in the background, unless the previous ones are still built
+    /// return true when the frame was taken. Call from the GL thread
+    bool submit(const void* memory, const std::tuple<int, int, int, int>& bbox, int level, const std::vector<std::string>& channels);
+
+    /// the tables of the last built frame, NULL before the first one. Call from the GL thread
+    std::shared_ptr<const Tables> tables();
+
+    /// the overlay of the invalid pixels as a texture, 0 when hidden or not built yet. Call from the GL thread
+    GLuint overlay_texture();
+
+    /// statistics of a rectangle, in display pixels, clipped to the data window
+    /// return false before the first frame, or when the rectangle misses the data window
+    bool region(int x, int y, int w, int h, Region* result);
+
+    /// region: the rectangle of the last region call, in display pixels
+    void onGUI(const std::tuple<int, int, int, int>& region);
+};
@@ -77,12 +77,19 @@ void PixelsRenderer::init_program() {
         uniform mediump sampler2D inputTexture;
         uniform vec2 resolution;
         uniform ivec4 bbox;
+        uniform float level_scale; // 2^level, the texture holds a lower resolution level
 
         void main()
         {
             vec2 uv = (gl_FragCoord.xy)/resolution; // normalize fragcoord
             uv=vec2(uv.x, 1.0-uv.y); // flip y
-            uv-=vec2(bbox.x/resolution.x, bbox.y/resolution); // position image
+
+            // position image
+            vec2 pixel = uv*resolution/level_scale - vec2(bbox.xy);
+            uv = pixel/resolution;
+
+            // only the bbox of the texture holds pixels of the current frame, eg. when reading a region of interest
+            if(pixel.x<0.0 || pixel.y<0.0 || pixel.x>=bbox.z || pixel.y>=bbox.w) discard;
             vec3 color = texture(inputTexture, uv).rgb;
             float alpha = texture(inputTexture, uv).a;
             FragColor = vec4(color, alpha);
@@ -98,6 +105,47 @@ void PixelsRenderer::init_program() {
     // swap programs
     if (glIsProgram(mProgram)) glDeleteProgram(mProgram);
     mProgram = program;
+
+    // every channel of the frame is a slice of the array. a layer picks its slices
+    auto array_fragment_code = R"(
+        #version 330 core
+        out vec4 FragColor;
+        uniform sampler2DArray inputTexture;
+        uniform vec2 resolution;
+        uniform ivec4 bbox;
+        uniform float level_scale; // 2^level, the texture holds a lower resolution level
+        uniform ivec4 slices; // slice of each component, -1 when the layer has no such channel
+
+        float channel(int slice, vec2 uv, float fallback)
+        {
+            return slice < 0 ? fallback : texture(inputTexture, vec3(uv, slice)).r;
+        }
+
+        void main()
+        {
+            vec2 uv = (gl_FragCoord.xy)/resolution; // normalize fragcoord
+            uv=vec2(uv.x, 1.0-uv.y); // flip y
+
+            // position image
+            vec2 pixel = uv*resolution/level_scale - vec2(bbox.xy);
+            uv = pixel/resolution;
+
+            if(pixel.x<0.0 || pixel.y<0.0 || pixel.x>=bbox.z || pixel.y>=bbox.w) discard;
+            FragColor = vec4(
+                channel(slices.r, uv, 0.0),
+                channel(slices.g, uv, 0.0),
+                channel(slices.b, uv, 0.0),
+                channel(slices.a, uv, 1.0)
+            );
+        }
+    )";
+
+    GLuint array_program = imdraw::make_program_from_source(
+        vertex_code,
+        array_fragment_code
+    );
+    if (glIsProgram(mArrayProgram)) glDeleteProgram(mArrayProgram);
+    mArrayProgram = array_program;
 }
 
 void PixelsRenderer::set_uniforms(std::map<std::string, imdraw::UniformVariant> uniforms) {
@@ -105,6 +153,11 @@ void PixelsRenderer::set_uniforms(std::map<std::string, imdraw::UniformVariant>
 }
 
 void PixelsRenderer::render_texture_to_fbo()
+{
+    render_to_fbo(mProgram, GL_TEXTURE_2D, data_tex, {});
+}
+
+void PixelsRenderer::render_to_fbo(GLuint program, GLenum target, GLuint texture, std::map<std::string, imdraw::UniformVariant> uniforms)
 {
     //ZoneScopedN("datatext to fbo");
     BeginRenderToTexture(fbo, 0, 0, width, height);
@@ -114,30 +167,31 @@ void PixelsRenderer::render_texture_to_fbo()
         glEnable(GL_BLEND);
         glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
         auto [x, y, w, h] = m_bbox;
-        set_uniforms({
-            {"inputTexture", 0},
-            {"resolution", glm::vec2(width, height)},
-            {"bbox", glm::ivec4(x,y,w,h)}
-            });
+        uniforms["inputTexture"] = 0;
+        uniforms["resolution"] = glm::vec2(width, height);
+        uniforms["bbox"] = glm::ivec4(x, y, w, h);
+        uniforms["level_scale"] = (float)(1 << m_level);
+        imdraw::set_uniforms(program, uniforms);
 
         /// Create geometry
         static GLuint vbo = imdraw::make_vbo(std::vector<glm::vec3>({ {-1,-1,0}, {1,-1,0}, {-1,1,0}, {1,1,0} }));
-        static auto vao = imdraw::make_vao(mProgram, { {"aPos", {vbo, 3}} });
+        static auto vao = imdraw::make_vao(program, { {"aPos", {vbo, 3}} }); // aPos is at location 0 in both programs
 
         /// Draw quad with fragment shader
-        imdraw::push_program(mProgram);
-        glBindTexture(GL_TEXTURE_2D, data_tex);
+        imdraw::push_program(program);
+        glBindTexture(target, texture);
         glBindVertexArray(vao);
         glDrawArrays(GL_TRIANGLE_STRIP, 0, 4);
         glBindVertexArray(0);
-        glBindTexture(GL_TEXTURE_2D, 0);
+        glBindTexture(target, 0);
         imdraw::pop_program();
     }
     EndRenderToTexture();
+    revision++;
 }
 
 // write texture from memory
-void PixelsRenderer::update_from_data(void* pixels, std::tuple<int, int, int, int> bbox, std::vector<std::string> channels, GLenum gltype)
+void PixelsRenderer::update_from_data(void* pixels, std::tuple<int, int, int, int> bbox, std::vector<std::string> channels, GLenum gltype, int level)
 {
     //ZoneScopedN("pixels to texture");
     { // Upload from memory
@@ -147,6 +201,7 @@ void PixelsRenderer::update_from_data(void* pixels, std::tuple<int, int, int, in
 
         // update bounding box
         m_bbox = bbox;
+        m_level = level;
 
         // transfer pixels to texture
         auto [x, y, w, h] = m_bbox;
@@ -162,8 +217,35 @@ void PixelsRenderer::update_from_data(void* pixels, std::tuple<int, int, int, in
     }
 }
 
+// write rows of the texture from memory
+void PixelsRenderer::update_rows_from_data(void* pixels, std::tuple<int, int, int, int> bbox, std::vector<std::string> channels, int row_begin, int row_end, GLenum gltype, int level)
+{
+    { // Upload band from memory
+        std::array<GLint, 4> swizzle_mask;
+        auto glformat = glformat_from_channels(channels, swizzle_mask);
+        if (glformat == -1) return;
+
+        // update bounding box to the decoded rows
+        auto [x, y, w, h] = bbox;
+        m_bbox = { x, y, w, row_end };
+        m_level = level;
+
+        // transfer band to texture
+        const size_t row_bytes = (size_t)w * channels.size() * sizeof(half);
+        glBindTexture(GL_TEXTURE_2D, data_tex);
+        glTexParameteriv(GL_TEXTURE_2D, GL_TEXTURE_SWIZZLE_RGBA, swizzle_mask.data());
+        glTexSubImage2D(GL_TEXTURE_2D, 0, 0, row_begin, w, row_end - row_begin, glformat, GL_HALF_FLOAT, (char*)pixels + row_begin * row_bytes);
+        glBindTexture(GL_TEXTURE_2D, 0);
+    }
+
+    {
+        // Draw data_texture to bounding box
+        render_texture_to_fbo();
+    }
+}
+
 // write texture from pbo
-void PixelsRenderer::update_from_pbo(GLuint pbo, const std::tuple<int, int, int, int>& bbox, const std::vector<std::string>& channels, GLenum gltype)
+void PixelsRenderer::update_from_pbo(GLuint pbo, const std::tuple<int, int, int, int>& bbox, const std::vector<std::string>& channels, GLenum gltype, int level)
 {
     { // upload from PBO
         std::array<GLint, 4> swizzle_mask;
@@ -172,6 +254,7 @@ void PixelsRenderer::update_from_pbo(GLuint pbo, const std::tuple<int, int, int,
 
         // update bounding box
         m_bbox = bbox;
+        m_level = level;
 
         // transfer PBO to texture
         glBindTexture(GL_TEXTURE_2D, data_tex);
@@ -186,4 +269,16 @@ void PixelsRenderer::update_from_pbo(GLuint pbo, const std::tuple<int, int, int,
     {
         render_texture_to_fbo();
     }
+}
+
+// draw from a texture array
+void PixelsRenderer::update_from_array(GLuint array_tex, const std::tuple<int, int, int, int>& bbox, const std::array<int, 4>& slices, int level)
+{
+    // update bounding box
+    m_bbox = bbox;
+    m_level = level;
+
+    render_to_fbo(mArrayProgram, GL_TEXTURE_2D_ARRAY, array_tex, {
+        {"slices", glm::ivec4(slices[0], slices[1], slices[2], slices[3])}
+        });
 }
\ No newline at end of file
@@ -3,6 +3,7 @@
 #include "glad/glad.h"
 #include <tuple>
 #include <map>
+#include <array>
 #include <string>
 #include "imdraw/imdraw_internal.h"
 
@@ -12,10 +13,13 @@ public:
     GLuint fbo{ 0 };
     GLuint color_attachment{ 0 };
     GLuint mProgram;
+    GLuint mArrayProgram{ 0 }; // shows slices of a texture array, see update_from_array
 
     GLuint data_tex;
     int width, height;
     std::tuple<int, int, int, int> m_bbox;
+    int m_level{ 0 }; // resolution level of the data texture, it is scaled up by 2^level
+    int revision{ 0 }; // counts the draws to the fbo, the stages reading color_attachment redraw when it changes
 
 
     GLenum glinternalformat = GL_RGBA16F; // select texture internal format
@@ -34,9 +38,20 @@ public:
 
     void render_texture_to_fbo();
 
+    // draw a texture to the bounding box with one of the programs
+    void render_to_fbo(GLuint program, GLenum target, GLuint texture, std::map<std::string, imdraw::UniformVariant> uniforms);
+
     // write texture from memory
-    void update_from_data(void* pixels, std::tuple<int, int, int, int> bbox, std::vector<std::string> channels, GLenum gltype = GL_HALF_FLOAT);
+    void update_from_data(void* pixels, std::tuple<int, int, int, int> bbox, std::vector<std::string> channels, GLenum gltype = GL_HALF_FLOAT, int level = 0);
+
+    // write rows of the texture from memory, while the rest of the frame is decoded
+    // pixels holds the whole bbox. rows [row_begin, row_end) are uploaded, rows below row_end are hidden
+    void update_rows_from_data(void* pixels, std::tuple<int, int, int, int> bbox, std::vector<std::string> channels, int row_begin, int row_end, GLenum gltype = GL_HALF_FLOAT, int level = 0);
 
     // write texture from pbo
-    void update_from_pbo(GLuint pbo, const std::tuple<int, int, int, int>& bbox, const std::vector<std::string>& channels, GLenum gltype = GL_HALF_FLOAT);
+    void update_from_pbo(GLuint pbo, const std::tuple<int, int, int, int>& bbox, const std::vector<std::string>& channels, GLenum gltype = GL_HALF_FLOAT, int level = 0);
+
+    // draw from a texture array holding a channel per slice, no upload
+    // slices: the slice shown as red, green, blue and alpha. -1 shows black, or opaque for alpha
+    void update_from_array(GLuint array_tex, const std::tuple<int, int, int, int>& bbox, const std::array<int, 4>& slices, int level = 0);
 };
\ No newline at end of file
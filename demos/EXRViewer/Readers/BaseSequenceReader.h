@@ -2,6 +2,33 @@
 #include <tuple>
 #include <vector>
 #include <string>
+#include <atomic>
+
+/// everything a reader needs to decode a single frame.
+/// Requests are plain values, so worker threads can decode them without touching the reader state.
+struct ReadRequest
+{
+	int frame;
+	int part;
+	std::vector<std::string> channels;
+	std::tuple<int, int, int, int> roi{ 0,0,0,0 }; // region of interest x,y,w,h in display pixels, from the display window origin. empty reads the whole data window
+	int level{ 0 }; // resolution level, each level halves the resolution. clamped to the levels in the file
+	bool planar{ false }; // a plane of rows per channel, instead of the channels of a pixel side by side
+	bool full_float{ false }; // 32 bit floats instead of halves eg. for depth and positions
+
+	size_t typesize() const { return full_float ? 4 : 2; }
+
+	bool operator==(const ReadRequest& other) const = default;
+};
+
+/// progress of a read, shared between the decoding thread and the thread displaying the frame.
+/// the reader decodes the frame in bands from the top, and publishes the decoded rows after each band.
+struct ReadProgress
+{
+	int band_rows{ 64 }; // preferred band height, readers round it up to whole compressed blocks or tile rows
+	std::atomic<int> rows{ 0 }; // rows decoded from the top of bbox. bbox and level are set before the first band
+	std::atomic<bool> cancel{ false }; // stop the read before the next band
+};
 
 class BaseSequenceReader
 {
@@ -10,6 +37,7 @@ public:
 
 	virtual std::tuple<int, int> size() = 0;
 	virtual std::tuple<int, int, int, int> bbox() = 0;
+	virtual int level() = 0; /// resolution level of bbox
 
 	virtual int current_frame() = 0;
 	virtual void set_current_frame(int f) = 0;
@@ -20,8 +48,52 @@ public:
 	virtual std::vector<std::string> selected_channels()=0;
 	virtual void set_selected_channels(std::vector<std::string> channels)=0;
 
+	/// decoder threads used for a single frame, 0 for the reader default
+	/// set by the prefetcher, when it decodes multiple frames at once
+	virtual void set_threads_per_frame(int threads) {}
+
+	/// region of interest x,y,w,h in image pixels, empty reads the whole data window
+	std::tuple<int, int, int, int> roi{ 0,0,0,0 };
+
+	/// preferred resolution level, for multi resolution files
+	int requested_level{ 0 };
+
+	/// request for the current frame, part, channels, roi and level
+	ReadRequest current_request() {
+		return { current_frame(), selected_part_idx(), selected_channels(), roi, requested_level };
+	}
+
 	// calculate
 	virtual void read()=0;
 
+	/// rows of a part decoded together eg. the scanlines of a compressed block, or a row of tiles, in the pixels of the level
+	/// a roi read is widened to whole blocks, so reading in bands of blocks decompresses each of them once. 0 when unknown
+	virtual int block_rows(int frame, int part) { return 0; }
+
+	/// decode a request to memory, and set the data window of the decoded pixels
+	/// when the request has a roi, only the rows overlapping it are decoded, packed from the start of memory,
+	/// and bbox is set to the decoded rows
+	/// pixels are halves with the channels of a pixel side by side, see ReadRequest::planar and full_float for other layouts
+	/// level is set to the decoded resolution level. bbox is in the pixels of that level: display pixels / 2^level
+	/// progress is optional. when set, the rows are published band by band, and the read can be cancelled
+	/// must be safe to call from multiple threads at once
+	/// return false when the frame cannot be read, or the read was cancelled
+	virtual bool read(const ReadRequest& request, void* memory, std::tuple<int, int, int, int>* bbox, int* level, ReadProgress* progress) = 0;
+
+	/// decode several channel groups of a frame, eg. the layers of a contact sheet
+	/// each group is decoded to its own memory, like request.channels would be. request.channels is ignored
+	/// a channel belongs to a single group. readers override this to decode every group in a single pass,
+	/// the default reads the groups one after the other
+	virtual bool read_groups(const ReadRequest& request, const std::vector<std::vector<std::string>>& groups, const std::vector<void*>& memories, std::tuple<int, int, int, int>* bbox, int* level)
+	{
+		bool success = !groups.empty();
+		for (auto i = 0; i < groups.size(); i++) {
+			ReadRequest group = request;
+			group.channels = groups[i];
+			success = read(group, memories[i], bbox, level, NULL) && success;
+		}
+		return success;
+	}
+
 	void* memory=NULL;
-};
\ No newline at end of file
+};
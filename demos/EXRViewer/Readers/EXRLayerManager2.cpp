@@ -2,6 +2,7 @@
 #include "imgui.h"
 
 #include "OpenEXR/ImfMultiPartInputFile.h"
+#include "MemoryMappedIStream.h"
 #include <OpenEXR/ImfInputPart.h>
 #include <OpenEXR/ImfChannelList.h>
 
@@ -66,7 +67,9 @@ inline std::vector<std::tuple<int, int>> group_stringvector_by_patterns(const st
 
 EXRLayerManager2::EXRLayerManager2(const std::filesystem::path& filename)
 {
-	auto file = std::make_unique<Imf::MultiPartInputFile>(filename.string().c_str());
+	// only the headers are read: map the file without read ahead
+	MemoryMappedIStream stream(filename.string().c_str(), MemoryMappedIStream::AccessHint::Random);
+	auto file = std::make_unique<Imf::MultiPartInputFile>(stream);
 
 	/// Collect layers per parts
 	{
@@ -2,11 +2,14 @@
 
 #include "EXRSequenceReader.h"
 #include "stringutils.h"
+#include "../helpers.h" // lines_per_block
 //#include "../../tracy/Tracy.hpp"
 
 // OpenEXR
 #include <OpenEXR/ImfMultiPartInputFile.h>
 #include <OpenEXR/ImfInputPart.h>
+#include <OpenEXR/ImfTiledInputPart.h>
+#include <OpenEXR/ImfTileDescription.h>
 #include <OpenEXR/ImfStdIO.h>
 #include <OpenEXR/ImfArray.h> //Imf::Array2D
 #include <OpenEXR/half.h> // <half> type
@@ -15,9 +18,14 @@
 #include <OpenEXR/ImfVersion.h> // get version
 #include <OpenEXR/ImfFrameBuffer.h>
 #include <OpenEXR/ImfHeader.h>
+#include <OpenEXR/ImfCompression.h>
 
 #include "imgui.h"
 
+#include <cmath>
+#include <algorithm>
+#include <thread>
+
 int alpha_channel(const std::vector<std::string>& channels) {
     int AlphaIndex{ -1 };
     std::string alpha_channel_name{};
@@ -33,30 +41,156 @@ int alpha_channel(const std::vector<std::string>& channels) {
     return AlphaIndex;
 }
 
-EXRSequenceReader::EXRSequenceReader(const FileSequence& seq)
+/// frame buffer slices of the requested channels, for pixels of the bbox in memory
+/// channels are interleaved, or one plane after the other when the request is planar
+Imf::FrameBuffer make_framebuffer(const ReadRequest& request, void* memory, int x, int y, int w, int h)
+{
+    const Imf::PixelType pixeltype = request.full_float ? Imf::PixelType::FLOAT : Imf::PixelType::HALF;
+    const size_t typesize = request.typesize();
+    const size_t xstride = request.planar ? typesize : typesize * request.channels.size();
+    const size_t ystride = xstride * w;
+    const size_t channel_offset = request.planar ? ystride * std::max(h, 0) : typesize;
+
+    // slices are addressed by data window coordinates
+    char* buf = (char*)memory;
+    buf -= (x * xstride + y * ystride);
+
+    Imf::FrameBuffer frameBuffer;
+    for (auto i = 0; i < request.channels.size(); i++)
+    {
+        frameBuffer.insert(request.channels[i],   // name
+            Imf::Slice(pixeltype, // type
+                buf + i * channel_offset,           // base
+                xstride,
+                ystride
+            )
+        );
+    }
+    return frameBuffer;
+}
+
+/// read the tiles of a resolution level overlapping the roi, to the slices of framebuffer
+/// bbox is set to the decoded tiles, in the pixels of the level
+bool read_tiles(Imf::MultiPartInputFile& file, const ReadRequest& request, const EXRSequenceReader::FrameBufferFactory& framebuffer, std::tuple<int, int, int, int>* bbox, int* level, ReadProgress* progress)
+{
+    Imf::TiledInputPart part(file, request.part);
+
+    /// select level
+    int max_level{ 0 };
+    switch (part.header().tileDescription().mode) {
+    case Imf::MIPMAP_LEVELS:
+        max_level = part.numLevels() - 1;
+        break;
+    case Imf::RIPMAP_LEVELS: // use the levels on the diagonal
+        max_level = std::min(part.numXLevels(), part.numYLevels()) - 1;
+        break;
+    default:
+        max_level = 0;
+    }
+    const int L = std::clamp(request.level, 0, max_level);
+    const double scale = 1 << L;
+    *level = L;
+
+    /// find tiles overlapping the roi
+    // roi is in display pixels from the display window origin, tiles are counted from the level data window
+    const Imath::Box2i dataWindow = part.header().dataWindow();
+    const Imath::Box2i displayWindow = part.header().displayWindow();
+    const Imath::Box2i levelWindow = part.dataWindowForLevel(L, L);
+    const int tile_w = part.tileXSize();
+    const int tile_h = part.tileYSize();
+
+    int tx_begin = 0, tx_end = part.numXTiles(L) - 1;
+    int ty_begin = 0, ty_end = part.numYTiles(L) - 1;
+    auto [roi_x, roi_y, roi_w, roi_h] = request.roi;
+    roi_x += displayWindow.min.x; // to the coordinates of the data window
+    roi_y += displayWindow.min.y;
+    if (roi_w > 0 && roi_h > 0)
+    {
+        tx_begin = std::max(tx_begin, (int)std::floor((roi_x - dataWindow.min.x) / scale / tile_w));
+        tx_end = std::min(tx_end, (int)std::floor((roi_x + roi_w - 1 - dataWindow.min.x) / scale / tile_w));
+        ty_begin = std::max(ty_begin, (int)std::floor((roi_y - dataWindow.min.y) / scale / tile_h));
+        ty_end = std::min(ty_end, (int)std::floor((roi_y + roi_h - 1 - dataWindow.min.y) / scale / tile_h));
+    }
+
+    /// region of the tiles, in level pixels
+    int x0 = levelWindow.min.x + tx_begin * tile_w;
+    int y0 = levelWindow.min.y + ty_begin * tile_h;
+    int x1 = std::min(levelWindow.max.x, levelWindow.min.x + (tx_end + 1) * tile_w - 1);
+    int y1 = std::min(levelWindow.max.y, levelWindow.min.y + (ty_end + 1) * tile_h - 1);
+    if (tx_begin > tx_end || ty_begin > ty_end) {
+        x1 = x0 - 1; // roi is outside the data window
+        y1 = y0 - 1;
+    }
+    const int w = x1 - x0 + 1;
+    const int h = y1 - y0 + 1;
+
+    // level pixels start at the data window origin, the viewer places them at origin / 2^level
+    *bbox = {
+        x0 - levelWindow.min.x + (int)std::floor(dataWindow.min.x / scale),
+        y0 - levelWindow.min.y + (int)std::floor(dataWindow.min.y / scale),
+        w,
+        h
+    };
+    if (w <= 0 || h <= 0) return true;
+
+    /// Read tiles to pointer
+    part.setFrameBuffer(framebuffer(x0, y0, w, h));
+    if (progress == NULL) {
+        part.readTiles(tx_begin, tx_end, ty_begin, ty_end, L, L);
+        return true;
+    }
+
+    // read in bands of tile rows, and publish the decoded rows
+    const int band = std::max(1, progress->band_rows / tile_h);
+    for (int ty = ty_begin; ty <= ty_end; ty += band) {
+        if (progress->cancel) return false;
+        part.readTiles(tx_begin, tx_end, ty, std::min(ty + band - 1, ty_end), L, L);
+        progress->rows = std::min((ty + band - ty_begin) * tile_h, h);
+    }
+    return true;
+}
+
+EXRSequenceReader::EXRSequenceReader(const FileSequence& seq) :
+    m_files([this](const std::filesystem::path& filename) {
+        auto exr = std::make_unique<EXRFile>();
+        int threads = m_threads_per_frame > 0 ? m_threads_per_frame.load() : Imf::globalThreadCount();
+        if (m_memory_map) {
+            exr->stream = std::make_unique<MemoryMappedIStream>(filename.string().c_str(), m_access_hint);
+            exr->file = std::make_unique<Imf::MultiPartInputFile>(*exr->stream, threads);
+        }
+        else {
+            exr->stream = std::make_unique<SharedFileIStream>(filename.string().c_str());
+            exr->file = std::make_unique<Imf::MultiPartInputFile>(*exr->stream, threads);
+        }
+        return exr;
+    })
 {
     //ZoneScoped;
     m_sequence = seq;
 
     m_current_frame = m_sequence.first_frame;
-    Imf::setGlobalThreadCount(24);
+    // a single pool for every open file. the threads of a file are set with set_threads_per_frame
+    Imf::setGlobalThreadCount(std::thread::hardware_concurrency());
 
     ///
     /// Open file
     /// 
     auto filename = m_sequence.item(m_sequence.first_frame);
 
-    auto first_file = std::make_unique<Imf::MultiPartInputFile>(filename.string().c_str());
+    auto first_file = m_files.acquire(filename);
+    if (!first_file) {
+        throw std::runtime_error("file does not exist: " + filename.string());
+    }
 
     // read info to string
-    //infostring = get_infostring(*first_file);
-    int parts = first_file->parts();
+    //infostring = get_infostring(*first_file->file);
+    int parts = first_file->file->parts();
     bool fileComplete = true;
     for (int i = 0; i < parts && fileComplete; ++i)
-        if (!first_file->partComplete(i)) fileComplete = false;
+        if (!first_file->file->partComplete(i)) fileComplete = false;
 
     /// read header 
-    Imath::Box2i display_window = first_file->header(m_selected_part_idx).displayWindow();
+    Imath::Box2i display_window = first_file->file->header(m_selected_part_idx).displayWindow();
     display_x = display_window.min.x;
     display_y = display_window.min.y;
     display_width = display_window.max.x - display_window.min.x + 1;
@@ -72,6 +206,27 @@ void EXRSequenceReader::onGUI() {
 
     ImGui::DragInt("current frame", &m_current_frame);
 
+    int open_files = m_files.capacity();
+    if (ImGui::InputInt("open files cache", &open_files) && open_files >= 0) {
+        m_files.set_capacity(open_files);
+    }
+    ImGui::LabelText("open files", "%d (hits: %d, misses: %d)", (int)m_files.size(), m_files.hits(), m_files.misses());
+
+    // files opened with other settings are closed
+    bool memory_map = m_memory_map;
+    if (ImGui::Checkbox("memory map files", &memory_map)) {
+        m_memory_map = memory_map;
+        m_files.clear();
+    }
+    if (ImGui::IsItemHovered()) ImGui::SetTooltip("no copy of uncompressed pixels, for sequences that are not rewritten:\na frame rewritten in place while it is mapped makes the viewer crash");
+    if (memory_map) {
+        int hint = (int)m_access_hint.load();
+        if (ImGui::Combo("access hint", &hint, "normal\0sequential\0random\0")) {
+            m_access_hint = (MemoryMappedIStream::AccessHint)hint;
+            m_files.clear();
+        }
+    }
+
     ImGui::LabelText("part", "%d", this->selected_part_idx());
     ImGui::LabelText("channels", "%s", join_string(this->selected_channels(), ", ").c_str());
 }
@@ -112,6 +267,31 @@ void EXRSequenceReader::set_selected_channels(std::vector<std::string> channels)
     mSelectedChannels = reordered_channels;
 }
 
+void EXRSequenceReader::set_threads_per_frame(int threads)
+{
+    // files take the thread count when opened
+    if (m_threads_per_frame.exchange(threads) != threads) {
+        m_files.clear();
+    }
+}
+
+int EXRSequenceReader::block_rows(int frame, int part)
+{
+    try
+    {
+        // the lease goes back to the cache, the read that follows skips the open
+        auto file = m_files.acquire(m_sequence.item(frame));
+        if (!file || part < 0 || part >= file->file->parts()) return 0;
+        const Imf::Header& header = file->file->header(part);
+        if (header.hasTileDescription()) return header.tileDescription().ySize;
+        return lines_per_block(header.compression());
+    }
+    catch (const std::exception&)
+    {
+        return 0;
+    }
+}
+
 std::vector<std::string> EXRSequenceReader::selected_channels() {
     return mSelectedChannels;
 }
@@ -122,73 +302,134 @@ void EXRSequenceReader::read()
     if (mSelectedChannels.empty()) return;
     assert(("memory address is NULL", memory != NULL));
 
+    read(current_request(), memory, &m_bbox, &m_level, NULL);
+}
+
+bool EXRSequenceReader::read(const ReadRequest& request, void* memory, std::tuple<int, int, int, int>* bbox, int* level, ReadProgress* progress)
+{
+    //ZoneScoped;
+    if (request.channels.empty()) return false;
+    assert(("memory address is NULL", memory != NULL));
+
+    return decode(request, [&](int x, int y, int w, int h) {
+        return make_framebuffer(request, memory, x, y, w, h);
+    }, bbox, level, progress);
+}
+
+bool EXRSequenceReader::read_groups(const ReadRequest& request, const std::vector<std::vector<std::string>>& groups, const std::vector<void*>& memories, std::tuple<int, int, int, int>* bbox, int* level)
+{
+    //ZoneScoped;
+    if (groups.empty()) return false;
+    assert(("a memory address for each group", memories.size() == groups.size()));
+
+    // a single frame buffer with the slices of every group: each block is decompressed once for all of them
+    return decode(request, [&](int x, int y, int w, int h) {
+        Imf::FrameBuffer frameBuffer;
+        for (auto i = 0; i < groups.size(); i++)
+        {
+            ReadRequest group = request;
+            group.channels = groups[i];
+            const Imf::FrameBuffer slices = make_framebuffer(group, memories[i], x, y, w, h);
+            for (auto it = slices.begin(); it != slices.end(); ++it) {
+                frameBuffer.insert(it.name(), it.slice());
+            }
+        }
+        return frameBuffer;
+    }, bbox, level, NULL);
+}
+
+bool EXRSequenceReader::decode(const ReadRequest& request, const FrameBufferFactory& framebuffer, std::tuple<int, int, int, int>* bbox, int* level, ReadProgress* progress)
+{
     /// Open Current InputPart
-    std::unique_ptr<Imf::MultiPartInputFile> current_file;
+    // files are leased from the cache: reopening a frame, or switching layers skips the open and the header parse
+    OpenFileCache<EXRFile>::Lease current_file;
     std::unique_ptr<Imf::InputPart> current_inputpart;
     {
         //ZoneScopedN("Open Curren InputPart");
 
-        auto filename = m_sequence.item(m_current_frame);
-        if (!std::filesystem::exists(filename)) {
-            std::cerr << "file does not exist: " << filename << "\n";
-            return;
-        }
-
+        auto filename = m_sequence.item(request.frame);
         try
         {
             //ZoneScopedN("Open Current File");
-            current_file = std::make_unique<Imf::MultiPartInputFile>(filename.string().c_str());
+            current_file = m_files.acquire(filename);
         }
         catch (const Iex::InputExc& ex)
         {
             std::cerr << "file doesn't appear to really be an EXR file" << "\n";
             std::cerr << "  " << ex.what() << "\n";
-            return;
+            return false;
+        }
+
+        if (!current_file) {
+            std::cerr << "file does not exist: " << filename << "\n";
+            return false;
+        }
+
+        // tiled parts can read a single resolution level, and only the tiles overlapping the roi
+        if (current_file->file->header(request.part).hasTileDescription()) {
+            return read_tiles(*current_file->file, request, framebuffer, bbox, level, progress);
         }
 
         {
             //ZoneScopedN("seek part");
-            current_inputpart = std::make_unique<Imf::InputPart>(*current_file, m_selected_part_idx);
+            current_inputpart = std::make_unique<Imf::InputPart>(*current_file->file, request.part);
         }
     }
+    *level = 0; // scanline parts have a single level
 
     /// Update datawindow
     {
         //ZoneScopedN("Update datawindow");
         Imath::Box2i dataWindow = current_inputpart->header().dataWindow();
-        m_bbox = std::tuple<int, int, int, int>(
+        int ymin = dataWindow.min.y;
+        int ymax = dataWindow.max.y;
+
+        /// Clip to region of interest
+        // only the scanline blocks overlapping the roi are decompressed.
+        // the roi is widened to whole blocks, since those rows are decoded anyway
+        auto [roi_x, roi_y, roi_w, roi_h] = request.roi;
+        roi_y += current_inputpart->header().displayWindow().min.y; // display pixels to the coordinates of the data window
+        if (roi_w > 0 && roi_h > 0)
+        {
+            ymin = std::max(ymin, roi_y);
+            ymax = std::min(ymax, roi_y + roi_h - 1);
+            if (ymin <= ymax) {
+                const int lines = lines_per_block(current_inputpart->header().compression());
+                ymin = dataWindow.min.y + (ymin - dataWindow.min.y) / lines * lines;
+                ymax = std::min(dataWindow.max.y, dataWindow.min.y + ((ymax - dataWindow.min.y) / lines + 1) * lines - 1);
+            }
+            else {
+                ymax = ymin - 1; // roi is outside the data window
+            }
+        }
+
+        *bbox = std::tuple<int, int, int, int>(
             dataWindow.min.x,
-            dataWindow.min.y,
+            ymin,
             dataWindow.max.x - dataWindow.min.x + 1,
-            dataWindow.max.y - dataWindow.min.y + 1);
+            ymax - ymin + 1);
     }
 
     /// Read pixels to pointer
     {
-        auto [x, y, w, h] = m_bbox;
-
-        Imf::FrameBuffer frameBuffer;
-        //size_t chanoffset = 0;
-        unsigned long long xstride = sizeof(half) * mSelectedChannels.size();
-        char* buf = (char*)memory;
-        buf -= (x * xstride + y * w * xstride);
+        auto [x, y, w, h] = *bbox;
 
-        size_t chanoffset = 0;
-        for (auto name : mSelectedChannels)
-        {
-            size_t chanbytes = sizeof(half);
-            frameBuffer.insert(name,   // name
-                Imf::Slice(Imf::PixelType::HALF, // type
-                    buf + chanoffset,           // base
-                    xstride,
-                    (size_t)w * xstride
-                )
-            );
-            chanoffset += chanbytes;
+        if (h <= 0) return true;
+        current_inputpart->setFrameBuffer(framebuffer(x, y, w, h));
+        if (progress == NULL) {
+            current_inputpart->readPixels(y, y + h - 1);
+            return true;
         }
 
-        current_inputpart->setFrameBuffer(frameBuffer);
-        current_inputpart->readPixels(y, y + h - 1);
+        // read in bands of whole blocks, and publish the decoded rows
+        // a band splitting a block would decompress it twice
+        const int lines = lines_per_block(current_inputpart->header().compression());
+        const int band = std::max(1, (progress->band_rows + lines - 1) / lines) * lines;
+        for (int row = 0; row < h; row += band) {
+            if (progress->cancel) return false;
+            current_inputpart->readPixels(y + row, std::min(y + row + band, y + h) - 1);
+            progress->rows = std::min(row + band, h);
+        }
     }
+    return true;
 }
-
@@ -1,6 +1,21 @@
 #pragma once
 #include "../FileSequence.h"
 #include "BaseSequenceReader.h"
+#include "OpenFileCache.h"
+#include <OpenEXR/ImfMultiPartInputFile.h>
+#include <OpenEXR/ImfFrameBuffer.h>
+#include <atomic>
+#include <functional>
+#include "MemoryMappedIStream.h"
+#include "SharedFileIStream.h"
+
+/// an open exr file, and the stream it reads from
+/// the file does not own its stream: the stream is declared first, so it is destroyed last
+struct EXRFile
+{
+    std::unique_ptr<Imf::IStream> stream; // NULL when the file opened its own stream
+    std::unique_ptr<Imf::MultiPartInputFile> file;
+};
 
 class EXRSequenceReader : public BaseSequenceReader {
 
@@ -11,6 +26,7 @@ public:
     // attributes
     std::tuple<int, int> size() override; /// display size
     std::tuple<int, int, int, int> bbox() override; /// data bounding box
+    int level() override { return m_level; }
 
     int current_frame() override { return m_current_frame; }
     void set_current_frame(int f) override { m_current_frame = f; }
@@ -21,15 +37,32 @@ public:
     std::vector<std::string> selected_channels() override;
     void set_selected_channels(std::vector<std::string> channels) override;
 
+    void set_threads_per_frame(int threads) override;
+    int block_rows(int frame, int part) override;
+
     // calculate
     void read() override;
+    bool read(const ReadRequest& request, void* memory, std::tuple<int, int, int, int>* bbox, int* level, ReadProgress* progress) override;
+    bool read_groups(const ReadRequest& request, const std::vector<std::vector<std::string>>& groups, const std::vector<void*>& memories, std::tuple<int, int, int, int>* bbox, int* level) override;
+
+    /// slices for the decoded pixels x, y, w, h, in the data window coordinates of the level
+    using FrameBufferFactory = std::function<Imf::FrameBuffer(int x, int y, int w, int h)>;
 
 private:
+    /// open the frame, clip the roi, and decode the part to the slices of framebuffer
+    bool decode(const ReadRequest& request, const FrameBufferFactory& framebuffer, std::tuple<int, int, int, int>* bbox, int* level, ReadProgress* progress);
+
     FileSequence m_sequence;
     std::tuple<int, int, int, int> m_bbox; // data window
+    int m_level{ 0 }; // resolution level of m_bbox
     int display_x, display_y, display_width, display_height; // display window
     int m_current_frame; // current selected frame
     int m_selected_part_idx = 0;
     std::vector<std::string> mSelectedChannels{ "A", "B", "G", "R" }; // channels to actually read
 
+    std::atomic<bool> m_memory_map{ false }; // read files through MemoryMappedIStream, instead of SharedFileIStream. opt-in: frames rewritten in place while mapped fault the reader
+    std::atomic<int> m_threads_per_frame{ 0 }; // line buffers decoded in parallel per file, 0: global thread count
+    std::atomic<MemoryMappedIStream::AccessHint> m_access_hint{ MemoryMappedIStream::AccessHint::Sequential };
+    OpenFileCache<EXRFile> m_files; // open files with parsed headers
+
 };
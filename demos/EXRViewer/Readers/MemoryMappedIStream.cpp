@@ -0,0 +1,114 @@
+#include "MemoryMappedIStream.h"
+
+#include <string>
+#include <cstring>
+#include <OpenEXR/Iex.h>
+
+#ifdef _WIN32
+#define NOMINMAX
+#include <windows.h>
+#else
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
+MemoryMappedIStream::MemoryMappedIStream(const char fileName[], AccessHint hint) : Imf::IStream(fileName)
+{
+#ifdef _WIN32
+	DWORD flags = FILE_ATTRIBUTE_NORMAL;
+	if (hint == AccessHint::Sequential) flags |= FILE_FLAG_SEQUENTIAL_SCAN;
+	if (hint == AccessHint::Random) flags |= FILE_FLAG_RANDOM_ACCESS;
+
+	HANDLE file = CreateFileA(fileName, GENERIC_READ, FILE_SHARE_READ | FILE_SHARE_WRITE | FILE_SHARE_DELETE, NULL, OPEN_EXISTING, flags, NULL);
+	if (file == INVALID_HANDLE_VALUE) {
+		throw Iex::InputExc(std::string("cannot open file: ") + fileName);
+	}
+
+	LARGE_INTEGER size;
+	if (!GetFileSizeEx(file, &size) || size.QuadPart == 0) {
+		CloseHandle(file);
+		throw Iex::InputExc(std::string("cannot map empty file: ") + fileName);
+	}
+
+	HANDLE mapping = CreateFileMappingA(file, NULL, PAGE_READONLY, 0, 0, NULL);
+	if (mapping == NULL) {
+		CloseHandle(file);
+		throw Iex::InputExc(std::string("cannot map file: ") + fileName);
+	}
+
+	void* data = MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0);
+	if (data == NULL) {
+		CloseHandle(mapping);
+		CloseHandle(file);
+		throw Iex::InputExc(std::string("cannot map file: ") + fileName);
+	}
+
+	m_file = file;
+	m_mapping = mapping;
+	m_data = (char*)data;
+	m_size = size.QuadPart;
+#else
+	int fd = open(fileName, O_RDONLY);
+	if (fd < 0) {
+		throw Iex::InputExc(std::string("cannot open file: ") + fileName);
+	}
+
+	struct stat st;
+	if (fstat(fd, &st) != 0 || st.st_size == 0) {
+		close(fd);
+		throw Iex::InputExc(std::string("cannot map empty file: ") + fileName);
+	}
+
+	void* data = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+	if (data == MAP_FAILED) {
+		close(fd);
+		throw Iex::InputExc(std::string("cannot map file: ") + fileName);
+	}
+
+	if (hint == AccessHint::Sequential) {
+		madvise(data, st.st_size, MADV_SEQUENTIAL);
+		madvise(data, st.st_size, MADV_WILLNEED); // start reading ahead right away
+	}
+	if (hint == AccessHint::Random) {
+		madvise(data, st.st_size, MADV_RANDOM);
+	}
+
+	m_fd = fd;
+	m_data = (char*)data;
+	m_size = st.st_size;
+#endif
+}
+
+MemoryMappedIStream::~MemoryMappedIStream()
+{
+#ifdef _WIN32
+	UnmapViewOfFile(m_data);
+	CloseHandle(m_mapping);
+	CloseHandle(m_file);
+#else
+	munmap(m_data, m_size);
+	close(m_fd);
+#endif
+}
+
+bool MemoryMappedIStream::read(char c[], int n)
+{
+	if (m_pos < 0 || m_pos + n > m_size) {
+		throw Iex::InputExc(std::string("unexpected end of file: ") + fileName());
+	}
+	memcpy(c, m_data + m_pos, n);
+	m_pos += n;
+	return m_pos < m_size;
+}
+
+char* MemoryMappedIStream::readMemoryMapped(int n)
+{
+	if (m_pos < 0 || m_pos + n > m_size) {
+		throw Iex::InputExc(std::string("unexpected end of file: ") + fileName());
+	}
+	char* data = m_data + m_pos;
+	m_pos += n;
+	return data;
+}
@@ -0,0 +1,43 @@
+#pragma once
+#include <OpenEXR/ImfIO.h>
+#include <OpenEXR/ImfInt64.h>
+
+/// Imf::IStream reading from a memory mapped file.
+/// OpenEXR asks memory mapped streams for pointers with readMemoryMapped instead of copying chunks
+/// to its own buffers. Uncompressed pixels are copied from the mapped pages straight to the framebuffer.
+/// The file is opened with every sharing mode, so it can still be replaced or deleted while mapped.
+/// Rewriting it in place is not safe: a mapped file that is truncated faults the reader (SIGBUS on linux).
+/// The stream is not thread safe, OpenEXR serializes access per file.
+class MemoryMappedIStream : public Imf::IStream
+{
+public:
+	enum class AccessHint {
+		Normal,
+		Sequential, // whole file reads eg. full frames. the OS reads ahead aggressively
+		Random      // headers, tiles or regions only. no read ahead
+	};
+
+	/// map the whole file. throws Iex::InputExc when the file cannot be mapped
+	MemoryMappedIStream(const char fileName[], AccessHint hint = AccessHint::Normal);
+	~MemoryMappedIStream() override;
+
+	bool isMemoryMapped() const override { return true; }
+	bool read(char c[/*n*/], int n) override;
+	char* readMemoryMapped(int n) override;
+	Imf::Int64 tellg() override { return m_pos; }
+	void seekg(Imf::Int64 pos) override { m_pos = pos; }
+
+	Imf::Int64 size() const { return m_size; }
+
+private:
+	char* m_data{ NULL };
+	Imf::Int64 m_size{ 0 };
+	Imf::Int64 m_pos{ 0 };
+
+#ifdef _WIN32
+	void* m_file{ NULL };    // HANDLE
+	void* m_mapping{ NULL }; // HANDLE
+#else
+	int m_fd{ -1 };
+#endif
+};
@@ -4,8 +4,17 @@
 #include "../tracy/Tracy.hpp"
 
 #include "OpenImageIO/imagecache.h"
+#include "FramePool.h"
 
-OIIOSequenceReader::OIIOSequenceReader(const FileSequence& seq)
+#include <cmath>
+#include <climits>
+#include <cstring>
+#include <iostream>
+
+OIIOSequenceReader::OIIOSequenceReader(const FileSequence& seq) :
+	m_files([](const std::filesystem::path& filename) {
+		return OIIO::ImageInput::open(filename.string());
+	})
 {
 	m_sequence = seq;
 	m_current_frame = m_sequence.first_frame;
@@ -13,7 +22,10 @@ OIIOSequenceReader::OIIOSequenceReader(const FileSequence& seq)
 	// OpenFile
 	auto filename = m_sequence.item(m_sequence.first_frame);
 
-	auto file = OIIO::ImageInput::open(filename.string());
+	auto file = m_files.acquire(filename);
+	if (!file) {
+		throw std::runtime_error("OIIO cant open file: " + filename.string());
+	}
 
 	auto spec = file->spec();
 	display_x = spec.full_x;
@@ -30,6 +42,12 @@ OIIOSequenceReader::OIIOSequenceReader(const FileSequence& seq)
 void OIIOSequenceReader::onGUI()
 {
 	ImGui::DragInt("current frame", &m_current_frame);
+
+	int open_files = m_files.capacity();
+	if (ImGui::InputInt("open files cache", &open_files) && open_files >= 0) {
+		m_files.set_capacity(open_files);
+	}
+	ImGui::LabelText("open files", "%d (hits: %d, misses: %d)", (int)m_files.size(), m_files.hits(), m_files.misses());
 }
 
 std::tuple<int, int> OIIOSequenceReader::size() {
@@ -55,87 +73,146 @@ void OIIOSequenceReader::read()
 	if (mSelectedChannels.empty()) return;
 	assert(("memory address is NULL", memory != NULL));
 
-	auto filename = m_sequence.item(m_current_frame);
-	
+	read(current_request(), memory, &m_bbox, &m_level, NULL);
+}
+
+bool OIIOSequenceReader::read(const ReadRequest& request, void* memory, std::tuple<int, int, int, int>* bbox, int* level, ReadProgress* progress)
+{
+	//ZoneScoped;
+	if (request.channels.empty()) return false;
+	assert(("memory address is NULL", memory != NULL));
+
+	auto filename = m_sequence.item(request.frame);
 	OIIO::ImageSpec spec;
 	
 	/// Open current subimage
 	
-	std::unique_ptr<OIIO::ImageInput> file;
+	// files are leased from the cache: reopening a frame, or switching layers skips the open and the header parse
+	OpenFileCache<OIIO::ImageInput>::Lease file;
 	//OIIO::ImageSpec spec;
 	{
-		
-		auto filename = m_sequence.item(m_current_frame);
-		if (!std::filesystem::exists(filename)) {
-			std::cerr << "file does not exist: " << filename << "\n";
-			return;
-		}
-
-		file = OIIO::ImageInput::open(filename.string());
+		file = m_files.acquire(filename);
 
 		if (!file) {
 			std::cerr << "OIIO cant open this file" << "\n";
 			std::cerr << "  " << OIIO::geterror() << "\n";
+			return false;
 		}
 
-		file->seek_subimage(m_selected_part_idx, 0);
+		file->threads(m_threads_per_frame);
+
+		// the closest available mip level up to the requested one
+		int miplevel = std::max(0, request.level);
+		while (!file->seek_subimage(request.part, miplevel) && miplevel > 0) miplevel--;
+		*level = miplevel;
 		spec = file->spec();
 	}
 
 	/// Update datawindow
-	m_bbox = std::tuple<int, int, int, int>(
+	// clipped to the rows of the region of interest
+	const double scale = 1 << *level;
+	int ybegin = spec.y;
+	int yend = spec.y + spec.height;
+	auto [roi_x, roi_y, roi_w, roi_h] = request.roi;
+	if (roi_w > 0 && roi_h > 0) {
+		// the roi is in display pixels, from the display window origin
+		ybegin = std::clamp(spec.full_y + (int)std::floor(roi_y / scale), spec.y, yend);
+		yend = std::clamp(spec.full_y + (int)std::ceil((roi_y + roi_h) / scale), ybegin, yend);
+	}
+
+	*bbox = std::tuple<int, int, int, int>(
 		spec.x,
-		spec.y,
+		ybegin,
 		spec.width,
-		spec.height);
+		yend - ybegin);
+	if (yend <= ybegin) return true;
 
 	/// Read pixels
 	{
-		
-		// get channel indices
-		std::vector<int> channel_indices;
-		{
-			auto channelnames = spec.channelnames;
-			for (auto channel_name : mSelectedChannels) {
-				auto it = std::find(channelnames.begin(), channelnames.end(), channel_name);
-				if (it != channelnames.end()) {
-					int index = it - channelnames.begin();
-					channel_indices.push_back(index);
-				}
+		// where each requested channel is in the file, -1 when missing
+		std::vector<int> file_channels;
+		int chbegin = INT_MAX, chend = INT_MIN;
+		for (const auto& name : request.channels) {
+			auto it = std::find(spec.channelnames.begin(), spec.channelnames.end(), name);
+			int index = it != spec.channelnames.end() ? (int)(it - spec.channelnames.begin()) : -1;
+			file_channels.push_back(index);
+			if (index >= 0) {
+				chbegin = std::min(chbegin, index);
+				chend = std::max(chend, index + 1);
 			}
 		}
 
-		// read channels
-		{
-			int channels_count = channel_indices.size();
-			char* ptr = (char*)memory;
-			auto typesize = spec.format.size();
-			auto width = spec.width;
-
-			const auto [min, max] = std::minmax_element(channel_indices.begin(), channel_indices.end());
-			int chbegin = *min;
-			int chend = *max+1;
-			if (chend - chbegin != channel_indices.size()) {
-				throw std::exception("channels are not in order");
+		const OIIO::TypeDesc type = request.full_float ? OIIO::TypeDesc::FLOAT : OIIO::TypeDesc::HALF;
+		const size_t typesize = type.size();
+		const size_t pixel_bytes = request.channels.size() * typesize;
+		const size_t row_bytes = (size_t)spec.width * pixel_bytes;
+		const size_t plane_bytes = (size_t)spec.width * typesize * (yend - ybegin);
+
+		// channels already in file order, and interleaved, are read straight into memory
+		bool direct = !request.planar && chend > chbegin;
+		for (auto i = 0; i < file_channels.size(); i++) {
+			direct = direct && file_channels[i] == chbegin + i;
+		}
+
+		// otherwise the whole range of requested channels is decoded once, and shuffled into place
+		// reading a range per run would decompress the same chunks again for every run
+		const int range_channels = std::max(0, chend - chbegin);
+		const size_t range_pixel_bytes = range_channels * typesize;
+		const int band = progress ? std::max(1, progress->band_rows) : yend - ybegin;
+		FramePool::Buffer range;
+		if (!direct && range_channels > 0) {
+			range = FramePool::global().acquire((size_t)spec.width * range_pixel_bytes * std::min(band, yend - ybegin));
+		}
+
+		auto read_rows = [&](int y0, int y1) {
+			if (direct) {
+				char* dst = (char*)memory + (y0 - ybegin) * row_bytes;
+				if (!file->read_scanlines(request.part, *level, y0, y1, 0, chbegin, chend, type, dst, pixel_bytes, row_bytes)) {
+					std::cerr << "OIIO cannot read " << filename << ": " << file->geterror() << "\n";
+					return false;
+				}
+				return true;
+			}
+
+			if (range_channels > 0) {
+				if (!file->read_scanlines(request.part, *level, y0, y1, 0, chbegin, chend, type, range.get())) {
+					std::cerr << "OIIO cannot read " << filename << ": " << file->geterror() << "\n";
+					return false;
+				}
+			}
+
+			// shuffle to interleaved pixels or planes, missing channels are black
+			for (auto y = y0; y < y1; y++) {
+				const char* src = range.get() + (size_t)(y - y0) * spec.width * range_pixel_bytes;
+				for (auto i = 0; i < file_channels.size(); i++)
+				{
+					char* dst = request.planar
+						? (char*)memory + i * plane_bytes + (size_t)(y - ybegin) * spec.width * typesize
+						: (char*)memory + (y - ybegin) * row_bytes + i * typesize;
+					const size_t dst_stride = request.planar ? typesize : pixel_bytes;
+					if (file_channels[i] < 0) {
+						for (auto x = 0; x < spec.width; x++) memset(dst + x * dst_stride, 0, typesize);
+						continue;
+					}
+					const char* channel = src + (file_channels[i] - chbegin) * typesize;
+					for (auto x = 0; x < spec.width; x++) {
+						memcpy(dst + x * dst_stride, channel + x * range_pixel_bytes, typesize);
+					}
+				}
 			}
-			file->read_image(chbegin, chend, OIIO::TypeDesc::HALF, memory);
-
-			/// read each color plate seperatelly
-			//for (auto i = 0; i < channels_count; i++)
-			//{
-			//	int chbegin = channel_indices.at(i);
-
-			//	file->read_image(
-			//		chbegin,
-			//		chbegin + 1,
-			//		OIIO::TypeDesc::HALF, // type
-			//		&ptr[i * typesize], //data
-			//		typesize * channels_count, // xstride
-			//		typesize * channels_count * width, //ystride
-			//		OIIO::AutoStride // zstride
-			//	);
-			//}
+			return true;
+		};
+
+		if (progress == NULL) {
+			return read_rows(ybegin, yend);
+		}
+
+		// read in bands, and publish the decoded rows
+		for (int y = ybegin; y < yend; y += band) {
+			if (progress->cancel) return false;
+			if (!read_rows(y, std::min(y + band, yend))) return false;
+			progress->rows = std::min(y + band, yend) - ybegin;
 		}
 	}
-	file->close();
-}
\ No newline at end of file
+	return true;
+}
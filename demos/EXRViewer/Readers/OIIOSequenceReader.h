@@ -2,6 +2,9 @@
 #include "../FileSequence.h"
 #include "BaseSequenceReader.h"
 #include "OpenImageIO/imagecache.h"
+#include "OpenImageIO/imageio.h"
+#include "OpenFileCache.h"
+#include <atomic>
 
 class OIIOSequenceReader : public BaseSequenceReader
 {
@@ -12,6 +15,7 @@ public:
 	// attributes
 	std::tuple<int, int> size() override; /// display size
 	std::tuple<int, int, int, int> bbox() override; /// data bounding box
+	int level() override { return m_level; }
 
 	int current_frame() override { return m_current_frame; }
 	void set_current_frame(int f) override { m_current_frame = f; }
@@ -22,17 +26,23 @@ public:
 	std::vector<std::string> selected_channels() override;
 	void set_selected_channels(std::vector<std::string> channels) override;
 
+	void set_threads_per_frame(int threads) override { m_threads_per_frame = threads; }
+
 	// calculate
 	void read() override;
+	bool read(const ReadRequest& request, void* memory, std::tuple<int, int, int, int>* bbox, int* level, ReadProgress* progress) override;
 
 private:
 	FileSequence m_sequence;
 	std::tuple<int, int, int, int> m_bbox; // data window
+	int m_level{ 0 }; // resolution level of m_bbox
 	int display_x, display_y, display_width, display_height; // display window
 	int m_current_frame; // current selected frame
 	int m_selected_part_idx = 0;
 	std::vector<std::string> mSelectedChannels{ "R", "G", "B", "A"}; // channels to actually read
 
+	std::atomic<int> m_threads_per_frame{ 0 }; // 0: OIIO global threads attribute
 	OIIO::ImageCache* image_cache;
+	OpenFileCache<OIIO::ImageInput> m_files; // open files with parsed headers
 };
 
@@ -0,0 +1,140 @@
+#pragma once
+#include <list>
+#include <mutex>
+#include <memory>
+#include <string>
+#include <filesystem>
+#include <functional>
+#include <atomic>
+#include <utility>
+
+/// LRU cache of open files and their parsed headers, keyed by path and modification time.
+/// Decoders keep state inside an open file (framebuffer, current subimage), so a file is leased
+/// to a single reader at a time. The lease puts the file back to the cache when it goes out of scope.
+/// The cache must outlive its leases.
+template<typename T>
+class OpenFileCache
+{
+private:
+	struct Key {
+		std::filesystem::path path;
+		std::filesystem::file_time_type mtime;
+	};
+
+public:
+	using Opener = std::function<std::unique_ptr<T>(const std::filesystem::path&)>;
+
+	class Lease
+	{
+	private:
+		OpenFileCache* m_cache{ NULL };
+		Key m_key;
+		std::unique_ptr<T> m_file;
+
+	public:
+		Lease() {}
+		Lease(OpenFileCache* cache, Key key, std::unique_ptr<T> file) : m_cache(cache), m_key(std::move(key)), m_file(std::move(file)) {}
+		Lease(Lease&& other) noexcept : m_cache(std::exchange(other.m_cache, nullptr)), m_key(std::move(other.m_key)), m_file(std::move(other.m_file)) {}
+		Lease& operator=(Lease&& other) noexcept {
+			if (this != &other) {
+				release(); // the file held so far goes back to the cache, instead of being closed
+				m_cache = std::exchange(other.m_cache, nullptr);
+				m_key = std::move(other.m_key);
+				m_file = std::move(other.m_file);
+			}
+			return *this;
+		}
+		Lease(const Lease&) = delete;
+		Lease& operator=(const Lease&) = delete;
+
+		~Lease() {
+			release();
+		}
+
+		/// give the file back to the cache, the lease is empty afterwards
+		void release() {
+			if (m_cache && m_file) m_cache->give_back(std::move(m_key), std::move(m_file));
+			m_cache = NULL;
+			m_file.reset();
+		}
+
+		T* get() const { return m_file.get(); }
+		T* operator->() const { return m_file.get(); }
+		T& operator*() const { return *m_file; }
+		explicit operator bool() const { return m_file != nullptr; }
+	};
+
+	OpenFileCache(Opener opener, size_t capacity = 32) : m_opener(opener), m_capacity(capacity) {}
+
+	/// lease an open file
+	/// the file is only opened when there is no idle file cached with the same path and mtime.
+	/// return an empty lease when the file does not exist, or the opener returns NULL.
+	/// exceptions of the opener are passed to the caller.
+	Lease acquire(const std::filesystem::path& path)
+	{
+		// a single stat: replaces the exists() check, and detects rewritten files
+		std::error_code ec;
+		auto mtime = std::filesystem::last_write_time(path, ec);
+		if (ec) return Lease();
+
+		{
+			std::lock_guard<std::mutex> lock(m_mutex);
+			for (auto it = m_idle.begin(); it != m_idle.end(); )
+			{
+				if (it->first.path != path) {
+					++it;
+				}
+				else if (it->first.mtime != mtime) {
+					it = m_idle.erase(it); // file changed on disk
+				}
+				else {
+					auto file = std::move(it->second);
+					m_idle.erase(it);
+					m_hits++;
+					return Lease(this, { path, mtime }, std::move(file));
+				}
+			}
+			m_misses++;
+		}
+
+		// open without holding the lock
+		auto file = m_opener(path);
+		if (!file) return Lease();
+		return Lease(this, { path, mtime }, std::move(file));
+	}
+
+	void clear() {
+		std::lock_guard<std::mutex> lock(m_mutex);
+		m_idle.clear();
+	}
+
+	size_t capacity() const { return m_capacity; }
+	void set_capacity(size_t capacity) {
+		std::lock_guard<std::mutex> lock(m_mutex);
+		m_capacity = capacity;
+		while (m_idle.size() > m_capacity) m_idle.pop_back();
+	}
+
+	size_t size() {
+		std::lock_guard<std::mutex> lock(m_mutex);
+		return m_idle.size();
+	}
+
+	int hits() const { return m_hits; }
+	int misses() const { return m_misses; }
+
+private:
+	Opener m_opener;
+	size_t m_capacity;
+	std::list<std::pair<Key, std::unique_ptr<T>>> m_idle; // most recently used first
+	std::mutex m_mutex;
+	std::atomic<int> m_hits{ 0 };
+	std::atomic<int> m_misses{ 0 };
+
+	void give_back(Key key, std::unique_ptr<T> file)
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+		m_idle.emplace_front(std::move(key), std::move(file));
+		while (m_idle.size() > m_capacity) m_idle.pop_back(); // close least recently used
+	}
+};
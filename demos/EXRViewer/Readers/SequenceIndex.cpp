@@ -0,0 +1,368 @@
+#include "SequenceIndex.h"
+
+#include <fstream>
+#include <iostream>
+#include <chrono>
+#include <cstring>
+
+#include <OpenEXR/ImfHeader.h>
+#include <OpenEXR/ImfVersion.h>
+#include <OpenEXR/ImfXdr.h>
+#include <OpenEXR/ImfChannelList.h>
+#include <OpenEXR/ImfTileDescription.h>
+#include <OpenEXR/Iex.h>
+
+#include "MemoryMappedIStream.h"
+#include "../helpers.h" // lines_per_block, stable_hash
+#include "pathutils.h" // cache_directory
+
+#include "imgui.h"
+
+/// size of a resolution level of a tiled part
+static int level_size(int size, int level, Imf::LevelRoundingMode rounding)
+{
+	int s = rounding == Imf::ROUND_DOWN ? size >> level : (size + (1 << level) - 1) >> level;
+	return std::max(1, s);
+}
+
+static int num_levels(int size, Imf::LevelRoundingMode rounding)
+{
+	int n = 1;
+	while (level_size(size, n - 1, rounding) > 1) n++;
+	return n;
+}
+
+/// number of entries in the offset table of a part
+static int chunk_count(const Imf::Header& header)
+{
+	if (header.hasChunkCount()) return header.chunkCount(); // multipart files store it
+
+	auto dw = header.dataWindow();
+	int w = dw.max.x - dw.min.x + 1;
+	int h = dw.max.y - dw.min.y + 1;
+
+	if (!header.hasTileDescription()) {
+		int lines = lines_per_block(header.compression());
+		return (h + lines - 1) / lines;
+	}
+
+	const auto& td = header.tileDescription();
+	auto tiles = [&](int lx, int ly) {
+		int level_w = level_size(w, lx, td.roundingMode);
+		int level_h = level_size(h, ly, td.roundingMode);
+		return ((level_w + td.xSize - 1) / td.xSize) * ((level_h + td.ySize - 1) / td.ySize);
+	};
+
+	int count = 0;
+	switch (td.mode) {
+	case Imf::MIPMAP_LEVELS:
+		for (int l = 0; l < num_levels(std::max(w, h), td.roundingMode); l++) count += tiles(l, l);
+		break;
+	case Imf::RIPMAP_LEVELS:
+		for (int ly = 0; ly < num_levels(h, td.roundingMode); ly++)
+			for (int lx = 0; lx < num_levels(w, td.roundingMode); lx++)
+				count += tiles(lx, ly);
+		break;
+	default:
+		count = tiles(0, 0);
+	}
+	return count;
+}
+
+FrameInfo index_exr_file(const std::filesystem::path& filename)
+{
+	// only the headers and offset tables are touched
+	MemoryMappedIStream is(filename.string().c_str(), MemoryMappedIStream::AccessHint::Random);
+
+	int magic, version;
+	Imf::Xdr::read<Imf::StreamIO>(is, magic);
+	Imf::Xdr::read<Imf::StreamIO>(is, version);
+	if (magic != Imf::MAGIC) {
+		throw Iex::InputExc("not an exr file: " + filename.string());
+	}
+
+	/// read headers
+	std::vector<Imf::Header> headers;
+	if (Imf::isMultiPart(version)) {
+		// headers are terminated by an empty header
+		while (true) {
+			char c;
+			is.read(&c, 1);
+			if (c == 0) break;
+			is.seekg(is.tellg() - 1);
+			headers.emplace_back();
+			headers.back().readFrom(is, version);
+		}
+	}
+	else {
+		headers.emplace_back();
+		headers.back().readFrom(is, version);
+	}
+
+	/// summarize parts, and read the offset tables that follow the headers
+	FrameInfo info;
+	for (const auto& header : headers)
+	{
+		PartInfo part;
+		part.name = header.hasName() ? header.name() : "";
+		auto dw = header.dataWindow();
+		part.data_window = { dw.min.x, dw.min.y, dw.max.x - dw.min.x + 1, dw.max.y - dw.min.y + 1 };
+		auto disp = header.displayWindow();
+		part.display_window = { disp.min.x, disp.min.y, disp.max.x - disp.min.x + 1, disp.max.y - disp.min.y + 1 };
+		part.compression = header.compression();
+		part.tiled = header.hasTileDescription();
+		for (auto it = header.channels().begin(); it != header.channels().end(); ++it) {
+			part.channels.push_back(it.name());
+		}
+
+		int chunks = chunk_count(header);
+		part.chunk_offsets.resize(chunks);
+		const char* table = is.readMemoryMapped(chunks * sizeof(uint64_t));
+		memcpy(part.chunk_offsets.data(), table, chunks * sizeof(uint64_t)); // little endian on disk and on x86
+
+		info.parts.push_back(std::move(part));
+	}
+	info.valid = true;
+	return info;
+}
+
+SequenceIndex::SequenceIndex(const FileSequence& sequence, SequenceIndex* previous, int threads)
+{
+	m_sequence = sequence;
+	m_frames.resize(m_sequence.length());
+
+	// the sidecar is keyed by the pattern, so it survives range changes. Entries are validated by file size and mtime
+	char name[32];
+	snprintf(name, sizeof(name), "%016llx.idx", (unsigned long long)stable_hash(m_sequence.get_pattern()));
+	m_sidecar = cache_directory() / "index" / name;
+
+	if (previous && previous->m_sidecar == m_sidecar)
+	{
+		// extend the previous index: the frames it indexed so far, and the sidecar entries it had
+		m_cached = previous->m_cached;
+		std::lock_guard<std::mutex> lock(previous->m_mutex);
+		for (const auto& info : previous->m_frames) {
+			if (info) m_cached[info->frame] = info;
+		}
+	}
+	else
+	{
+		load_sidecar(&m_cached);
+	}
+
+	m_start = std::chrono::steady_clock::now();
+	for (auto i = 0; i < std::max(1, threads); i++) {
+		m_workers.emplace_back(&SequenceIndex::worker_loop, this);
+	}
+}
+
+SequenceIndex::~SequenceIndex()
+{
+	m_stop = true;
+	for (auto& worker : m_workers) {
+		worker.join();
+	}
+}
+
+void SequenceIndex::worker_loop()
+{
+	while (!m_stop)
+	{
+		int i = m_next++;
+		if (i >= m_frames.size()) return;
+		int F = m_sequence.first_frame + i;
+		auto filename = m_sequence.item(F);
+
+		// a stat is enough to validate the cached entry
+		std::error_code size_ec, time_ec;
+		auto file_size = std::filesystem::file_size(filename, size_ec);
+		auto mtime = std::filesystem::last_write_time(filename, time_ec);
+		bool exists = !size_ec && !time_ec;
+
+		std::shared_ptr<const FrameInfo> info;
+		std::shared_ptr<const FrameInfo> cached;
+		if (auto found = m_cached.find(F); found != m_cached.end()) cached = found->second;
+		if (exists && cached && cached->valid && cached->file_size == file_size && cached->mtime == mtime.time_since_epoch().count()) {
+			info = cached;
+		}
+		else {
+			auto parsed = std::make_shared<FrameInfo>();
+			if (exists) {
+				try {
+					*parsed = index_exr_file(filename);
+				}
+				catch (const std::exception& ex) {
+					std::cerr << "cannot index " << filename << ": " << ex.what() << "\n";
+				}
+				parsed->file_size = file_size;
+				parsed->mtime = mtime.time_since_epoch().count();
+			}
+			parsed->frame = F;
+			info = parsed;
+			m_parsed++;
+		}
+
+		{
+			std::lock_guard<std::mutex> lock(m_mutex);
+			m_frames[i] = info;
+		}
+
+		// the last frame completes the index
+		if (++m_indexed == m_frames.size()) {
+			std::chrono::duration<double> seconds = std::chrono::steady_clock::now() - m_start;
+			m_seconds = seconds.count();
+			if (m_parsed > 0) save_sidecar();
+		}
+	}
+}
+
+std::shared_ptr<const FrameInfo> SequenceIndex::frame(int F)
+{
+	int i = F - m_sequence.first_frame;
+	if (i < 0 || i >= m_frames.size()) return NULL;
+	std::lock_guard<std::mutex> lock(m_mutex);
+	return m_frames[i];
+}
+
+/// sidecar serialization
+// plain little endian records, the layout is versioned by the magic
+
+static const char SIDECAR_MAGIC[8] = { 'G','L','Z','I','D','X','0','1' };
+
+template<typename T>
+static void write_pod(std::ostream& os, const T& value) {
+	os.write((const char*)&value, sizeof(T));
+}
+
+template<typename T>
+static bool read_pod(std::istream& is, T* value) {
+	return (bool)is.read((char*)value, sizeof(T));
+}
+
+static void write_string(std::ostream& os, const std::string& text) {
+	write_pod(os, (uint32_t)text.size());
+	os.write(text.data(), text.size());
+}
+
+static bool read_string(std::istream& is, std::string* text) {
+	uint32_t size;
+	if (!read_pod(is, &size) || size > (1 << 20)) return false;
+	text->resize(size);
+	return (bool)is.read(text->data(), size);
+}
+
+static void write_box(std::ostream& os, const std::tuple<int, int, int, int>& box) {
+	auto [x, y, w, h] = box;
+	for (int32_t v : { x, y, w, h }) write_pod(os, v);
+}
+
+static bool read_box(std::istream& is, std::tuple<int, int, int, int>* box) {
+	int32_t v[4];
+	for (auto& c : v) if (!read_pod(is, &c)) return false;
+	*box = { v[0], v[1], v[2], v[3] };
+	return true;
+}
+
+void SequenceIndex::save_sidecar()
+{
+	// merged with the entries out of the range, so a shorter range does not lose them
+	std::map<int, std::shared_ptr<const FrameInfo>> merged = m_cached;
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+		for (const auto& info : m_frames) merged[info->frame] = info;
+	}
+
+	std::error_code ec;
+	std::filesystem::create_directories(m_sidecar.parent_path(), ec);
+
+	// write next to the sidecar, and swap, so a reader never sees a partial index
+	auto tmp = m_sidecar;
+	tmp += ".tmp";
+	{
+		std::ofstream os(tmp, std::ios::binary);
+		if (!os) return;
+		os.write(SIDECAR_MAGIC, sizeof(SIDECAR_MAGIC));
+		write_pod(os, (uint32_t)merged.size());
+		for (const auto& [F, info] : merged)
+		{
+			write_pod(os, (int32_t)info->frame);
+			write_pod(os, (uint64_t)info->file_size);
+			write_pod(os, (int64_t)info->mtime);
+			write_pod(os, (uint8_t)info->valid);
+			write_pod(os, (uint32_t)info->parts.size());
+			for (const auto& part : info->parts)
+			{
+				write_string(os, part.name);
+				write_box(os, part.data_window);
+				write_box(os, part.display_window);
+				write_pod(os, (int32_t)part.compression);
+				write_pod(os, (uint8_t)part.tiled);
+				write_pod(os, (uint32_t)part.channels.size());
+				for (const auto& channel : part.channels) write_string(os, channel);
+				write_pod(os, (uint32_t)part.chunk_offsets.size());
+				os.write((const char*)part.chunk_offsets.data(), part.chunk_offsets.size() * sizeof(uint64_t));
+			}
+		}
+	}
+	std::filesystem::rename(tmp, m_sidecar, ec);
+	if (ec) std::cerr << "cannot save sequence index: " << ec.message() << "\n";
+}
+
+bool SequenceIndex::load_sidecar(std::map<int, std::shared_ptr<const FrameInfo>>* frames)
+{
+	std::ifstream is(m_sidecar, std::ios::binary);
+	if (!is) return false;
+
+	char magic[8];
+	if (!is.read(magic, sizeof(magic)) || memcmp(magic, SIDECAR_MAGIC, sizeof(magic)) != 0) return false;
+
+	uint32_t count;
+	if (!read_pod(is, &count)) return false;
+
+	std::map<int, std::shared_ptr<const FrameInfo>> loaded;
+	for (uint32_t f = 0; f < count; f++)
+	{
+		auto info = std::make_shared<FrameInfo>();
+		int32_t frame;
+		uint8_t valid;
+		uint32_t parts;
+		if (!read_pod(is, &frame) || !read_pod(is, &info->file_size) || !read_pod(is, &info->mtime) || !read_pod(is, &valid) || !read_pod(is, &parts)) return false;
+		info->frame = frame;
+		info->valid = valid;
+
+		for (uint32_t p = 0; p < parts; p++)
+		{
+			PartInfo part;
+			int32_t compression;
+			uint8_t tiled;
+			uint32_t channels, chunks;
+			if (!read_string(is, &part.name) || !read_box(is, &part.data_window) || !read_box(is, &part.display_window)) return false;
+			if (!read_pod(is, &compression) || !read_pod(is, &tiled) || !read_pod(is, &channels)) return false;
+			part.compression = compression;
+			part.tiled = tiled;
+			part.channels.resize(channels);
+			for (auto& channel : part.channels) {
+				if (!read_string(is, &channel)) return false;
+			}
+			if (!read_pod(is, &chunks)) return false;
+			part.chunk_offsets.resize(chunks);
+			if (!is.read((char*)part.chunk_offsets.data(), chunks * sizeof(uint64_t))) return false;
+			info->parts.push_back(std::move(part));
+		}
+		loaded[frame] = info;
+	}
+
+	*frames = std::move(loaded);
+	return true;
+}
+
+void SequenceIndex::onGUI()
+{
+	ImGui::ProgressBar((float)m_indexed / std::max(1, size()), ImVec2(-1, 0), (std::to_string(m_indexed) + "/" + std::to_string(size())).c_str());
+	ImGui::LabelText("parsed", "%d (%d from sidecar)", (int)m_parsed, m_indexed - m_parsed);
+	if (done()) {
+		ImGui::LabelText("time", "%.1f ms", m_seconds * 1000.0);
+	}
+	ImGui::LabelText("sidecar", "%s", m_sidecar.filename().string().c_str());
+	if (ImGui::IsItemHovered()) ImGui::SetTooltip("%s", m_sidecar.string().c_str());
+}
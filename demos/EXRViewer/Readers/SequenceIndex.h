@@ -0,0 +1,82 @@
+#pragma once
+#include <vector>
+#include <map>
+#include <string>
+#include <tuple>
+#include <memory>
+#include <thread>
+#include <mutex>
+#include <atomic>
+#include <cstdint>
+#include <filesystem>
+#include <chrono>
+
+#include "../FileSequence.h"
+
+/// header summary of a single exr part
+struct PartInfo
+{
+	std::string name;
+	std::tuple<int, int, int, int> data_window; // x,y,w,h
+	std::tuple<int, int, int, int> display_window; // x,y,w,h
+	int compression{ 0 }; // Imf::Compression
+	bool tiled{ false };
+	std::vector<std::string> channels;
+	std::vector<uint64_t> chunk_offsets; // file offset of each scanline block or tile
+};
+
+/// header summary of a frame, and the file state it was read from
+struct FrameInfo
+{
+	int frame{ 0 };
+	uint64_t file_size{ 0 };
+	int64_t mtime{ 0 }; // last write time ticks
+	bool valid{ false }; // file exists, and its headers could be parsed
+	std::vector<PartInfo> parts;
+};
+
+/// Parses the headers of every frame of a sequence in parallel, in the background.
+/// The index is kept in a sidecar file in the cache directory, keyed by the pattern of the sequence, its entries by frame.
+/// When the sequence is opened again, or its range grows, only frames whose size or modification time changed are parsed.
+class SequenceIndex
+{
+private:
+	FileSequence m_sequence;
+	std::filesystem::path m_sidecar;
+
+	std::vector<std::shared_ptr<const FrameInfo>> m_frames; // by frame - first_frame, NULL until indexed
+	std::map<int, std::shared_ptr<const FrameInfo>> m_cached; // by frame, from the sidecar or a previous index, read only once the workers run
+	std::mutex m_mutex;
+	std::vector<std::thread> m_workers;
+	std::atomic<int> m_next{ 0 }; // next frame to index, relative to first frame
+	std::atomic<int> m_indexed{ 0 };
+	std::atomic<int> m_parsed{ 0 }; // frames that were not in the sidecar
+	std::atomic<bool> m_stop{ false };
+	std::chrono::steady_clock::time_point m_start;
+	std::atomic<double> m_seconds{ 0 }; // time to complete the index
+
+	void worker_loop();
+	bool load_sidecar(std::map<int, std::shared_ptr<const FrameInfo>>* frames);
+	void save_sidecar();
+
+public:
+	/// previous: index of the same sequence eg. before its range changed. Its entries are reused, without reading the sidecar again
+	SequenceIndex(const FileSequence& sequence, SequenceIndex* previous = NULL, int threads = std::thread::hardware_concurrency());
+	~SequenceIndex();
+
+	SequenceIndex(const SequenceIndex&) = delete;
+	SequenceIndex& operator=(const SequenceIndex&) = delete;
+
+	/// header summary of a frame. NULL when the frame is not indexed yet
+	std::shared_ptr<const FrameInfo> frame(int F);
+
+	int indexed() const { return m_indexed; }
+	int size() const { return (int)m_frames.size(); }
+	bool done() const { return m_indexed == m_frames.size(); }
+
+	void onGUI();
+};
+
+/// read the header summary of an exr file, including the chunk offset tables
+/// throws when the file cannot be parsed
+FrameInfo index_exr_file(const std::filesystem::path& filename);
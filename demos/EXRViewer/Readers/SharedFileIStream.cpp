@@ -0,0 +1,82 @@
+#include "SharedFileIStream.h"
+
+#include <string>
+#include <OpenEXR/Iex.h>
+
+#ifdef _WIN32
+#define NOMINMAX
+#include <windows.h>
+#else
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
+SharedFileIStream::SharedFileIStream(const char fileName[]) : Imf::IStream(fileName)
+{
+#ifdef _WIN32
+	HANDLE file = CreateFileA(fileName, GENERIC_READ, FILE_SHARE_READ | FILE_SHARE_WRITE | FILE_SHARE_DELETE, NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+	if (file == INVALID_HANDLE_VALUE) {
+		throw Iex::InputExc(std::string("cannot open file: ") + fileName);
+	}
+
+	LARGE_INTEGER size;
+	if (!GetFileSizeEx(file, &size)) {
+		CloseHandle(file);
+		throw Iex::InputExc(std::string("cannot open file: ") + fileName);
+	}
+
+	m_file = file;
+	m_size = size.QuadPart;
+#else
+	int fd = open(fileName, O_RDONLY);
+	if (fd < 0) {
+		throw Iex::InputExc(std::string("cannot open file: ") + fileName);
+	}
+
+	struct stat st;
+	if (fstat(fd, &st) != 0) {
+		close(fd);
+		throw Iex::InputExc(std::string("cannot open file: ") + fileName);
+	}
+
+	m_fd = fd;
+	m_size = st.st_size;
+#endif
+}
+
+SharedFileIStream::~SharedFileIStream()
+{
+#ifdef _WIN32
+	CloseHandle(m_file);
+#else
+	close(m_fd);
+#endif
+}
+
+bool SharedFileIStream::read(char c[], int n)
+{
+	if (m_pos < 0 || m_pos + n > m_size) {
+		throw Iex::InputExc(std::string("unexpected end of file: ") + fileName());
+	}
+
+	// reads at the position, there is no file pointer to keep in sync with seekg
+	for (int done = 0; done < n;)
+	{
+#ifdef _WIN32
+		OVERLAPPED at{};
+		at.Offset = (DWORD)(m_pos + done);
+		at.OffsetHigh = (DWORD)((m_pos + done) >> 32);
+		DWORD bytes = 0;
+		if (!ReadFile(m_file, c + done, n - done, &bytes, &at)) bytes = 0;
+#else
+		ssize_t bytes = pread(m_fd, c + done, n - done, m_pos + done);
+#endif
+		if (bytes <= 0) {
+			throw Iex::InputExc(std::string("cannot read file, it may have been truncated: ") + fileName());
+		}
+		done += bytes;
+	}
+	m_pos += n;
+	return m_pos < m_size;
+}
@@ -0,0 +1,29 @@
+#pragma once
+#include <OpenEXR/ImfIO.h>
+#include <OpenEXR/ImfInt64.h>
+
+/// Imf::IStream reading from a file opened with every sharing mode.
+/// Open files are kept by OpenFileCache. The files of a sequence that is still rendering are replaced, rewritten or deleted
+/// while they are cached: unlike the std::ifstream of Imf::StdIFStream on windows, this stream never prevents it.
+/// The stream is not thread safe, OpenEXR serializes access per file.
+class SharedFileIStream : public Imf::IStream
+{
+public:
+	/// throws Iex::InputExc when the file cannot be opened
+	SharedFileIStream(const char fileName[]);
+	~SharedFileIStream() override;
+
+	bool read(char c[/*n*/], int n) override;
+	Imf::Int64 tellg() override { return m_pos; }
+	void seekg(Imf::Int64 pos) override { m_pos = pos; }
+
+private:
+	Imf::Int64 m_size{ 0 };
+	Imf::Int64 m_pos{ 0 };
+
+#ifdef _WIN32
+	void* m_file{ NULL }; // HANDLE
+#else
+	int m_fd{ -1 };
+#endif
+};
@@ -32,6 +32,7 @@ void CorrectionPlate::resize(int width, int height)
 
     mWidth = width;
     mHeight = height;
+    mDirty = true;
 }
 
 void CorrectionPlate::onGui()
@@ -41,26 +42,34 @@ void CorrectionPlate::onGui()
         static const std::vector<std::string> devices{ "linear", "sRGB", "Rec.709" };
         int devices_combo_width = ImGui::CalcComboWidth(devices);
         ImGui::SetNextItemWidth(ImGui::GetTextLineHeight() * 6);
-        ImGui::SliderFloat(ICON_FA_ADJUST "##gain", &gain, -6.0f, 6.0f);
+        if (ImGui::SliderFloat(ICON_FA_ADJUST "##gain", &gain, -6.0f, 6.0f)) mDirty = true;
         if (ImGui::IsItemHovered()) ImGui::SetTooltip("gain");
-        if (ImGui::IsItemClicked(1)) gain = 0.0;
+        if (ImGui::IsItemClicked(1)) {
+            gain = 0.0;
+            mDirty = true;
+        }
 
         ImGui::SetNextItemWidth(ImGui::GetTextLineHeight() * 6);
-        ImGui::SliderFloat("##gamma", &gamma, 0, 4);
+        if (ImGui::SliderFloat("##gamma", &gamma, 0, 4)) mDirty = true;
         if (ImGui::IsItemHovered()) ImGui::SetTooltip("gamma");
-        if (ImGui::IsItemClicked(1)) gamma = 1.0;
+        if (ImGui::IsItemClicked(1)) {
+            gamma = 1.0;
+            mDirty = true;
+        }
 
 
         ImGui::SetNextItemWidth(devices_combo_width);
-        ImGui::Combo("##device", &selected_device, "linear\0sRGB\0Rec.709\0");
+        if (ImGui::Combo("##device", &selected_device, "linear\0sRGB\0Rec.709\0")) mDirty = true;
         if (ImGui::IsItemHovered()) ImGui::SetTooltip("device");
 
     }
     ImGui::EndGroup();
 }
 
-void CorrectionPlate::set_input_tex(GLuint tex) {
+void CorrectionPlate::set_input_tex(GLuint tex, int revision) {
+    if (tex != mInputtex || revision != mInputRevision) mDirty = true;
     mInputtex = tex;
+    mInputRevision = revision;
 }
 
 void CorrectionPlate::compile_program()
@@ -172,11 +181,14 @@ void CorrectionPlate::compile_program()
         glDeleteProgram(mProgram);
     }
     mProgram = imdraw::make_program_from_source(PASS_THROUGH_VERTEX_CODE, display_correction_fragment_code);
+    mDirty = true;
 }
 
 
     void CorrectionPlate::evaluate()
     {
+        if (!mDirty) return;
+
         // update result texture
         BeginRenderToTexture(fbo, 0, 0, mWidth, mHeight);
         glClearColor(0, 0, 0, 0);
@@ -204,6 +216,8 @@ void CorrectionPlate::compile_program()
         glBindTexture(GL_TEXTURE_2D, 0);
         imdraw::pop_program();
         EndRenderToTexture();
+        mDirty = false;
+        mRevision++;
     }
 
     void CorrectionPlate::render()
@@ -21,6 +21,10 @@ private:
     float gain{ 0 };
     float gamma{ 1.0 };
 
+    int mInputRevision{ -1 }; // of the input texture, see set_input_tex
+    bool mDirty{ true }; // the result is out of date
+    int mRevision{ 0 }; // counts the evaluations, the viewport redraws when it changes
+
 
 public:
     /// FBO size, and input texture id
@@ -33,11 +37,15 @@ public:
 
     void onGui();
 
-    void set_input_tex(GLuint tex);
+    /// revision: changes whenever the content of the texture changes eg. PixelsRenderer::revision
+    void set_input_tex(GLuint tex, int revision);
 
     void compile_program();
 
+    /// apply the corrections, unless the input and the settings are the same as last time
     void evaluate();
 
+    int revision() const { return mRevision; }
+
     void render();
 };
\ No newline at end of file
@@ -0,0 +1,469 @@
+#include "Scopes.h"
+
+#include <iostream>
+#include <algorithm>
+#include <chrono>
+#include <future>
+#include <cstring>
+#include <cmath>
+
+#include "imgui.h"
+#include "implot.h"
+#include <OpenEXR/half.h>
+
+// f16c converts eight halves per instruction. it is picked at runtime, so the build does not need /arch:AVX2
+// msvc compiles the intrinsics for any target, gcc and clang for the functions marked with SCOPES_F16C_TARGET
+#if defined(_M_X64) || defined(_M_IX86) || defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define SCOPES_F16C
+#ifdef _MSC_VER
+#include <intrin.h>
+#define SCOPES_F16C_TARGET
+#else
+#include <cpuid.h>
+#define SCOPES_F16C_TARGET __attribute__((target("avx,f16c")))
+#endif
+#endif
+
+#ifdef SCOPES_F16C
+/// the cpu converts halves, and the os saves the ymm registers
+static bool has_f16c()
+{
+    unsigned int ecx;
+#ifdef _MSC_VER
+    int info[4];
+    __cpuid(info, 1);
+    ecx = (unsigned int)info[2];
+#else
+    unsigned int eax, ebx, edx;
+    if (!__get_cpuid(1, &eax, &ebx, &ecx, &edx)) return false;
+#endif
+    const bool osxsave = ecx & (1u << 27), avx = ecx & (1u << 28), f16c = ecx & (1u << 29);
+    if (!osxsave || !avx || !f16c) return false;
+#ifdef _MSC_VER
+    const unsigned long long xcr0 = _xgetbv(0);
+#else
+    unsigned int xcr0_low, xcr0_high;
+    __asm__("xgetbv" : "=a"(xcr0_low), "=d"(xcr0_high) : "c"(0));
+    const unsigned long long xcr0 = xcr0_low;
+#endif
+    return (xcr0 & 0x6) == 0x6; // xmm and ymm state
+}
+
+SCOPES_F16C_TARGET static void halves_to_floats_f16c(const half* src, float* dst, size_t count)
+{
+    size_t i = 0;
+    for (; i + 8 <= count; i += 8) {
+        _mm256_storeu_ps(dst + i, _mm256_cvtph_ps(_mm_loadu_si128((const __m128i*)(src + i))));
+    }
+    for (; i < count; i++) dst[i] = src[i];
+}
+
+static const bool use_f16c = has_f16c();
+#endif
+
+/// the path halves_to_floats takes, to compare timings between machines
+static const char* conversion_name()
+{
+#ifdef SCOPES_F16C
+    if (use_f16c) return "f16c";
+#endif
+    return "scalar";
+}
+
+/// halves to floats, eg. a row of interleaved pixels
+static void halves_to_floats(const half* src, float* dst, size_t count)
+{
+#ifdef SCOPES_F16C
+    if (use_f16c) {
+        halves_to_floats_f16c(src, dst, count);
+        return;
+    }
+#endif
+    for (size_t i = 0; i < count; i++) dst[i] = src[i];
+}
+
+/// Rec. 709 luma, and the scale of the color differences to -0.5..0.5
+static constexpr float Kr{ 0.2126f }, Kg{ 0.7152f }, Kb{ 0.0722f };
+static constexpr float Cb_scale{ 1.8556f }, Cr_scale{ 1.5748f };
+
+std::vector<int> Scopes::rgb_indices(const std::vector<std::string>& channels)
+{
+    std::vector<int> rgb{ -1, -1, -1 };
+    for (auto i = 0; i < channels.size(); i++)
+    {
+        std::string name = channels[i].substr(channels[i].find_last_of('.') + 1);
+        std::transform(name.begin(), name.end(), name.begin(), [](unsigned char c) { return std::toupper(c); });
+        if (name == "R" || name == "RED") rgb[0] = i;
+        if (name == "G" || name == "GREEN") rgb[1] = i;
+        if (name == "B" || name == "BLUE") rgb[2] = i;
+    }
+    if (std::all_of(rgb.begin(), rgb.end(), [](int i) { return i >= 0; })) return rgb;
+
+    // not named eg. XYZ, or a data layer: the first three channels, or a grey first one
+    if (channels.size() >= 3) return { 0, 1, 2 };
+    if (channels.size() >= 1) return { 0 };
+    return {};
+}
+
+void Scopes::analyse(const void* pixels, int width, int height, int nchannels, const std::vector<int>& rgb, float min_value, float max_value, int threads, Result* result)
+{
+    auto start = std::chrono::steady_clock::now();
+    const int C = (int)rgb.size();
+    result->channels = C;
+    result->pixels = (size_t)width * height;
+    result->min_value = min_value;
+    result->max_value = max_value;
+    result->histogram.assign((size_t)C * bins, 0);
+    result->waveform.assign((size_t)C * bins * bins, 0);
+    result->vectorscope.assign(C == 3 ? bins * bins : 0, 0);
+    if (width <= 0 || height <= 0 || C == 0 || max_value <= min_value) return;
+
+    const half* src = (const half*)pixels;
+    const float scale = bins / (max_value - min_value);
+    const float top = bins - 1;
+
+    // histograms and vectorscope counts of each thread, summed at the end
+    threads = std::clamp(threads, 1, std::min(bins, width));
+    std::vector<std::vector<uint32_t>> histograms(threads);
+    std::vector<std::vector<uint32_t>> vectorscopes(threads);
+
+    /// the pixels of a band of waveform columns, in every row
+    /// each step is a plain loop over a row of the band, so the conversion and the bin indices vectorise,
+    /// only the increments are scattered
+    auto analyse_columns = [&](int t) {
+        const int bin_begin = bins * t / threads;
+        const int bin_end = bins * (t + 1) / threads;
+        const int x_begin = (int)(((long long)bin_begin * width + bins - 1) / bins);
+        const int x_end = (int)(((long long)bin_end * width + bins - 1) / bins);
+        const int n = x_end - x_begin;
+
+        auto& histogram = histograms[t];
+        auto& vectorscope = vectorscopes[t];
+        histogram.assign((size_t)C * bins, 0);
+        vectorscope.assign(C == 3 ? bins * bins : 0, 0);
+
+        std::vector<int> columns(n); // waveform column of each pixel
+        for (int i = 0; i < n; i++) columns[i] = (int)((long long)(x_begin + i) * bins / width);
+
+        std::vector<float> interleaved((size_t)n * nchannels);
+        std::vector<float> values((size_t)C * n); // planar
+        std::vector<int> index(n);
+        for (int y = 0; y < height; y++)
+        {
+            halves_to_floats(src + ((size_t)y * width + x_begin) * nchannels, interleaved.data(), interleaved.size());
+            for (int c = 0; c < C; c++) {
+                float* v = values.data() + (size_t)c * n;
+                const float* channel = interleaved.data() + rgb[c];
+                for (int i = 0; i < n; i++) v[i] = channel[(size_t)i * nchannels];
+            }
+
+            // histogram and waveform, NaNs go to the first bin
+            for (int c = 0; c < C; c++)
+            {
+                const float* v = values.data() + (size_t)c * n;
+                for (int i = 0; i < n; i++) {
+                    float b = (v[i] - min_value) * scale;
+                    b = b > 0.0f ? b : 0.0f;
+                    b = b < top ? b : top;
+                    index[i] = (int)b;
+                }
+                uint32_t* hist = histogram.data() + (size_t)c * bins;
+                uint32_t* wave = result->waveform.data() + (size_t)c * bins * bins; // this thread owns its columns
+                for (int i = 0; i < n; i++) {
+                    hist[index[i]]++;
+                    wave[columns[i] * bins + index[i]]++;
+                }
+            }
+
+            // vectorscope: color differences of rec. 709 rgb
+            if (C == 3)
+            {
+                const float* r = values.data();
+                const float* g = r + n;
+                const float* b = g + n;
+                for (int i = 0; i < n; i++) {
+                    const float Y = Kr * r[i] + Kg * g[i] + Kb * b[i];
+                    float u = ((b[i] - Y) / Cb_scale + 0.5f) * bins;
+                    float v = ((r[i] - Y) / Cr_scale + 0.5f) * bins;
+                    u = u > 0.0f ? u : 0.0f;
+                    u = u < top ? u : top;
+                    v = v > 0.0f ? v : 0.0f;
+                    v = v < top ? v : top;
+                    index[i] = (int)v * bins + (int)u;
+                }
+                for (int i = 0; i < n; i++) vectorscope[index[i]]++;
+            }
+        }
+    };
+
+    std::vector<std::future<void>> bands;
+    for (auto t = 1; t < threads; t++) {
+        bands.push_back(std::async(std::launch::async, analyse_columns, t));
+    }
+    analyse_columns(0);
+    for (auto& band : bands) band.get();
+
+    for (auto t = 0; t < threads; t++) {
+        for (size_t i = 0; i < result->histogram.size(); i++) result->histogram[i] += histograms[t][i];
+        for (size_t i = 0; i < result->vectorscope.size(); i++) result->vectorscope[i] += vectorscopes[t][i];
+    }
+
+    result->seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+}
+
+Scopes::Scopes()
+{
+    m_worker = std::thread(&Scopes::worker_loop, this);
+}
+
+Scopes::~Scopes()
+{
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_stop = true;
+    }
+    m_cv.notify_all();
+    m_worker.join();
+
+    if (m_waveform_texture) glDeleteTextures(1, &m_waveform_texture);
+    if (m_vectorscope_texture) glDeleteTextures(1, &m_vectorscope_texture);
+}
+
+void Scopes::worker_loop()
+{
+    while (true)
+    {
+        std::unique_lock<std::mutex> lock(m_mutex);
+        m_cv.wait(lock, [&] { return m_stop || m_pending; });
+        if (m_stop) return;
+
+        // the frame is not touched by submit while busy
+        m_pending = false;
+        m_busy = true;
+        const float min = m_min_value, max = m_max_value;
+        const int thread_count = m_threads;
+        lock.unlock();
+
+        Result result;
+        analyse(m_memory.get(), m_width, m_height, m_nchannels, m_rgb, min, max, thread_count, &result);
+
+        lock.lock();
+        m_result = std::move(result);
+        m_result_changed = true;
+        m_busy = false;
+        lock.unlock();
+
+        if (on_finished) on_finished();
+    }
+}
+
+bool Scopes::submit(const void* memory, const std::tuple<int, int, int, int>& bbox, const std::vector<std::string>& channels)
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    if (m_busy) {
+        m_skipped++;
+        return false;
+    }
+
+    auto [x, y, w, h] = bbox;
+    const size_t bytes = (size_t)w * h * channels.size() * sizeof(half);
+    if (m_memory.capacity() < bytes) {
+        m_memory.reset(); // the pool may hand back the same buffer
+        m_memory = FramePool::global().acquire(bytes);
+    }
+
+    // bands of rows in parallel
+    const int copy_threads = std::max(1, std::min((int)std::thread::hardware_concurrency(), h / 64));
+    const size_t row_bytes = (size_t)w * channels.size() * sizeof(half);
+    auto copy_rows = [&](int row_begin, int row_end) {
+        std::memcpy(m_memory.get() + row_begin * row_bytes, (const char*)memory + row_begin * row_bytes, (row_end - row_begin) * row_bytes);
+    };
+    std::vector<std::future<void>> bands;
+    for (auto t = 1; t < copy_threads; t++) {
+        bands.push_back(std::async(std::launch::async, copy_rows, h * t / copy_threads, h * (t + 1) / copy_threads));
+    }
+    copy_rows(0, h / copy_threads);
+    for (auto& band : bands) band.get();
+
+    m_width = w;
+    m_height = h;
+    m_nchannels = (int)channels.size();
+    m_rgb = rgb_indices(channels);
+    m_min_value = min_value;
+    m_max_value = max_value;
+    m_threads = threads;
+    m_pending = true;
+    m_cv.notify_one();
+    return true;
+}
+
+void Scopes::reanalyse()
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    if (m_width <= 0) return;
+    m_min_value = min_value;
+    m_max_value = max_value;
+    m_threads = threads;
+    m_pending = true; // the worker does not change the frame, it is analysed again after the current one
+    m_cv.notify_one();
+}
+
+/// log scaled densities, so the sparse values show up next to the dense ones
+static std::vector<float> densities(const uint32_t* counts, size_t size)
+{
+    const uint32_t max_count = *std::max_element(counts, counts + size);
+    std::vector<float> density(size, 0.0f);
+    if (max_count == 0) return density;
+    const float norm = 1.0f / std::log1p((float)max_count);
+    for (size_t i = 0; i < size; i++) density[i] = std::log1p((float)counts[i]) * norm;
+    return density;
+}
+
+static void upload_rgba(GLuint* texture, int width, int height, const std::vector<uint8_t>& rgba)
+{
+    if (!*texture) {
+        glGenTextures(1, texture);
+        glBindTexture(GL_TEXTURE_2D, *texture);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+    }
+    glBindTexture(GL_TEXTURE_2D, *texture);
+    glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA8, width, height, 0, GL_RGBA, GL_UNSIGNED_BYTE, rgba.data());
+    glBindTexture(GL_TEXTURE_2D, 0);
+}
+
+void Scopes::upload()
+{
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        if (!m_result_changed && parade == m_shown_parade) return;
+        if (m_result_changed) m_shown = m_result;
+        m_result_changed = false;
+    }
+    m_shown_parade = parade;
+    const int C = m_shown.channels;
+    if (C == 0) return;
+
+    /// waveform: the channels side by side, or added on top of each other
+    const int columns = parade ? C * bins : bins;
+    std::vector<uint8_t> rgba((size_t)columns * bins * 4, 0);
+    for (int c = 0; c < C; c++)
+    {
+        const auto density = densities(m_shown.waveform.data() + (size_t)c * bins * bins, (size_t)bins * bins);
+        for (int row = 0; row < bins; row++) {
+            for (int column = 0; column < bins; column++) {
+                const uint8_t value = (uint8_t)(density[column * bins + row] * 255);
+                uint8_t* texel = rgba.data() + ((size_t)row * columns + (parade ? c * bins : 0) + column) * 4;
+                if (C == 1) {
+                    texel[0] = texel[1] = texel[2] = value;
+                }
+                else {
+                    texel[c] = value;
+                }
+                texel[3] = 255;
+            }
+        }
+    }
+    upload_rgba(&m_waveform_texture, columns, bins, rgba);
+
+    if (C == 3)
+    {
+        const auto density = densities(m_shown.vectorscope.data(), m_shown.vectorscope.size());
+        std::vector<uint8_t> vectorscope_rgba((size_t)bins * bins * 4);
+        for (size_t i = 0; i < density.size(); i++) {
+            const uint8_t value = (uint8_t)(density[i] * 255);
+            vectorscope_rgba[i * 4 + 0] = vectorscope_rgba[i * 4 + 1] = vectorscope_rgba[i * 4 + 2] = value;
+            vectorscope_rgba[i * 4 + 3] = 255;
+        }
+        upload_rgba(&m_vectorscope_texture, bins, bins, vectorscope_rgba);
+    }
+}
+
+void Scopes::onGUI()
+{
+    if (ImGui::DragFloatRange2("range", &min_value, &max_value, 0.01f, -16.0f, 64.0f)) {
+        max_value = std::max(max_value, min_value + 0.01f);
+        reanalyse();
+    }
+    if (ImGui::IsItemHovered()) ImGui::SetTooltip("values of the histogram and the waveform");
+    ImGui::Checkbox("parade", &parade);
+    ImGui::SameLine();
+    ImGui::Checkbox("log histogram", &log_scale);
+    ImGui::SameLine();
+    ImGui::SetNextItemWidth(ImGui::GetTextLineHeight() * 4);
+    if (ImGui::SliderInt("threads", &threads, 1, (int)std::thread::hardware_concurrency())) reanalyse();
+
+    upload();
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        ImGui::Text("%.1f Mpixels, analysed in %.1f ms, %d frames skipped, %s halves", m_shown.pixels / 1e6, m_shown.seconds * 1000, m_skipped, conversion_name());
+    }
+
+    const int C = m_shown.channels;
+    if (C == 0) {
+        ImGui::TextDisabled("no frame analysed yet");
+        return;
+    }
+    static const ImVec4 rgb_colors[]{ { 1, 0.2f, 0.2f, 1 }, { 0.2f, 1, 0.2f, 1 }, { 0.3f, 0.5f, 1, 1 } };
+    static const char* rgb_names[]{ "R", "G", "B" };
+    const float lo = m_shown.min_value, hi = m_shown.max_value;
+
+    /// histogram
+    std::vector<float> xs(bins);
+    for (int i = 0; i < bins; i++) xs[i] = lo + (i + 0.5f) * (hi - lo) / bins;
+    std::vector<std::vector<float>> ys(C, std::vector<float>(bins));
+    float y_max = 1;
+    for (int c = 0; c < C; c++) {
+        for (int i = 0; i < bins; i++) {
+            const float count = (float)m_shown.histogram[(size_t)c * bins + i];
+            ys[c][i] = log_scale ? std::log1p(count) : count;
+            y_max = std::max(y_max, ys[c][i]);
+        }
+    }
+    ImPlot::SetNextPlotLimits(lo, hi, 0, y_max * 1.05, ImGuiCond_Always);
+    if (ImPlot::BeginPlot("##histogram", NULL, NULL, ImVec2(-1, 150), ImPlotFlags_CanvasOnly, ImPlotAxisFlags_None, ImPlotAxisFlags_NoTickLabels))
+    {
+        for (int c = 0; c < C; c++) {
+            const ImVec4 color = C == 1 ? ImVec4(1, 1, 1, 1) : rgb_colors[c];
+            ImPlot::PushStyleColor(ImPlotCol_Fill, ImVec4(color.x, color.y, color.z, 0.35f));
+            ImPlot::PushStyleColor(ImPlotCol_Line, color);
+            ImPlot::PlotShaded(C == 1 ? "Y" : rgb_names[c], xs.data(), ys[c].data(), bins);
+            ImPlot::PlotLine(C == 1 ? "Y" : rgb_names[c], xs.data(), ys[c].data(), bins);
+            ImPlot::PopStyleColor(2);
+        }
+        ImPlot::EndPlot();
+    }
+
+    /// waveform, left to right across the frame, bottom to top from the low to the high value
+    const double waveform_width = parade ? C : 1;
+    ImPlot::SetNextPlotLimits(0, waveform_width, lo, hi, ImGuiCond_Always);
+    if (ImPlot::BeginPlot("##waveform", NULL, NULL, ImVec2(-1, 200), ImPlotFlags_CanvasOnly, ImPlotAxisFlags_NoTickLabels, ImPlotAxisFlags_None))
+    {
+        ImPlot::PlotImage("waveform", (ImTextureID)(intptr_t)m_waveform_texture, ImPlotPoint(0, lo), ImPlotPoint(waveform_width, hi), ImVec2(0, 1), ImVec2(1, 0));
+        ImPlot::EndPlot();
+    }
+
+    /// vectorscope, with the targets of the 75% primaries and secondaries
+    if (C == 3)
+    {
+        const float size = std::min(ImGui::GetContentRegionAvail().x, 300.0f);
+        ImPlot::SetNextPlotLimits(-0.5, 0.5, -0.5, 0.5, ImGuiCond_Always);
+        if (ImPlot::BeginPlot("##vectorscope", NULL, NULL, ImVec2(size, size), ImPlotFlags_CanvasOnly | ImPlotFlags_Equal, ImPlotAxisFlags_NoTickLabels, ImPlotAxisFlags_NoTickLabels))
+        {
+            ImPlot::PlotImage("vectorscope", (ImTextureID)(intptr_t)m_vectorscope_texture, ImPlotPoint(-0.5, -0.5), ImPlotPoint(0.5, 0.5), ImVec2(0, 1), ImVec2(1, 0));
+
+            static const float targets[6][3]{ {0.75f,0,0}, {0.75f,0.75f,0}, {0,0.75f,0}, {0,0.75f,0.75f}, {0,0,0.75f}, {0.75f,0,0.75f} };
+            std::array<float, 6> cb, cr;
+            for (int i = 0; i < 6; i++) {
+                const float Y = Kr * targets[i][0] + Kg * targets[i][1] + Kb * targets[i][2];
+                cb[i] = (targets[i][2] - Y) / Cb_scale;
+                cr[i] = (targets[i][0] - Y) / Cr_scale;
+            }
+            ImPlot::PlotScatter("targets", cb.data(), cr.data(), 6);
+            ImPlot::EndPlot();
+        }
+    }
+}
@@ -0,0 +1,94 @@
+#pragma once
+
+#include <vector>
+#include <string>
+#include <tuple>
+#include <array>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <functional>
+#include <cstdint>
+
+#include "glad/glad.h"
+#include "FramePool.h"
+
+/// Histogram, waveform and vectorscope of the decoded frame.
+/// A frame is copied on submit, and analysed on a worker thread while the GL thread goes on.
+/// Frames submitted while the previous one is analysed are skipped, so during playback the scopes
+/// follow at the rate the analysis keeps up with.
+/// The analysis splits the frame into column bands, one per thread: each thread owns its columns of the
+/// waveform, and keeps partial histograms and vectorscope counts that are summed at the end.
+class Scopes
+{
+public:
+    static constexpr int bins{ 256 }; // histogram bins, waveform rows and columns, vectorscope size
+
+    struct Result {
+        int channels{ 0 }; // 3 for rgb, 1 for a grey or single channel layer, 0 before the first frame
+        std::vector<uint32_t> histogram; // [channel][bin]
+        std::vector<uint32_t> waveform; // [channel][column][value bin], the counts of a column are together as neighbouring pixels share it
+        std::vector<uint32_t> vectorscope; // [cr][cb], rgb only
+        size_t pixels{ 0 };
+        float min_value{ 0 }, max_value{ 1 }; // range of the bins
+        double seconds{ 0 };
+    };
+
+    /// the channels in a layer shown as red, green and blue, by name eg. R, G, B, or diffuse.R
+    /// a single index for grey layers
+    static std::vector<int> rgb_indices(const std::vector<std::string>& channels);
+
+    /// bin half pixels, interleaved with nchannels. rgb: indices of the channels to analyse
+    static void analyse(const void* pixels, int width, int height, int nchannels, const std::vector<int>& rgb, float min_value, float max_value, int threads, Result* result);
+
+private:
+    std::mutex m_mutex;
+    std::condition_variable m_cv;
+    std::thread m_worker;
+    bool m_stop{ false };
+
+    // submitted frame
+    FramePool::Buffer m_memory;
+    int m_width{ 0 }, m_height{ 0 }, m_nchannels{ 0 };
+    std::vector<int> m_rgb;
+    float m_min_value{ 0 }, m_max_value{ 1 };
+    int m_threads{ 1 };
+    bool m_pending{ false };
+    bool m_busy{ false };
+    int m_skipped{ 0 };
+
+    Result m_result; // guarded by m_mutex
+    bool m_result_changed{ false };
+
+    // drawn on the GL thread
+    Result m_shown;
+    GLuint m_waveform_texture{ 0 };
+    GLuint m_vectorscope_texture{ 0 };
+    bool m_shown_parade{ true };
+
+    void worker_loop();
+    /// analyse the last frame again, with the current settings
+    void reanalyse();
+    /// the textures of a new result, on the GL thread
+    void upload();
+
+public:
+    float min_value{ 0.0f }; // value range of the histogram and the waveform
+    float max_value{ 1.0f };
+    bool parade{ true }; // red, green and blue waveforms side by side, instead of on top of each other
+    bool log_scale{ true }; // histogram counts
+    int threads{ (int)std::thread::hardware_concurrency() };
+    std::function<void()> on_finished; // called on the worker thread when a frame is analysed eg. to wake an idle main loop
+
+    Scopes();
+    ~Scopes();
+
+    Scopes(const Scopes&) = delete;
+    Scopes& operator=(const Scopes&) = delete;
+
+    /// copy a decoded frame of halves to analyse in the background, unless the previous one is still analysed
+    /// return true when the frame was taken. Call from the GL thread
+    bool submit(const void* memory, const std::tuple<int, int, int, int>& bbox, const std::vector<std::string>& channels);
+
+    void onGUI();
+};
@@ -0,0 +1,366 @@
+#include "SequencePrefetcher.h"
+
+#include <iostream>
+#include <algorithm>
+#include <cmath>
+#include <chrono>
+#include <cstring>
+
+#include "imgui.h"
+
+SequencePrefetcher::SequencePrefetcher(BaseSequenceReader* reader, int first_frame, int last_frame, size_t frame_bytes, int ring_size, int workers) :
+    m_reader(reader),
+    m_first_frame(first_frame),
+    m_last_frame(last_frame),
+    m_frame_bytes(frame_bytes),
+    m_active_workers(worker_count(workers, ring_size)),
+    m_scheduler(std::thread::hardware_concurrency(), worker_count(workers, ring_size)),
+    m_last_frame_requested(first_frame)
+{
+    // preallocate the ring
+    m_slots.resize(ring_size);
+    for (auto i = 0; i < ring_size; i++) {
+        m_slots[i].memory = FramePool::global().acquire(frame_bytes);
+        m_slots[i].data = m_slots[i].memory.get();
+        m_slots[i].index = i;
+    }
+    start(worker_count(workers, ring_size));
+}
+
+SequencePrefetcher::SequencePrefetcher(BaseSequenceReader* reader, int first_frame, int last_frame, const std::vector<void*>& buffers, size_t frame_bytes, std::function<bool(int slot)> writable, int workers) :
+    m_reader(reader),
+    m_first_frame(first_frame),
+    m_last_frame(last_frame),
+    m_frame_bytes(frame_bytes),
+    m_active_workers(worker_count(workers, (int)buffers.size())),
+    m_writable(writable),
+    m_scheduler(std::thread::hardware_concurrency(), worker_count(workers, (int)buffers.size())),
+    m_last_frame_requested(first_frame)
+{
+    m_slots.resize(buffers.size());
+    for (auto i = 0; i < buffers.size(); i++) {
+        m_slots[i].memory = FramePool::global().acquire(frame_bytes);
+        m_slots[i].data = m_slots[i].memory.get();
+        m_slots[i].target = buffers[i];
+        m_slots[i].index = i;
+    }
+    start(worker_count(workers, (int)buffers.size()));
+}
+
+int SequencePrefetcher::worker_count(int workers, int slots)
+{
+    if (workers > 0) return workers;
+    // two slots are kept for the displayed frames
+    return std::max(1, std::min((int)std::thread::hardware_concurrency(), slots - 2));
+}
+
+void SequencePrefetcher::start(int workers)
+{
+    for (auto i = 0; i < workers; i++) {
+        m_workers.emplace_back(&SequencePrefetcher::worker_loop, this, i);
+    }
+    apply_config();
+}
+
+SequencePrefetcher::~SequencePrefetcher()
+{
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_stop = true;
+    }
+    m_cv.notify_all();
+    for (auto& worker : m_workers) {
+        worker.join();
+    }
+}
+
+int SequencePrefetcher::wrap(int F) const
+{
+    const int length = m_last_frame - m_first_frame + 1;
+    return m_first_frame + ((F - m_first_frame) % length + length) % length;
+}
+
+/// apply the scheduler config to the workers, and to the reader once the workers are out of it
+void SequencePrefetcher::apply_config()
+{
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        auto config = m_scheduler.config();
+        m_active_workers = adaptive ? std::min(config.frames, (int)m_workers.size()) : (int)m_workers.size();
+        const int threads = adaptive ? config.threads : 0;
+        if (threads != m_threads_per_frame) {
+            m_threads_per_frame = threads;
+            m_pending_threads = threads;
+        }
+    }
+    m_cv.notify_all();
+}
+
+void SequencePrefetcher::worker_loop(int index)
+{
+    while (true)
+    {
+        /// take the next queued slot
+        int idx;
+        int generation;
+        ReadRequest request;
+        void* memory;
+        void* target;
+        {
+            std::unique_lock<std::mutex> lock(m_mutex);
+            m_cv.wait(lock, [&] { return m_stop || (index < m_active_workers && !m_queue.empty()); });
+            if (m_stop) return;
+
+            // the reader reopens its files with the new thread count, while no worker reads
+            // workers wait here for the lock, so none starts meanwhile
+            if (m_pending_threads >= 0) {
+                m_cv.wait(lock, [&] { return m_stop || m_decoding == 0; });
+                if (m_stop) return;
+                if (m_pending_threads >= 0) m_reader->set_threads_per_frame(m_pending_threads);
+                m_pending_threads = -1;
+                if (m_queue.empty() || index >= m_active_workers) continue;
+            }
+
+            idx = m_queue.front();
+            m_queue.pop_front();
+            auto& slot = m_slots[idx];
+            if (slot.state != SlotState::Queued) continue; // cancelled since it was queued
+            slot.state = SlotState::Decoding;
+            slot.stale = false;
+            request = slot.request;
+            memory = slot.data;
+            target = slot.target;
+            generation = m_generation;
+            m_decoding++;
+        }
+
+        /// decode without holding the lock
+        std::tuple<int, int, int, int> bbox;
+        int level{ 0 };
+        bool success = false;
+        bool loaded = false;
+        auto start = std::chrono::steady_clock::now();
+        try {
+            loaded = load && load(request, memory, &bbox, &level);
+            success = loaded || m_reader->read(request, memory, &bbox, &level, NULL);
+            if (success && target) {
+                // a sequential write, the buffer may be write-combined memory
+                auto [x, y, w, h] = bbox;
+                std::memcpy(target, memory, (size_t)std::max(0, w) * std::max(0, h) * request.channels.size() * request.typesize());
+            }
+        }
+        catch (const std::exception& ex) {
+            std::cerr << "prefetch frame " << request.frame << " failed: " << ex.what() << "\n";
+        }
+        std::chrono::duration<double> seconds = std::chrono::steady_clock::now() - start;
+
+        /// publish
+        bool reschedule = false;
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            auto& slot = m_slots[idx];
+            slot.bbox = bbox;
+            slot.level = level;
+            slot.state = (success && generation == m_generation && !slot.stale) ? SlotState::Ready : SlotState::Empty;
+            if (success && !loaded && adaptive) reschedule = m_scheduler.record(seconds.count()); // decodes only
+            m_decoding--;
+        }
+        m_cv.notify_all(); // a worker may wait for the others to leave the reader
+        if (reschedule) apply_config();
+    }
+}
+
+void SequencePrefetcher::update(const ReadRequest& current)
+{
+    const int length = m_last_frame - m_first_frame + 1;
+    if (length < 2) return;
+
+    /// follow the playhead
+    int delta = current.frame - m_last_frame_requested;
+    if (delta > length / 2) delta -= length; // wrapped around at the start of the range
+    if (delta < -length / 2) delta += length; // wrapped around at the end of the range
+    if (delta != 0) {
+        m_direction = delta > 0 ? 1 : -1;
+        m_velocity = 0.7f * m_velocity + 0.3f * std::abs(delta);
+    }
+    m_last_frame_requested = current.frame;
+
+    /// collect frames ahead of the playhead, closest first
+    // when scrubbing fast, step over frames with the scrub velocity
+    const int stride = std::max(1, (int)std::round(m_velocity));
+    const int count = std::min(lookahead, (int)m_slots.size() - 2); // keep room for the displayed frames
+    std::vector<ReadRequest> wanted;
+    for (auto i = 1; i <= count; i++) {
+        ReadRequest request = current;
+        request.frame = wrap(current.frame + m_direction * stride * i);
+        if (request.frame == current.frame) break; // range is shorter than the lookahead
+        if (available && !available(request.frame)) continue; // not rendered yet
+        wanted.push_back(request);
+    }
+
+    std::lock_guard<std::mutex> lock(m_mutex);
+    auto is_wanted = [&](const Slot& slot) {
+        if (slot.request == current) return true; // keep the current frame for redraws
+        return std::find(wanted.begin(), wanted.end(), slot.request) != wanted.end();
+    };
+
+    /// cancel frames the playhead moved away from
+    for (auto& slot : m_slots) {
+        if (slot.state == SlotState::Queued && !is_wanted(slot)) {
+            slot.state = SlotState::Empty;
+        }
+    }
+    m_queue.erase(std::remove_if(m_queue.begin(), m_queue.end(), [&](int idx) {
+        return m_slots[idx].state != SlotState::Queued;
+    }), m_queue.end());
+
+    /// schedule missing frames
+    for (const auto& request : wanted)
+    {
+        bool scheduled = std::any_of(m_slots.begin(), m_slots.end(), [&](const Slot& slot) {
+            return slot.state != SlotState::Empty && slot.request == request;
+        });
+        if (scheduled) continue;
+
+        // reuse an empty slot, or a decoded frame that is not wanted anymore
+        // external buffers are skipped while the GPU reads them
+        auto writable = [&](int i) { return !m_writable || m_writable(i); };
+        int target = -1;
+        for (auto i = 0; i < m_slots.size() && target < 0; i++) {
+            if (m_slots[i].state == SlotState::Empty && writable(i)) target = i;
+        }
+        for (auto i = 0; i < m_slots.size() && target < 0; i++) {
+            if (m_slots[i].state == SlotState::Ready && !is_wanted(m_slots[i]) && writable(i)) target = i;
+        }
+        if (target < 0) break; // ring is full
+
+        m_slots[target].request = request;
+        m_slots[target].state = SlotState::Queued;
+        m_queue.push_back(target);
+    }
+    m_cv.notify_all();
+}
+
+const SequencePrefetcher::Slot* SequencePrefetcher::acquire(const ReadRequest& request)
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+
+    // count each requested frame once, not every redraw
+    const bool count = !(request == m_last_acquired);
+    m_last_acquired = request;
+
+    for (auto& slot : m_slots) {
+        if (slot.state == SlotState::Ready && slot.request == request) {
+            slot.state = SlotState::InUse;
+            if (count) m_hits++;
+            return &slot;
+        }
+    }
+    if (count) m_misses++;
+    return NULL;
+}
+
+void SequencePrefetcher::release(const Slot* slot)
+{
+    if (slot == NULL) return;
+    std::lock_guard<std::mutex> lock(m_mutex);
+    for (auto& s : m_slots) {
+        if (&s == slot && s.state == SlotState::InUse) {
+            s.state = s.stale ? SlotState::Empty : SlotState::Ready;
+            s.stale = false;
+        }
+    }
+}
+
+void SequencePrefetcher::invalidate()
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_generation++; // frames being decoded right now are dropped when they finish
+    m_queue.clear();
+    for (auto& slot : m_slots) {
+        if (slot.state == SlotState::Queued || slot.state == SlotState::Ready) {
+            slot.state = SlotState::Empty;
+        }
+        if (slot.state == SlotState::InUse) slot.stale = true;
+    }
+    m_last_acquired = { -1, -1, {} };
+    m_scheduler.reset(); // the new frames may decode differently
+}
+
+void SequencePrefetcher::invalidate(int frame)
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    for (auto& slot : m_slots) {
+        if (slot.request.frame != frame) continue;
+        if (slot.state == SlotState::Queued || slot.state == SlotState::Ready) {
+            slot.state = SlotState::Empty;
+        }
+        if (slot.state == SlotState::Decoding || slot.state == SlotState::InUse) slot.stale = true;
+    }
+    // the queue skips slots that are not queued anymore
+    if (m_last_acquired.frame == frame) m_last_acquired = { -1, -1, {} };
+}
+
+void SequencePrefetcher::set_range(int first_frame, int last_frame)
+{
+    // only read by update on the GL thread
+    m_first_frame = first_frame;
+    m_last_frame = last_frame;
+}
+
+void SequencePrefetcher::onGUI()
+{
+    ImGui::SliderInt("lookahead", &lookahead, 0, (int)m_slots.size() - 2);
+    bool is_adaptive = adaptive;
+    if (ImGui::Checkbox("adaptive parallelism", &is_adaptive)) {
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            adaptive = is_adaptive;
+        }
+        apply_config();
+    }
+    ImGui::LabelText("workers", "%d/%d active", m_active_workers, (int)m_workers.size());
+    if (adaptive) {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_scheduler.onGUI();
+    }
+    if (m_writable) {
+        ImGui::LabelText("ring", "%d external buffers", (int)m_slots.size());
+    }
+    else {
+        ImGui::LabelText("ring", "%d x %.1f MB", (int)m_slots.size(), m_frame_bytes / 1024.0 / 1024.0);
+    }
+    ImGui::LabelText("direction", "%s %.1f frames/update", m_direction > 0 ? "forward" : "backward", m_velocity);
+
+    const int total = m_hits + m_misses;
+    ImGui::LabelText("hits", "%d", m_hits);
+    ImGui::LabelText("misses", "%d", m_misses);
+    ImGui::LabelText("hit rate", "%.1f%%", total > 0 ? 100.0 * m_hits / total : 0.0);
+    if (ImGui::Button("reset stats")) {
+        reset_stats();
+    }
+
+    // slot states
+    std::lock_guard<std::mutex> lock(m_mutex);
+    for (const auto& slot : m_slots)
+    {
+        ImVec4 color;
+        switch (slot.state) {
+        case SlotState::Empty: color = ImVec4(0.5, 0.5, 0.5, 1); break;
+        case SlotState::Queued: color = ImVec4(1, 1, 0, 1); break;
+        case SlotState::Decoding: color = ImVec4(1, 0, 0, 1); break;
+        case SlotState::Ready: color = ImVec4(0, 1, 0, 1); break;
+        case SlotState::InUse: color = ImVec4(0, 0.5, 1, 1); break;
+        }
+        ImGui::PushStyleColor(ImGuiCol_Text, color);
+        if (slot.state == SlotState::Empty) {
+            ImGui::Text("-");
+        }
+        else {
+            ImGui::Text("%d", slot.request.frame);
+        }
+        ImGui::PopStyleColor();
+        ImGui::SameLine();
+    }
+    ImGui::NewLine();
+}
@@ -0,0 +1,128 @@
+#pragma once
+
+#include <vector>
+#include <tuple>
+#include <deque>
+#include <memory>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <functional>
+
+#include "Readers/BaseSequenceReader.h"
+#include "DecodeScheduler.h"
+#include "FramePool.h"
+
+/// Read-ahead engine for sequence playback.
+/// Decodes the frames ahead of the playhead on worker threads into a ring of preallocated buffers.
+/// The GL thread takes ready frames with acquire/release, and never waits for a decode.
+class SequencePrefetcher
+{
+public:
+    enum class SlotState : int {
+        Empty,    // free to use
+        Queued,   // waiting for a worker
+        Decoding, // owned by a worker
+        Ready,    // decoded, can be acquired
+        InUse     // acquired by the GL thread
+    };
+
+    struct Slot {
+        SlotState state{ SlotState::Empty };
+        ReadRequest request;
+        std::tuple<int, int, int, int> bbox;
+        int level{ 0 }; // resolution level of bbox
+        FramePool::Buffer memory;
+        void* data{ NULL }; // decoded pixels, in memory the CPU reads back eg. to spill or analyse them
+        void* target{ NULL }; // external buffer the decoded pixels are copied to, NULL without external buffers
+        int index{ 0 }; // in the ring
+        bool stale{ false }; // invalidated while decoding or acquired, dropped instead of kept ready
+    };
+
+private:
+    BaseSequenceReader* m_reader;
+    int m_first_frame;
+    int m_last_frame;
+    size_t m_frame_bytes;
+
+    std::vector<Slot> m_slots;
+    std::deque<int> m_queue; // slot indices waiting to be decoded
+    std::vector<std::thread> m_workers;
+    std::mutex m_mutex;
+    std::condition_variable m_cv;
+    bool m_stop{ false };
+    int m_generation{ 0 }; // bumped on invalidate
+    int m_active_workers; // workers above this index are idle
+    std::function<bool(int slot)> m_writable; // external buffers only
+
+    DecodeScheduler m_scheduler;
+    int m_threads_per_frame{ 0 }; // applied to the reader
+    int m_pending_threads{ -1 }; // threads per frame to apply once no worker decodes, -1: none
+    int m_decoding{ 0 }; // workers inside read
+
+    // playhead
+    int m_last_frame_requested;
+    int m_direction{ 1 };
+    float m_velocity{ 1.0f }; // smoothed frames per update
+
+    // stats
+    ReadRequest m_last_acquired{ -1, -1, {} };
+    int m_hits{ 0 };
+    int m_misses{ 0 };
+
+    void worker_loop(int index);
+    void start(int workers);
+    /// workers: 0 for one per core, up to the frames the ring decodes ahead
+    static int worker_count(int workers, int slots);
+    void apply_config();
+    int wrap(int F) const;
+
+public:
+    int lookahead{ 6 }; // number of frames to decode ahead of the playhead
+    bool adaptive{ true }; // let the scheduler choose the concurrent frames and the threads per frame
+    /// frames found without decoding eg. in the disk cache, copied into the slot by a worker instead of decoded
+    /// return false to decode. Called on the worker threads
+    std::function<bool(const ReadRequest&, void* memory, std::tuple<int, int, int, int>* bbox, int* level)> load;
+    /// frames missing on disk are not scheduled, instead of failing a read on every update. Called on the GL thread
+    std::function<bool(int frame)> available;
+
+    /// frame_bytes: size of a single preallocated decode buffer
+    /// workers: frames decoded at most at once, the scheduler picks how many of them run. 0: one per core, up to the ring
+    SequencePrefetcher(BaseSequenceReader* reader, int first_frame, int last_frame, size_t frame_bytes, int ring_size = 8, int workers = 0);
+
+    /// fill buffers owned elsewhere eg. persistently mapped PBOs, one slot per buffer
+    /// a frame is decoded to pooled memory of frame_bytes, and copied to its buffer by the worker: the buffers are only ever written,
+    /// so they can be mapped write-only, and the pixels are read back from the decoded memory
+    /// writable(slot) is asked on the GL thread before a slot is decoded into again, and returns false while the GPU still reads it
+    SequencePrefetcher(BaseSequenceReader* reader, int first_frame, int last_frame, const std::vector<void*>& buffers, size_t frame_bytes, std::function<bool(int slot)> writable, int workers = 0);
+    ~SequencePrefetcher();
+
+    SequencePrefetcher(const SequencePrefetcher&) = delete;
+    SequencePrefetcher& operator=(const SequencePrefetcher&) = delete;
+
+    /// follow the playhead, and schedule frames ahead in the play direction
+    /// call once per GUI frame from the GL thread
+    void update(const ReadRequest& current);
+
+    /// take a decoded frame without blocking
+    /// return NULL when the frame is not ready (a miss). The caller should read it synchronously.
+    const Slot* acquire(const ReadRequest& request);
+
+    /// give back an acquired frame. The frame stays in the ring until its slot is reused.
+    void release(const Slot* slot);
+
+    /// drop every scheduled and decoded frame eg. when the sequence changed on disk
+    void invalidate();
+
+    /// drop a single frame eg. when it was rewritten on disk
+    void invalidate(int frame);
+
+    /// follow a sequence that grows on disk. Call from the GL thread.
+    void set_range(int first_frame, int last_frame);
+
+    int hits() const { return m_hits; }
+    int misses() const { return m_misses; }
+    void reset_stats() { m_hits = 0; m_misses = 0; }
+
+    void onGUI();
+};
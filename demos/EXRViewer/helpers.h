@@ -14,10 +14,13 @@
 #include <OpenExr/ImfMultiPartInputFile.h>
 #include <string>
 #include <OpenEXR/ImfPixelType.h>
+#include <OpenEXR/ImfCompression.h>
 #include <OpenEXR/half.h> // <half> type
 
 #include <vector>
 #include <array>
+#include <cstdint>
+#include <cassert>
 
 #include "glad/glad.h"
 
@@ -163,8 +166,39 @@ inline int pixelTypeSize(Imf::PixelType type)
     return size;
 }
 
+/// number of scanlines compressed together in a block
+inline int lines_per_block(Imf::Compression compression) {
+    switch (compression) {
+    case Imf::ZIP_COMPRESSION:
+    case Imf::PXR24_COMPRESSION:
+        return 16;
+    case Imf::PIZ_COMPRESSION:
+    case Imf::B44_COMPRESSION:
+    case Imf::B44A_COMPRESSION:
+    case Imf::DWAA_COMPRESSION:
+        return 32;
+    case Imf::DWAB_COMPRESSION:
+        return 256;
+    default: // NO, RLE, ZIPS
+        return 1;
+    }
+}
+
+/// FNV-1a, stable between runs unlike std::hash. For cache file names.
+inline uint64_t stable_hash(const std::string& text)
+{
+    uint64_t hash = 14695981039346656037ull;
+    for (unsigned char c : text) {
+        hash ^= c;
+        hash *= 1099511628211ull;
+    }
+    return hash;
+}
+
 inline std::string get_infostring(const Imf::MultiPartInputFile& in);
 
+std::string printCompression(Imf::Compression c);
+
 inline std::string to_string(Imf::PixelType pt)
 {
     switch (pt)
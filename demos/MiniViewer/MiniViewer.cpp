@@ -25,6 +25,7 @@
 #include "pathutils.h"
 #include "stringutils.h"
 #include "glhelpers.h"
+#include "FramePool.h"
 
 // OpenImageIO
 #include "OpenImageIO/imageio.h""
@@ -67,7 +68,7 @@ struct State {
     ChannelsTable _current_channels_df;
     std::vector<std::string> channels{}; // list of currently available channel names
     OIIO::ImageSpec spec;
-    GLuint tex{ 0 };
+    DisplayTexture tex; // reused between frames of the same display size
 };
 State state = State();
 
@@ -217,14 +218,14 @@ OIIO::ImageSpec get_spec(const std::filesystem::path& current_filename, const Ch
     return spec;
 }
 
-GLuint get_texture(const std::filesystem::path& current_filename, const ChannelsTable& current_channels_df)
+void update_texture(DisplayTexture* texture, const std::filesystem::path& current_filename, const ChannelsTable& current_channels_df)
 {
     ZoneScopedS(6);
     auto indices = get_index_column(current_channels_df);
     if (indices.size() > 4) {
         indices.erase(indices.begin()+ 4, indices.end());
     }
-    return make_texture_from_file(get_image_cache(), current_filename, indices);
+    update_texture_from_file(texture, get_image_cache(), current_filename, indices);
 }
 
 #pragma endregion GETTERS
@@ -256,8 +257,7 @@ void open(const std::filesystem::path& filepath, bool sequence=false)
         state._current_channels_df = get_current_chanels_df(state._channels_table, state.layers, state.current_layer, state.views, state.current_view);
         state.spec = get_spec(state._current_filename, state._current_channels_df);
         state.channels = get_channels(state._current_channels_df);
-        if (glIsTexture(state.tex)) glDeleteTextures(1, &state.tex);
-        state.tex = get_texture(state._current_filename, state._current_channels_df);
+        update_texture(&state.tex, state._current_filename, state._current_channels_df);
     }
 };
 
@@ -280,11 +280,7 @@ void on_frame_change()
     state._current_channels_df = get_current_chanels_df(state._channels_table, state.layers, state.current_layer, state.views, state.current_view);
     state.spec = get_spec(state._current_filename, state._current_channels_df);
     state.channels = get_channels(state._current_channels_df);
-    {
-        ZoneScopedN("delete texture");
-        if (glIsTexture(state.tex)) glDeleteTextures(1, &state.tex);
-    }
-    state.tex = get_texture(state._current_filename, state._current_channels_df);
+    update_texture(&state.tex, state._current_filename, state._current_channels_df);
 };
 
 void on_layer_change()
@@ -295,8 +291,7 @@ void on_layer_change()
     state._current_channels_df = get_current_chanels_df(state._channels_table, state.layers, state.current_layer, state.views, state.current_view);
     state.spec = get_spec(state._current_filename, state._current_channels_df);
     state.channels = get_channels(state._current_channels_df);
-    if (glIsTexture(state.tex)) glDeleteTextures(1, &state.tex);
-    state.tex = get_texture(state._current_filename, state._current_channels_df);
+    update_texture(&state.tex, state._current_filename, state._current_channels_df);
 };
 
 void on_view_change()
@@ -305,8 +300,7 @@ void on_view_change()
     state._current_channels_df = get_current_chanels_df(state._channels_table, state.layers, state.current_layer, state.views, state.current_view);
     state.spec = get_spec(state._current_filename, state._current_channels_df);
     state.channels = get_channels(state._current_channels_df);
-    if (glIsTexture(state.tex)) glDeleteTextures(1, &state.tex);
-    state.tex = get_texture(state._current_filename, state._current_channels_df);
+    update_texture(&state.tex, state._current_filename, state._current_channels_df);
 };
 #pragma endregion EVENT HANDLERS
 
@@ -847,8 +841,9 @@ void ShowViewer(bool *p_open)
                         {"gain_correction", gain},
                         {"gamma_correction", 1.0f/gamma},
                         {"convert_to_device", selected_device},
+                        {"sRGB_to_linear_input", state.spec.get_string_attribute("oiio:ColorSpace") != "Linear"},
                         });
-                    glBindTexture(GL_TEXTURE_2D, state.tex);
+                    glBindTexture(GL_TEXTURE_2D, state.tex.id);
                     glBindVertexArray(vao);
                     glDrawArrays(GL_TRIANGLE_STRIP, 0, 4);
                     glBindVertexArray(0);
@@ -6,6 +6,7 @@ uniform vec2 resolution;
 uniform float gamma_correction;
 uniform float gain_correction;
 uniform int convert_to_device; // 0:linear | 1:sRGB | 2:Rec709
+uniform bool sRGB_to_linear_input; // the texture holds the sRGB encoded values of the file eg. 8 bit images
 
 float sRGB_to_linear(float channel){
     return channel <= 0.04045
@@ -61,7 +62,7 @@ void main(){
     vec3 rawColor = texture(inputTexture, uv).rgb;
                 
     // apply corrections
-    vec3 color = rawColor;
+    vec3 color = sRGB_to_linear_input ? sRGB_to_linear(rawColor) : rawColor;
 
     // apply exposure correction
     color = color * pow(2, gain_correction);
@@ -1,5 +1,7 @@
 #pragma once
 
+#include "FramePool.h" // FramePool::Buffer
+
 //#include <../tracy/Tracy.hpp>
 
 #pragma region RenderToTexture
@@ -119,15 +121,12 @@ namespace ImGui {
 }
 
 /// <summary>
-/// 
+/// texture formats that keep the precision of the file: 8 and 16 bit normalized, half or float
 /// </summary>
 /// <returns>internalformat, format, type</returns>
 std::tuple<GLint, GLenum, GLenum> typespec_to_opengl(const OIIO::ImageSpec& spec, int nchannels)
 {
-    GLint glinternalformat; 
-    GLenum glformat;
     GLenum gltype;
-
     switch (spec.format.basetype) {
     case OIIO::TypeDesc::FLOAT: gltype = GL_FLOAT; break;
     case OIIO::TypeDesc::HALF: gltype = GL_HALF_FLOAT; break;
@@ -142,86 +141,60 @@ std::tuple<GLint, GLenum, GLenum> typespec_to_opengl(const OIIO::ImageSpec& spec
         break;
     }
 
-    bool issrgb = spec.get_string_attribute("oiio:ColorSpace") == "sRGB";
+    // one and two channels are uploaded as red and green, see texture_swizzle_mask for luminance and alpha
+    const std::vector<GLenum> glformats{ GL_RED, GL_RG, GL_RGB, GL_RGBA };
+    const std::vector<GLint> unorm8{ GL_R8, GL_RG8, GL_RGB8, GL_RGBA8 };
+    const std::vector<GLint> unorm16{ GL_R16, GL_RG16, GL_RGB16, GL_RGBA16 };
+    const std::vector<GLint> float16{ GL_R16F, GL_RG16F, GL_RGB16F, GL_RGBA16F };
+    const std::vector<GLint> float32{ GL_R32F, GL_RG32F, GL_RGB32F, GL_RGBA32F };
 
-    glinternalformat = nchannels;
-    if (nchannels == 1) {
-        glformat = GL_LUMINANCE;
-        if (spec.format.basetype == OIIO::TypeDesc::UINT8) {
-            glinternalformat = GL_R8;
-        }
-        else if (spec.format.basetype == OIIO::TypeDesc::UINT16) {
-            glinternalformat = GL_R16F;
-        }
-        else if (spec.format.basetype == OIIO::TypeDesc::FLOAT)
-        {
-            glinternalformat = GL_R32F;
-        }
-        else if (spec.format.basetype == OIIO::TypeDesc::HALF) {
-            glinternalformat = GL_R16F;
-        }
-    }
-    else if (nchannels == 2) {
-        glformat = GL_LUMINANCE_ALPHA;
-        if (spec.format.basetype == OIIO::TypeDesc::UINT8) {
-            
-            glinternalformat = GL_RG8;
-        }
-        else if (spec.format.basetype == OIIO::TypeDesc::UINT16) {
-            glinternalformat = GL_RG16F;
-        }
-        else if (spec.format.basetype == OIIO::TypeDesc::FLOAT)
-        {
-            glinternalformat = GL_RG32F;
-        }
-        else if (spec.format.basetype == OIIO::TypeDesc::HALF) {
-            glinternalformat = GL_RG16F;
-        }
-    }
-    else if (nchannels == 3) {
-        glformat = GL_RGB;
-        if (spec.format.basetype == OIIO::TypeDesc::UINT8) {
-            glinternalformat = GL_RGB8;
-        }
-        else if (spec.format.basetype == OIIO::TypeDesc::UINT16) {
-            glinternalformat = GL_RGB16;
-        }
-        else if (spec.format.basetype == OIIO::TypeDesc::FLOAT) {
-            glinternalformat = GL_RGB32F;
-        }
-        else if (spec.format.basetype == OIIO::TypeDesc::HALF) {
-            glinternalformat = GL_RGB16F;
-        }
-    }
-    else if (nchannels == 4) {
-        glformat = GL_RGBA;
-        if (spec.format.basetype == OIIO::TypeDesc::UINT8) {
-            glinternalformat = GL_RGBA8;
-        }
-        else if (spec.format.basetype == OIIO::TypeDesc::UINT16) {
-            glinternalformat = GL_RGBA16;
-        }
-        else if (spec.format.basetype == OIIO::TypeDesc::FLOAT) {
-            glinternalformat = GL_RGBA32F;
-        }
-        else if (spec.format.basetype == OIIO::TypeDesc::HALF) {
-            glinternalformat = GL_RGBA16F;
-        }
+    if (nchannels < 1 || nchannels > 4) {
+        return { GL_INVALID_ENUM, GL_INVALID_ENUM, gltype };
     }
-    else {
-        glformat = GL_INVALID_ENUM;
-        glinternalformat = GL_INVALID_ENUM;
+
+    GLint glinternalformat;
+    switch (spec.format.basetype) {
+    case OIIO::TypeDesc::UINT8: glinternalformat = unorm8[nchannels - 1]; break;
+    case OIIO::TypeDesc::UINT16: glinternalformat = unorm16[nchannels - 1]; break;
+    case OIIO::TypeDesc::HALF: glinternalformat = float16[nchannels - 1]; break;
+    default: glinternalformat = float32[nchannels - 1]; break; // float, and the integer types
     }
 
-    return { glinternalformat, glformat, gltype };
+    return { glinternalformat, glformats[nchannels - 1], gltype };
+}
+
+/// show one channel as grey, and two channels as luminance and alpha
+std::array<GLint, 4> texture_swizzle_mask(int nchannels)
+{
+    switch (nchannels) {
+    case 1: return { GL_RED, GL_RED, GL_RED, GL_ONE };
+    case 2: return { GL_RED, GL_RED, GL_RED, GL_GREEN };
+    case 3: return { GL_RED, GL_GREEN, GL_BLUE, GL_ONE };
+    default: return { GL_RED, GL_GREEN, GL_BLUE, GL_ALPHA };
+    }
 }
 
-GLuint make_texture_from_file(OIIO::ImageCache* image_cache, const std::filesystem::path& filename, const std::vector<ChannelKey>& channel_keys = {})
+/// the display window texture of the current image, reused while the display size and format stay the same
+/// the texture keeps the precision of the file eg. RGBA8 for 8 bit images, and RGBA16F for halves
+struct DisplayTexture
+{
+    GLuint id{ 0 };
+    int width{ 0 };
+    int height{ 0 };
+    GLint internalformat{ 0 };
+};
+
+/// read the channels of a file, and place the data window in the display window texture
+/// the texture is allocated only when the display size changes, and the pixels outside the data window are black.
+/// sRGB encoded files are converted to linear by the display shader, see display_correction.frag
+bool update_texture_from_file(DisplayTexture* texture, OIIO::ImageCache* image_cache, const std::filesystem::path& filename, const std::vector<ChannelKey>& channel_keys = {})
 {
     ZoneScoped;
     /// Validate parameters
-    if (!std::filesystem::exists(filename)) return 0;
-    if (channel_keys.empty()) return 0;
+    if (!std::filesystem::exists(filename) || channel_keys.empty()) {
+        if (texture->id) glClearTexImage(texture->id, 0, GL_RGBA, GL_FLOAT, NULL);
+        return false;
+    }
     assert(("cant create a texture from more than 4 channels", channel_keys.size() <= 4));
 
     /// Read header
@@ -239,130 +212,71 @@ GLuint make_texture_from_file(OIIO::ImageCache* image_cache, const std::filesyst
     int nchannels = chend - chbegin;
 
     /// Allocate and read pixels
-    void* data;
+    FramePool::Buffer buffer;
     {
         ZoneScopedN("Allocate");
         auto type_size = spec.format.size();
-        data = malloc(w * h * nchannels * type_size);
+        buffer = FramePool::global().acquire((size_t)w * h * nchannels * type_size);
     }
+    void* data = buffer.get();
 
     {
         ZoneScopedN("Read pixels");
         image_cache->get_pixels(OIIO::ustring(filename.string()), std::get<0>(channel_keys[0]), 0, x, x + w, y, y + h, 0, 1, chbegin, chend, spec.format, data, OIIO::AutoStride, OIIO::AutoStride, OIIO::AutoStride, chbegin, chend);
     }
 
-    /// Create texture for ROI
-    GLuint tex_roi;
+    /// Allocate the display window texture, when the display size or the format changes
+    auto [internalformat, format, type] = typespec_to_opengl(spec, nchannels);
+    if (internalformat == GL_INVALID_ENUM) return false;
+    if (!texture->id || texture->width != spec.full_width || texture->height != spec.full_height || texture->internalformat != internalformat)
     {
-        ZoneScopedN("Upload image to GPU")
-        glGenTextures(1, &tex_roi);
-        glBindTexture(GL_TEXTURE_2D, tex_roi);
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_BORDER);
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_BORDER);
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
-
-        auto [internalformat, format, type] = typespec_to_opengl(spec, nchannels);
-        glTexImage2D(GL_TEXTURE_2D, 0, internalformat, spec.width, spec.height, 0, format, type, data);
+        ZoneScopedN("Allocate display texture");
+        if (texture->id) glDeleteTextures(1, &texture->id);
+        texture->id = imdraw::make_texture_float(spec.full_width, spec.full_height, NULL, internalformat, format, type, GL_LINEAR, GL_NEAREST, GL_CLAMP_TO_BORDER, GL_CLAMP_TO_BORDER);
+        texture->width = spec.full_width;
+        texture->height = spec.full_height;
+        texture->internalformat = internalformat;
+
+        // the shader reads rgba, whatever the channels of the file
+        const auto swizzle_mask = texture_swizzle_mask(nchannels);
+        glBindTexture(GL_TEXTURE_2D, texture->id);
+        glTexParameteriv(GL_TEXTURE_2D, GL_TEXTURE_SWIZZLE_RGBA, swizzle_mask.data());
         glBindTexture(GL_TEXTURE_2D, 0);
     }
 
-    // Deallocate data after uploaded to GPU
+    /// Upload the data window at its offset in the display window
+    // the data window can be smaller eg. a cropped render, or larger eg. overscan. only the overlap is uploaded
     {
-        ZoneScopedN("Deallocate data");
-        free(data);
-    }
+        ZoneScopedN("Upload image to GPU");
+        const int x0 = std::max(spec.x, spec.full_x);
+        const int y0 = std::max(spec.y, spec.full_y);
+        const int x1 = std::min(spec.x + spec.width, spec.full_x + spec.full_width);
+        const int y1 = std::min(spec.y + spec.height, spec.full_y + spec.full_height);
+        const bool covers_display = x0 == spec.full_x && y0 == spec.full_y && x1 == spec.full_x + spec.full_width && y1 == spec.full_y + spec.full_height;
+        if (!covers_display) {
+            glClearTexImage(texture->id, 0, GL_RGBA, GL_FLOAT, NULL); // black outside the data window
+        }
 
-    /// Render ROI texture to full display window
-    GLuint tex_full;
-    {
-        ZoneScopedN("Create full texture");
-        tex_full = imdraw::make_texture_float(spec.full_width, spec.full_height, NULL, GL_RGBA32F);
-        GLuint fbo_full = imdraw::make_fbo(tex_full);
-        BeginRenderToTexture(fbo_full, spec.full_x, spec.full_y, spec.full_width, spec.full_height);
+        if (x1 > x0 && y1 > y0)
         {
-            glClearColor(0, 0, 0, 0);
-            glClear(GL_COLOR_BUFFER_BIT);
-            static GLuint prog = imdraw::make_program_from_source(R"(
-                #version 330 core
-                layout (location = 0) in vec3 aPos;
-                void main()
-                {
-                    gl_Position = vec4(aPos, 1.0);
-                }
-            )",
-                R"(
-                #version 330 core
-                uniform sampler2D textureMap;
-
-                uniform ivec2 uPos;
-                uniform ivec2 uSize;
-                uniform ivec2 uFullSize;
-                uniform bool use_sRGB_to_linear_conversion;
-
-                float sRGB_to_linear(float sRGB_value){
-                    return sRGB_value <= 0.04045
-                        ? sRGB_value / 12.92
-                        : pow((sRGB_value + 0.055) / 1.055, 2.4);
-                }
-
-                vec3 sRGB_to_linear(vec3 sRGB){
-                    return vec3(
-                        sRGB_to_linear(sRGB.r),
-                        sRGB_to_linear(sRGB.g),
-                        sRGB_to_linear(sRGB.b)
-                        );
-                }
-
-                void main()
-                {
-                    vec2 uv = (gl_FragCoord.xy-uPos)/uSize;
-                    vec3 raw_color = texture(textureMap, uv).rgb;
-                    float alpha = texture(textureMap, uv).a;
-                    vec3 color;
-                    if(use_sRGB_to_linear_conversion)
-                    {
-                        color = sRGB_to_linear(raw_color);
-                    }else{
-                        color = raw_color;
-                    }
-                
-                    gl_FragColor = vec4(color,alpha);
-                }
-            )");
-
-            static auto geo = imgeo::quad();
-            static auto vao = imdraw::make_vao(prog, {
-                {"aPos", {imdraw::make_vbo(geo.positions), 3}},
-                });
-
-            bool use_sRGB_to_linear_conversion = spec.get_string_attribute("oiio:ColorSpace") != "Linear";
-            //std::cout << "make_texture_from_file" << "\n";
-            //std::cout << "  colorspace: " << spec.get_string_attribute("oiio:ColorSpace").c_str() << "\n";
-            //std::cout << "  use_sRGB_to_linear_conversion: " << use_sRGB_to_linear_conversion << "\n";
-
-            imdraw::push_program(prog);
-            imdraw::set_uniforms(prog,
-                {
-                {"uPos", glm::ivec2(spec.x, spec.y)},
-                {"uSize", glm::ivec2(spec.width, spec.height)},
-                {"uFullSize", glm::ivec2(spec.full_width,spec.full_height) },
-                {"use_sRGB_to_linear_conversion", use_sRGB_to_linear_conversion}
-                });
-
-            // draw
-            ZoneNamedN(DRAW_ROI_ON_FULL, "Draw ROI texture to full", true);
-            glBindTexture(GL_TEXTURE_2D, tex_roi);
-            imdraw::draw(geo.mode, vao, imdraw::make_ebo(geo.indices), geo.indices.size());
+            glBindTexture(GL_TEXTURE_2D, texture->id);
+            glPixelStorei(GL_UNPACK_ALIGNMENT, 1); // rows of 8 bit rgb pixels are not 4 byte aligned
+            glPixelStorei(GL_UNPACK_ROW_LENGTH, spec.width);
+            glPixelStorei(GL_UNPACK_SKIP_PIXELS, x0 - spec.x);
+            glPixelStorei(GL_UNPACK_SKIP_ROWS, y0 - spec.y);
+            glTexSubImage2D(GL_TEXTURE_2D, 0, x0 - spec.full_x, y0 - spec.full_y, x1 - x0, y1 - y0, format, type, data);
+            glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+            glPixelStorei(GL_UNPACK_ROW_LENGTH, 0);
+            glPixelStorei(GL_UNPACK_SKIP_PIXELS, 0);
+            glPixelStorei(GL_UNPACK_SKIP_ROWS, 0);
             glBindTexture(GL_TEXTURE_2D, 0);
-            imdraw::pop_program();
         }
-        EndRenderToTexture();
+    }
 
-        // Delete temporary FBO and tetures
-        glDeleteFramebuffers(1, &fbo_full);
-        glDeleteTextures(1, &tex_roi);
+    // Return the buffer to the pool after uploaded to GPU, the next file reuses it
+    {
+        ZoneScopedN("Deallocate data");
+        buffer.reset();
     }
-    /// Return final texture
-    return tex_full;
+    return true;
 }
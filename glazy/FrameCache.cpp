@@ -0,0 +1,518 @@
+#include "FrameCache.h"
+
+#include <algorithm>
+#include <fstream>
+#include <string>
+#include <limits>
+#include <future>
+#include <deque>
+#include <mutex>
+#include <condition_variable>
+#include <functional>
+#include <cstring>
+#include <stdexcept>
+
+#include <zlib.h>
+
+#ifdef _WIN32
+#define NOMINMAX
+#include <windows.h>
+#endif
+
+/// persistent threads deflating and inflating the chunks of frames, instead of a thread per chunk
+class ChunkPool
+{
+private:
+    std::mutex m_mutex;
+    std::condition_variable m_cv;
+    std::deque<std::packaged_task<void()>> m_tasks;
+    std::vector<std::thread> m_threads;
+    bool m_stop{ false };
+
+public:
+    ChunkPool(int threads)
+    {
+        for (auto i = 0; i < threads; i++) {
+            m_threads.emplace_back([this]() {
+                while (true)
+                {
+                    std::unique_lock<std::mutex> lock(m_mutex);
+                    m_cv.wait(lock, [&] { return m_stop || !m_tasks.empty(); });
+                    if (m_stop && m_tasks.empty()) return;
+                    auto task = std::move(m_tasks.front());
+                    m_tasks.pop_front();
+                    lock.unlock();
+                    task(); // exceptions go to the future
+                }
+            });
+        }
+    }
+
+    ~ChunkPool()
+    {
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            m_stop = true;
+        }
+        m_cv.notify_all();
+        for (auto& thread : m_threads) thread.join();
+    }
+
+    std::future<void> submit(std::function<void()> fn)
+    {
+        std::packaged_task<void()> task(std::move(fn));
+        auto result = task.get_future();
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            m_tasks.push_back(std::move(task));
+        }
+        m_cv.notify_one();
+        return result;
+    }
+
+    static ChunkPool& global()
+    {
+        static ChunkPool pool(std::max(1, (int)std::thread::hardware_concurrency()));
+        return pool;
+    }
+};
+
+/// wait for every task, before rethrowing the first exception: the others may still use the frame
+static void wait_all(std::vector<std::future<void>>& tasks)
+{
+    for (auto& task : tasks) task.wait();
+    for (auto& task : tasks) task.get();
+}
+
+FrameCache::FrameCache(size_t budget) : m_budget(budget), m_limit(budget)
+{
+}
+
+FrameCache::~FrameCache()
+{
+    for (auto& [F, compression] : m_compressing) {
+        for (auto& task : compression->tasks) task.wait();
+    }
+}
+
+void FrameCache::set_budget(size_t bytes)
+{
+    m_budget = bytes;
+    m_limit = bytes;
+    evict(0);
+}
+
+void FrameCache::set_compressed_budget(size_t bytes)
+{
+    m_compressed_budget = bytes;
+    m_compressed_limit = bytes;
+    evict_compressed(0);
+}
+
+double FrameCache::compression_ratio() const
+{
+    size_t raw = 0;
+    for (const auto& [F, compressed] : m_compressed) {
+        raw += compressed.raw_bytes;
+    }
+    return m_compressed_used > 0 ? (double)raw / m_compressed_used : 0.0;
+}
+
+void FrameCache::set_playback(int playhead, int direction, int first_frame, int last_frame)
+{
+    m_playhead = playhead;
+    m_direction = direction < 0 ? -1 : 1;
+    m_first_frame = first_frame;
+    m_last_frame = std::max(first_frame, last_frame);
+}
+
+long long FrameCache::distance(int F) const
+{
+    if (F < m_first_frame || F > m_last_frame) return std::numeric_limits<long long>::max();
+    long long length = (long long)m_last_frame - m_first_frame + 1;
+    long long ahead = ((long long)F - m_playhead) * m_direction;
+    return (ahead % length + length) % length;
+}
+
+void FrameCache::evict(size_t required)
+{
+    while (!m_frames.empty() && m_used + required > m_limit)
+    {
+        auto victim = std::max_element(m_frames.begin(), m_frames.end(), [&](const auto& a, const auto& b) {
+            return distance(a.first) < distance(b.first);
+        });
+
+        // demote to the compressed tier, unless it is already there or would be evicted right away
+        int F = victim->first;
+        bool keep = m_compressed_budget > 0 && !m_compressed.contains(F) && distance(F) != std::numeric_limits<long long>::max();
+        m_used -= victim->second.bytes;
+        if (keep) {
+            // the pool deflates the frame while the caller goes on, unless it is too far behind
+            collect_compressed();
+            while (!m_compressing.empty() && (int)m_compressing.size() >= std::max(1, max_compressing)) {
+                finish_compression(m_compressing.begin());
+            }
+
+            auto compression = std::make_unique<Compression>();
+            compression->start = std::chrono::steady_clock::now();
+            compression->frame = std::move(victim->second);
+            start_compress(compression->frame, threads, &compression->compressed, &compression->tasks);
+            m_compressing[F] = std::move(compression);
+        }
+        m_frames.erase(victim);
+    }
+}
+
+FrameCache::Frame FrameCache::finish_compression(std::map<int, std::unique_ptr<Compression>>::iterator it)
+{
+    const int F = it->first;
+    auto compression = std::move(it->second);
+    m_compressing.erase(it);
+
+    try {
+        wait_all(compression->tasks);
+    }
+    catch (const std::exception&) {
+        return std::move(compression->frame); // not compressed, dropped like any evicted frame
+    }
+    auto& compressed = compression->compressed;
+    for (const auto& chunk : compressed.chunks) {
+        compressed.bytes += chunk.size();
+    }
+    m_compress_seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - compression->start).count();
+
+    evict_compressed(compressed.bytes, distance(F));
+    if (m_compressed_used + compressed.bytes <= m_compressed_limit) {
+        m_compressed_used += compressed.bytes;
+        m_compressed[F] = std::move(compressed);
+    }
+    return std::move(compression->frame);
+}
+
+void FrameCache::collect_compressed(bool wait)
+{
+    for (auto it = m_compressing.begin(); it != m_compressing.end();)
+    {
+        auto next = std::next(it);
+        const bool done = std::all_of(it->second->tasks.begin(), it->second->tasks.end(), [](const auto& task) {
+            return task.wait_for(std::chrono::seconds(0)) == std::future_status::ready;
+        });
+        if (wait || done) finish_compression(it);
+        it = next;
+    }
+}
+
+void FrameCache::evict_compressed(size_t required, long long keep_distance)
+{
+    while (!m_compressed.empty() && m_compressed_used + required > m_compressed_limit)
+    {
+        auto victim = std::max_element(m_compressed.begin(), m_compressed.end(), [&](const auto& a, const auto& b) {
+            return distance(a.first) < distance(b.first);
+        });
+        if (keep_distance >= 0 && distance(victim->first) <= keep_distance) return;
+        m_compressed_used -= victim->second.bytes;
+        m_compressed.erase(victim);
+    }
+}
+
+const FrameCache::Frame* FrameCache::get(int F)
+{
+    if (auto it = m_frames.find(F); it != m_frames.end()) {
+        return &it->second;
+    }
+
+    collect_compressed();
+    if (auto it = m_compressing.find(F); it != m_compressing.end()) {
+        // evicted a moment ago: keep the compressed copy, and take the frame back
+        auto frame = finish_compression(it);
+        evict(frame.bytes);
+        m_used += frame.bytes;
+        return &(m_frames[F] = std::move(frame));
+    }
+
+    /// promote from the compressed tier, the compressed copy is kept for the next loop
+    auto it = m_compressed.find(F);
+    if (it == m_compressed.end()) return NULL;
+
+    auto start = std::chrono::steady_clock::now();
+    auto frame = decompress(it->second, threads);
+    m_decompress_seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+    evict(frame.bytes);
+    m_used += frame.bytes;
+    return &(m_frames[F] = std::move(frame));
+}
+
+FrameCache::Frame FrameCache::make_frame(int width, int height, int channels, size_t pixel_bytes)
+{
+    Frame frame;
+    frame.bytes = (size_t)width * height * channels * pixel_bytes;
+    frame.pixels = FramePool::global().acquire(frame.bytes);
+    frame.width = width;
+    frame.height = height;
+    frame.channels = channels;
+    return frame;
+}
+
+const FrameCache::Frame* FrameCache::insert(int F, Frame&& frame)
+{
+    if (auto it = m_frames.find(F); it != m_frames.end()) {
+        m_used -= it->second.bytes;
+        m_frames.erase(it);
+    }
+    if (auto it = m_compressing.find(F); it != m_compressing.end()) { // stale
+        finish_compression(it);
+    }
+    if (auto it = m_compressed.find(F); it != m_compressed.end()) { // stale
+        m_compressed_used -= it->second.bytes;
+        m_compressed.erase(it);
+    }
+
+    collect_compressed();
+    update_memory_pressure();
+    evict(frame.bytes);
+
+    m_used += frame.bytes;
+    return &(m_frames[F] = std::move(frame));
+}
+
+void FrameCache::clear()
+{
+    collect_compressed(true);
+    m_frames.clear();
+    m_used = 0;
+    m_compressed.clear();
+    m_compressed_used = 0;
+}
+
+std::vector<int> FrameCache::frames() const
+{
+    std::vector<int> frames;
+    for (const auto& [F, frame] : m_frames) {
+        frames.push_back(F);
+    }
+    for (const auto& [F, compressed] : m_compressed) {
+        if (!m_frames.contains(F)) frames.push_back(F);
+    }
+    for (const auto& [F, compression] : m_compressing) {
+        frames.push_back(F); // in no tier yet
+    }
+    std::sort(frames.begin(), frames.end());
+    return frames;
+}
+
+/// deflate at the fastest level. Run length matching suits byte planes, and raw streams skip the checksum.
+/// deflated into a pooled buffer, so dest is allocated once at its final size
+static size_t deflate_fast(const char* src, size_t size, std::vector<char>* dest)
+{
+    z_stream zs{};
+    if (deflateInit2(&zs, Z_BEST_SPEED, Z_DEFLATED, -15, 8, Z_RLE) != Z_OK) {
+        throw std::runtime_error("cannot compress frame");
+    }
+    auto scratch = FramePool::global().acquire(deflateBound(&zs, (uLong)size));
+    zs.next_in = (Bytef*)src;
+    zs.avail_in = (uInt)size;
+    zs.next_out = (Bytef*)scratch.get();
+    zs.avail_out = (uInt)scratch.size();
+    int result = deflate(&zs, Z_FINISH);
+    deflateEnd(&zs);
+    if (result != Z_STREAM_END) throw std::runtime_error("cannot compress frame");
+    dest->assign(scratch.get(), scratch.get() + zs.total_out);
+    return dest->size();
+}
+
+static void inflate_raw(const std::vector<char>& src, char* dest, size_t size)
+{
+    z_stream zs{};
+    if (inflateInit2(&zs, -15) != Z_OK) {
+        throw std::runtime_error("cannot decompress frame");
+    }
+    zs.next_in = (Bytef*)src.data();
+    zs.avail_in = (uInt)src.size();
+    zs.next_out = (Bytef*)dest;
+    zs.avail_out = (uInt)size;
+    int result = inflate(&zs, Z_FINISH);
+    bool complete = zs.total_out == size;
+    inflateEnd(&zs);
+    if (result != Z_STREAM_END || !complete) throw std::runtime_error("cannot decompress frame");
+}
+
+/// element size of a frame eg. 2 for half
+static size_t element_bytes(int width, int height, int channels, size_t bytes)
+{
+    size_t elements = (size_t)width * height * channels;
+    return elements > 0 ? bytes / elements : 1;
+}
+
+void FrameCache::start_compress(const Frame& frame, int chunks, CompressedFrame* compressed, std::vector<std::future<void>>* tasks)
+{
+    compressed->raw_bytes = frame.bytes;
+    compressed->width = frame.width;
+    compressed->height = frame.height;
+    compressed->channels = frame.channels;
+
+    const size_t element = element_bytes(frame.width, frame.height, frame.channels, frame.bytes);
+    const size_t row_bytes = (size_t)frame.width * frame.channels * element;
+    chunks = std::clamp(chunks, 1, std::max(1, frame.height));
+
+    for (auto i = 0; i <= chunks; i++) {
+        compressed->chunk_rows.push_back((int)((long long)frame.height * i / chunks));
+    }
+    compressed->chunks.resize(chunks);
+
+    for (auto i = 0; i < chunks; i++)
+    {
+        tasks->push_back(ChunkPool::global().submit([&frame, compressed, element, row_bytes, i]() {
+            const char* src = frame.pixels.get() + compressed->chunk_rows[i] * row_bytes;
+            const size_t size = (compressed->chunk_rows[i + 1] - compressed->chunk_rows[i]) * row_bytes;
+            const size_t count = size / element;
+
+            // split into byte planes: byte b of every element is stored together
+            auto planes = FramePool::global().acquire(size);
+            for (size_t b = 0; b < element; b++) {
+                char* plane = planes.get() + b * count;
+                for (size_t e = 0; e < count; e++) {
+                    plane[e] = src[e * element + b];
+                }
+            }
+
+            deflate_fast(planes.get(), size, &compressed->chunks[i]);
+        }));
+    }
+}
+
+FrameCache::CompressedFrame FrameCache::compress(const Frame& frame, int threads)
+{
+    CompressedFrame compressed;
+    std::vector<std::future<void>> tasks;
+    start_compress(frame, threads, &compressed, &tasks);
+    wait_all(tasks); // rethrows
+
+    for (const auto& chunk : compressed.chunks) {
+        compressed.bytes += chunk.size();
+    }
+    return compressed;
+}
+
+FrameCache::Frame FrameCache::decompress(const CompressedFrame& compressed, int threads)
+{
+    Frame frame;
+    frame.bytes = compressed.raw_bytes;
+    frame.pixels = FramePool::global().acquire(frame.bytes);
+    frame.width = compressed.width;
+    frame.height = compressed.height;
+    frame.channels = compressed.channels;
+
+    const size_t element = element_bytes(frame.width, frame.height, frame.channels, frame.bytes);
+    const size_t row_bytes = (size_t)frame.width * frame.channels * element;
+
+    // chunks are independent, each task decodes every threads-th chunk
+    const int chunks = (int)compressed.chunks.size();
+    const int task_count = std::clamp(threads, 1, std::max(1, chunks));
+    std::vector<std::future<void>> tasks;
+    for (auto t = 0; t < task_count; t++)
+    {
+        tasks.push_back(ChunkPool::global().submit([&, t]() {
+            FramePool::Buffer planes;
+            for (auto i = t; i < chunks; i += task_count)
+            {
+                char* dst = frame.pixels.get() + compressed.chunk_rows[i] * row_bytes;
+                const size_t size = (compressed.chunk_rows[i + 1] - compressed.chunk_rows[i]) * row_bytes;
+                const size_t count = size / element;
+
+                if (planes.capacity() < size) {
+                    planes.reset();
+                    planes = FramePool::global().acquire(size);
+                }
+                inflate_raw(compressed.chunks[i], planes.get(), size);
+
+                // interleave the byte planes
+                for (size_t b = 0; b < element; b++) {
+                    const char* plane = planes.get() + b * count;
+                    for (size_t e = 0; e < count; e++) {
+                        dst[e * element + b] = plane[e];
+                    }
+                }
+            }
+        }));
+    }
+    wait_all(tasks); // rethrows
+
+    return frame;
+}
+
+void FrameCache::update_memory_pressure()
+{
+    auto now = std::chrono::steady_clock::now();
+    if (now - m_last_pressure_check < std::chrono::milliseconds(250)) return;
+    m_last_pressure_check = now;
+
+    size_t available = memory_available();
+    if (available >= headroom)
+    {
+        // frames already cached count as available, the uncompressed tier gets the room first
+        size_t room = available - headroom;
+        size_t hot_room = std::min(room, m_budget > m_used ? m_budget - m_used : 0);
+        m_limit = std::min(m_budget, m_used + hot_room);
+        m_compressed_limit = std::min(m_compressed_budget, m_compressed_used + (room - hot_room));
+    }
+    else
+    {
+        // give back the shortfall, the compressed frames are further from the playhead and go first
+        size_t shortfall = headroom - available;
+        size_t compressed_shortfall = std::min(shortfall, m_compressed_used);
+        m_compressed_limit = std::min(m_compressed_budget, m_compressed_used - compressed_shortfall);
+        shortfall -= compressed_shortfall;
+        m_limit = std::min(m_budget, m_used > shortfall ? m_used - shortfall : 0);
+    }
+    evict(0);
+    evict_compressed(0);
+
+    // evicted frames would stay in the pool for reuse, give them back to the system
+    if (available <= headroom) FramePool::global().trim();
+}
+
+/// read a single value from a /proc or /sys file, 0 when it is missing
+static size_t read_number(const std::string& path, const std::string& key = "")
+{
+    std::ifstream file(path);
+    std::string token;
+    while (file >> token) {
+        if (!key.empty() && token != key) continue;
+        if (!key.empty()) file >> token;
+        if (token == "max") return 0; // cgroup without a limit
+        try {
+            return std::stoull(token);
+        }
+        catch (const std::exception&) {
+            return 0;
+        }
+    }
+    return 0;
+}
+
+size_t available_memory()
+{
+#ifdef _WIN32
+    MEMORYSTATUSEX status;
+    status.dwLength = sizeof(status);
+    if (!GlobalMemoryStatusEx(&status)) return std::numeric_limits<size_t>::max();
+    return (size_t)status.ullAvailPhys;
+#else
+    size_t available = read_number("/proc/meminfo", "MemAvailable:") * 1024; // kB
+    if (available == 0) available = std::numeric_limits<size_t>::max();
+
+    // cgroup v2, then v1
+    size_t limit = read_number("/sys/fs/cgroup/memory.max");
+    size_t usage = read_number("/sys/fs/cgroup/memory.current");
+    if (limit == 0) {
+        limit = read_number("/sys/fs/cgroup/memory/memory.limit_in_bytes");
+        usage = read_number("/sys/fs/cgroup/memory/memory.usage_in_bytes");
+    }
+    // v1 reports a huge number when there is no limit
+    if (limit > 0 && limit < (size_t(1) << 60)) {
+        available = std::min(available, limit > usage ? limit - usage : 0);
+    }
+    return available;
+#endif
+}
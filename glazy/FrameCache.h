@@ -0,0 +1,160 @@
+#pragma once
+#include <map>
+#include <memory>
+#include <vector>
+#include <chrono>
+#include <thread>
+#include <future>
+#include <functional>
+
+#include "FramePool.h"
+
+/*
+bytes of memory the process can still allocate without swapping
+the minimum of the system available memory (/proc/meminfo MemAvailable, GlobalMemoryStatusEx on windows)
+and the room left under the cgroup memory limit, when there is one
+*/
+size_t available_memory();
+
+/*
+Decoded frames of a sequence in memory, within a byte budget.
+
+When the budget is exceeded, frames are evicted by how far ahead of the playhead they are in the play
+direction, wrapping around the loop range. The frames just played are dropped first, and the frames about
+to be played are kept. Frames outside of the loop range go before any of them.
+
+An optional second tier keeps evicted frames losslessly compressed. Each frame is split into byte planes
+(the high bytes of half floats compress well, the low bytes are mostly noise) and deflated at the fastest
+level, in row chunks on a persistent pool of threads. The uncompressed tier in front of it can then be kept small.
+Evicted frames are deflated in the background, the caller only waits when more than max_compressing frames
+are in flight, or when it asks for a frame that is still being compressed.
+
+The budget shrinks when the system runs low on memory, see available_memory().
+Not thread safe, use from a single thread.
+*/
+class FrameCache
+{
+public:
+    struct Frame {
+        FramePool::Buffer pixels;
+        size_t bytes{ 0 };
+        int width{ 0 };
+        int height{ 0 };
+        int channels{ 0 };
+    };
+
+    struct CompressedFrame {
+        std::vector<std::vector<char>> chunks; // byte planes of a range of rows, deflated
+        std::vector<int> chunk_rows; // first row of each chunk, and the height at the end
+        size_t bytes{ 0 }; // compressed size
+        size_t raw_bytes{ 0 };
+        int width{ 0 };
+        int height{ 0 };
+        int channels{ 0 };
+    };
+
+private:
+    std::map<int, Frame> m_frames;
+    size_t m_budget;
+    size_t m_used{ 0 };
+    size_t m_limit; // budget, lowered by memory pressure
+
+    // compressed tier, a frame may be in both tiers
+    std::map<int, CompressedFrame> m_compressed;
+
+    /// an evicted frame, deflated on the chunk pool
+    struct Compression {
+        Frame frame; // read by the tasks until they finish
+        CompressedFrame compressed;
+        std::vector<std::future<void>> tasks;
+        std::chrono::steady_clock::time_point start;
+    };
+    std::map<int, std::unique_ptr<Compression>> m_compressing; // not in any tier yet, but cached
+    size_t m_compressed_budget{ 0 }; // 0: disabled
+    size_t m_compressed_used{ 0 };
+    size_t m_compressed_limit{ 0 };
+    double m_compress_seconds{ 0 }; // last frame
+    double m_decompress_seconds{ 0 }; // last frame
+
+    // playback
+    int m_playhead{ 0 };
+    int m_direction{ 1 };
+    int m_first_frame{ 0 };
+    int m_last_frame{ 0 };
+
+    std::chrono::steady_clock::time_point m_last_pressure_check;
+
+    /// frames ahead of the playhead in the play direction, larger is evicted sooner
+    long long distance(int F) const;
+    void evict(size_t required);
+    /// keep_distance: only evict frames further than this, -1 to evict any
+    void evict_compressed(size_t required, long long keep_distance = -1);
+
+    /// wait for a compression, add it to the compressed tier when it fits, and return its frame
+    Frame finish_compression(std::map<int, std::unique_ptr<Compression>>::iterator it);
+    /// finish the compressions that are done, or all of them
+    void collect_compressed(bool wait = false);
+
+    /// split frame into chunks of rows, and deflate them on the chunk pool into compressed
+    static void start_compress(const Frame& frame, int chunks, CompressedFrame* compressed, std::vector<std::future<void>>* tasks);
+
+public:
+    size_t headroom{ size_t(512) * 1024 * 1024 }; // memory left to the system under pressure
+    std::function<size_t()> memory_available{ available_memory }; // asked by update_memory_pressure, replaced eg. by tests
+    int threads{ (int)std::thread::hardware_concurrency() }; // chunks of a compressed frame, and threads to decompress it
+    int max_compressing{ 4 }; // frames compressed in the background
+
+    FrameCache(size_t budget);
+    ~FrameCache(); // waits for the background compressions
+
+    FrameCache(const FrameCache&) = delete;
+    FrameCache& operator=(const FrameCache&) = delete;
+
+    void set_budget(size_t bytes);
+    size_t budget() const { return m_budget; }
+    size_t limit() const { return m_limit; }
+    size_t used() const { return m_used; }
+    size_t size() const { return m_frames.size(); }
+
+    /// enable the compressed tier with a non zero budget
+    void set_compressed_budget(size_t bytes);
+    size_t compressed_budget() const { return m_compressed_budget; }
+    size_t compressed_limit() const { return m_compressed_limit; }
+    size_t compressed_used() const { return m_compressed_used; }
+    size_t compressed_size() const { return m_compressed.size(); }
+    size_t compressing() const { return m_compressing.size(); }
+    double compression_ratio() const;
+    double compress_seconds() const { return m_compress_seconds; } // from eviction to the compressed tier
+    double decompress_seconds() const { return m_decompress_seconds; }
+
+    /// the playhead, play direction (1 or -1) and loop range
+    void set_playback(int playhead, int direction, int first_frame, int last_frame);
+
+    bool contains(int F) const { return m_frames.contains(F) || m_compressed.contains(F) || m_compressing.contains(F); }
+
+    /// return NULL when the frame is not cached
+    /// a compressed frame is decompressed into the uncompressed tier
+    /// the frame stays valid until the next get, insert or clear
+    const Frame* get(int F);
+
+    /// allocate a frame to decode into from FramePool::global(). Insert it when decoded.
+    static Frame make_frame(int width, int height, int channels, size_t pixel_bytes);
+
+    /// take ownership of a decoded frame, evict frames to make room for it
+    const Frame* insert(int F, Frame&& frame);
+
+    void clear();
+
+    /// cached frame numbers in ascending order, in any tier
+    std::vector<int> frames() const;
+
+    /// lossless, threads: number of row chunks compressed in parallel
+    static CompressedFrame compress(const Frame& frame, int threads);
+    /// threads: at most this many chunks are inflated in parallel
+    static Frame decompress(const CompressedFrame& compressed, int threads);
+
+    /// shrink the limit to the memory available to the process, and evict to fit
+    /// when less than headroom is available, the cache gives back the difference
+    /// checks at most a few times per second
+    void update_memory_pressure();
+};
@@ -0,0 +1,201 @@
+#include "FramePool.h"
+
+#include <new> // std::bad_alloc
+#include <utility>
+
+#ifdef _WIN32
+#define NOMINMAX
+#include <windows.h>
+#else
+#include <sys/mman.h>
+#endif
+
+/// Buffer
+
+FramePool::Buffer::Buffer(Buffer&& other) noexcept :
+    m_pool(std::exchange(other.m_pool, nullptr)),
+    m_data(std::exchange(other.m_data, nullptr)),
+    m_size(std::exchange(other.m_size, 0)),
+    m_capacity(std::exchange(other.m_capacity, 0))
+{
+}
+
+FramePool::Buffer& FramePool::Buffer::operator=(Buffer&& other) noexcept
+{
+    if (this != &other) {
+        reset();
+        m_pool = std::exchange(other.m_pool, nullptr);
+        m_data = std::exchange(other.m_data, nullptr);
+        m_size = std::exchange(other.m_size, 0);
+        m_capacity = std::exchange(other.m_capacity, 0);
+    }
+    return *this;
+}
+
+void FramePool::Buffer::reset()
+{
+    if (m_data) m_pool->release(m_data, m_capacity);
+    m_pool = NULL;
+    m_data = NULL;
+    m_size = 0;
+    m_capacity = 0;
+}
+
+/// FramePool
+
+FramePool::~FramePool()
+{
+    trim();
+}
+
+size_t FramePool::size_class(size_t bytes)
+{
+    const size_t min_class = 64 * 1024;
+    if (bytes <= min_class) return min_class;
+
+    // four classes between powers of two
+    size_t power = min_class;
+    while (power * 2 <= bytes) power *= 2;
+    size_t step = power / 4;
+    return (bytes + step - 1) / step * step;
+}
+
+FramePool::Buffer FramePool::acquire(size_t bytes)
+{
+    size_t capacity = size_class(bytes);
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        auto it = m_idle.find(capacity);
+        if (it != m_idle.end() && !it->second.empty()) {
+            char* data = it->second.back();
+            it->second.pop_back();
+            m_idle_bytes -= capacity;
+            m_hits++;
+            return Buffer(this, data, bytes, capacity);
+        }
+        m_misses++;
+    }
+
+    char* data = allocate_pages(capacity);
+    if (!data) {
+        // give idle buffers of other classes back, and try again
+        trim();
+        data = allocate_pages(capacity);
+        if (!data) throw std::bad_alloc();
+    }
+
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_allocated_bytes += capacity;
+    return Buffer(this, data, bytes, capacity);
+}
+
+void FramePool::release(char* data, size_t capacity)
+{
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        if (m_idle_bytes + capacity <= max_idle) {
+            m_idle[capacity].push_back(data);
+            m_idle_bytes += capacity;
+            return;
+        }
+        m_allocated_bytes -= capacity;
+    }
+    free_pages(data, capacity);
+}
+
+void FramePool::trim()
+{
+    std::map<size_t, std::vector<char*>> idle;
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        std::swap(idle, m_idle);
+        m_allocated_bytes -= m_idle_bytes;
+        m_idle_bytes = 0;
+    }
+    for (const auto& [capacity, buffers] : idle) {
+        for (char* data : buffers) free_pages(data, capacity);
+    }
+}
+
+#ifdef _WIN32
+/// large pages need the lock pages in memory privilege: granted to the account by policy, and enabled in the process token
+/// return false when the account was not granted it
+static bool enable_lock_memory_privilege()
+{
+    HANDLE token;
+    if (!OpenProcessToken(GetCurrentProcess(), TOKEN_ADJUST_PRIVILEGES | TOKEN_QUERY, &token)) return false;
+    TOKEN_PRIVILEGES privileges{};
+    privileges.PrivilegeCount = 1;
+    privileges.Privileges[0].Attributes = SE_PRIVILEGE_ENABLED;
+    const bool enabled = LookupPrivilegeValue(NULL, SE_LOCK_MEMORY_NAME, &privileges.Privileges[0].Luid)
+        && AdjustTokenPrivileges(token, FALSE, &privileges, 0, NULL, NULL)
+        && GetLastError() == ERROR_SUCCESS; // ERROR_NOT_ALL_ASSIGNED when not granted
+    CloseHandle(token);
+    return enabled;
+}
+#endif
+
+char* FramePool::allocate_pages(size_t bytes)
+{
+#ifdef _WIN32
+    static const bool can_lock_memory = enable_lock_memory_privilege(); // once per process
+    if (huge_pages && can_lock_memory) {
+        // fails when physical memory is too fragmented
+        size_t large_page = GetLargePageMinimum();
+        if (large_page > 0) {
+            size_t rounded = (bytes + large_page - 1) / large_page * large_page;
+            if (void* data = VirtualAlloc(NULL, rounded, MEM_RESERVE | MEM_COMMIT | MEM_LARGE_PAGES, PAGE_READWRITE)) {
+                return (char*)data;
+            }
+        }
+    }
+    return (char*)VirtualAlloc(NULL, bytes, MEM_RESERVE | MEM_COMMIT, PAGE_READWRITE);
+#else
+    void* data = mmap(NULL, bytes, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (data == MAP_FAILED) return NULL;
+#ifdef MADV_HUGEPAGE
+    if (huge_pages) madvise(data, bytes, MADV_HUGEPAGE);
+#endif
+    return (char*)data;
+#endif
+}
+
+void FramePool::free_pages(char* data, size_t bytes)
+{
+#ifdef _WIN32
+    VirtualFree(data, 0, MEM_RELEASE);
+#else
+    munmap(data, bytes);
+#endif
+}
+
+size_t FramePool::idle_bytes() const
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    return m_idle_bytes;
+}
+
+size_t FramePool::allocated_bytes() const
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    return m_allocated_bytes;
+}
+
+int FramePool::hits() const
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    return m_hits;
+}
+
+int FramePool::misses() const
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    return m_misses;
+}
+
+FramePool& FramePool::global()
+{
+    // never destroyed: buffers held by other static objects are released during exit
+    static FramePool* pool = new FramePool();
+    return *pool;
+}
@@ -0,0 +1,95 @@
+#pragma once
+#include <map>
+#include <vector>
+#include <mutex>
+#include <atomic>
+#include <cstddef>
+
+/*
+Pool of large, reusable pixel buffers.
+
+Buffers are rounded up to size classes, four per power of two (so at most 25% is wasted), and returned to the
+pool when their handle is destroyed. The next request of the same class reuses the buffer, so playing a
+sequence does not allocate, and does not page fault on fresh memory for each frame.
+
+Memory comes straight from the OS in whole pages (64 byte aligned at least), optionally backed by huge pages
+(large pages on windows need the "Lock pages in memory" privilege, transparent huge pages on linux).
+Idle buffers over max_idle bytes are given back to the OS.
+
+Thread safe.
+*/
+class FramePool
+{
+public:
+    /// RAII handle of a pooled buffer. Move only, the buffer goes back to the pool on destruction.
+    class Buffer
+    {
+    private:
+        FramePool* m_pool{ NULL };
+        char* m_data{ NULL };
+        size_t m_size{ 0 };
+        size_t m_capacity{ 0 };
+
+        friend class FramePool;
+        Buffer(FramePool* pool, char* data, size_t size, size_t capacity) : m_pool(pool), m_data(data), m_size(size), m_capacity(capacity) {}
+
+    public:
+        Buffer() = default;
+        ~Buffer() { reset(); }
+
+        Buffer(Buffer&& other) noexcept;
+        Buffer& operator=(Buffer&& other) noexcept;
+        Buffer(const Buffer&) = delete;
+        Buffer& operator=(const Buffer&) = delete;
+
+        /// give the buffer back to the pool
+        void reset();
+
+        char* get() const { return m_data; }
+        char& operator[](size_t i) const { return m_data[i]; }
+        explicit operator bool() const { return m_data != NULL; }
+
+        size_t size() const { return m_size; } // requested bytes
+        size_t capacity() const { return m_capacity; } // bytes of the size class
+    };
+
+private:
+    mutable std::mutex m_mutex;
+    std::map<size_t, std::vector<char*>> m_idle; // free buffers by size class
+    size_t m_idle_bytes{ 0 };
+    size_t m_allocated_bytes{ 0 }; // from the OS, idle or in use
+    int m_hits{ 0 };
+    int m_misses{ 0 };
+
+    void release(char* data, size_t capacity);
+
+    char* allocate_pages(size_t bytes);
+    static void free_pages(char* data, size_t bytes);
+
+public:
+    std::atomic<size_t> max_idle{ size_t(2) * 1024 * 1024 * 1024 }; // idle bytes kept for reuse
+    std::atomic<bool> huge_pages{ false }; // windows: large pages, when the account was granted the lock pages in memory privilege. linux: transparent huge pages
+
+    FramePool() = default;
+    ~FramePool(); // buffers still in use must not outlive the pool
+
+    FramePool(const FramePool&) = delete;
+    FramePool& operator=(const FramePool&) = delete;
+
+    /// the size class a request is rounded up to
+    static size_t size_class(size_t bytes);
+
+    /// a buffer of at least bytes. Not zeroed. throws std::bad_alloc
+    Buffer acquire(size_t bytes);
+
+    /// give every idle buffer back to the OS eg. under memory pressure
+    void trim();
+
+    size_t idle_bytes() const;
+    size_t allocated_bytes() const;
+    int hits() const;
+    int misses() const;
+
+    /// the pool shared by the readers and caches of the process
+    static FramePool& global();
+};
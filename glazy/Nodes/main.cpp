@@ -35,6 +35,7 @@
 #include <future>
 
 #include "pathutils.h"
+#include "FrameCache.h"
 
 #include <opencv2/opencv.hpp>
 
@@ -204,8 +205,6 @@ private:
     int _F;
     std::string _cache_pattern;
 
-    using MemoryImage = std::tuple<void*, int,int,int>; //ptr, width, height, channels
-
     int _first_frame;
     int _last_frame;
     bool _is_movie;
@@ -219,10 +218,8 @@ public:
     Nodes::Attribute<int> frame;
     Nodes::Outlet<std::tuple<void*, std::tuple<int, int, int,int>>> plate_out;
 
-    void* memory;
-    size_t capacity{ 0 };
-
-    std::map<int, MemoryImage> _cache; // memory, width, height, channels
+    FrameCache _cache{ size_t(4) * 1024 * 1024 * 1024 };
+    int _direction{ 1 }; // play direction, for cache eviction
 
     int first_frame() const{
         return _first_frame;
@@ -292,28 +289,24 @@ public:
 
     ReadNode()
     {
-        // alloc default memory with a small imagesize
-        capacity = 256 * 256 * 4 * sizeof(half);
-        memory = std::malloc(capacity);
-        
         // setup inlet triggers
         file.onChange([&](std::string pattern) {
             frame.set(_first_frame);
         });
 
         frame.onChange([&](int F){
+            // a step back from the first frame to the last is still playing forward
+            bool wrapped = F == _first_frame && _F == _last_frame;
+            if (F != _F) _direction = (F > _F || wrapped) ? 1 : -1;
             _F = frame.get();
             read();
         });
     }
 
-    ~ReadNode()
-    {
-        free(memory);
-    }
-
     void read()
     {
+        _cache.set_playback(_F, _direction, _first_frame, _last_frame);
+        _cache.update_memory_pressure(); // give memory back even when every frame is cached
         if (!_cache.contains(_F))
         {
             ZoneScoped;
@@ -336,29 +329,11 @@ public:
                         return;
                     }
                     int nchannels = 4;
-                    auto required_capacity = spec.width * spec.height * nchannels * sizeof(half);
-                    if (capacity < required_capacity)
-                    {
-                        std::cout << "reader->realloc" << "\n";
-                        if (void* new_memory = std::realloc(memory, required_capacity))
-                        {
-                            memory = new_memory;
-                            capacity = required_capacity;
-                        }
-                        else {
-                            throw std::bad_alloc();
-                        }
-                    }
-
-                    if (!_current_file->read_image(frame.get(), 0, spec.nchannels, OIIO::TypeHalf, memory)) {
+                    auto img = FrameCache::make_frame(spec.width, spec.height, nchannels, sizeof(half));
+                    if (!_current_file->read_image(frame.get(), 0, spec.nchannels, OIIO::TypeHalf, img.pixels.get())) {
                         std::cout << "cant read subimage" << "\n";
                     }
-                    auto& img_cache = _cache[_F];
-                    std::get<0>(img_cache) = malloc(capacity);
-                    std::memcpy(std::get<0>(img_cache), memory, capacity);
-                    std::get<1>(img_cache) = spec.width;
-                    std::get<2>(img_cache) = spec.height;
-                    std::get<3>(img_cache) = nchannels;
+                    _cache.insert(_F, std::move(img));
                 }
             }
             else
@@ -372,44 +347,23 @@ public:
                 OIIO::ImageSpec spec = imagefile->spec();
                 int nchannels = 4;
 
-                auto required_capacity = spec.width * spec.height * nchannels * sizeof(half);
-                if (capacity < required_capacity)
-                {
-                    std::cout << "reader->realloc" << "\n";
-                    if (void* new_memory = std::realloc(memory, required_capacity))
-                    {
-                        memory = new_memory;
-                        capacity = required_capacity;
-                    }
-                    else {
-                        throw std::bad_alloc();
-                    }
-                }
-
-                imagefile->read_image(0, nchannels, OIIO::TypeHalf, memory);
-                auto& img_cache = _cache[_F];
-                std::get<0>(img_cache) = malloc(capacity);
-                std::memcpy(std::get<0>(img_cache), memory, capacity);
-                std::get<1>(img_cache) = spec.width;
-                std::get<2>(img_cache) = spec.height;
-                std::get<3>(img_cache) = nchannels;
+                // decode straight into the cached frame
+                auto img = FrameCache::make_frame(spec.width, spec.height, nchannels, sizeof(half));
+                imagefile->read_image(0, nchannels, OIIO::TypeHalf, img.pixels.get());
+                _cache.insert(_F, std::move(img));
 
                 imagefile->close();
             }
         }
 
-        auto [memory, w, h, c] = _cache.at(_F);
-        plate_out.trigger({ memory,{0,0,w,h} });
+        auto img = _cache.get(_F);
+        if (!img) return;
+        plate_out.trigger({ img->pixels.get(),{0,0,img->width,img->height} });
     }
 
     std::vector<std::tuple<int, int>> cached_range() const{
         // collect cache frame ranges
-        std::vector<int> cached_frames;
-        for (const auto& [F, img] : _cache)
-        {
-            cached_frames.push_back(F);
-        }
-        std::sort(cached_frames.begin(), cached_frames.end());
+        std::vector<int> cached_frames = _cache.frames(); // sorted
 
         std::vector<std::tuple<int, int>> ranges;
 
@@ -462,13 +416,37 @@ public:
 
         //ImGui::LabelText("filename", "%s", _filename.filename().string().c_str());
 
-        int used_memory=0;
-        for (const auto& [key, memory_img] : _cache) {
-            const auto& [mem, w,h,c] = memory_img;
-            used_memory += w * h * c * sizeof(half);
+        ImGui::LabelText("images", "%d", (int)_cache.size());
+        ImGui::LabelText("memory", "%.2f / %.2f MB", _cache.used() / pow(1000, 2), _cache.limit() / pow(1000, 2));
+        if (_cache.limit() < _cache.budget() && ImGui::IsItemHovered()) {
+            ImGui::SetTooltip("limited by system memory");
+        }
+        int budget_mb = (int)(_cache.budget() / (1000 * 1000));
+        if (ImGui::DragInt("budget", &budget_mb, 10, 64, 256 * 1000, "%d MB")) {
+            _cache.set_budget((size_t)budget_mb * 1000 * 1000);
+        }
+
+        // compressed tier
+        bool compress = _cache.compressed_budget() > 0;
+        if (ImGui::Checkbox("compress", &compress)) {
+            _cache.set_compressed_budget(compress ? size_t(8) * 1000 * 1000 * 1000 : 0);
         }
-        ImGui::LabelText("images", "%d", _cache.size());
-        ImGui::LabelText("memory", "%.2f MB", used_memory / pow(1000, 2) );
+        if (compress)
+        {
+            int compressed_budget_mb = (int)(_cache.compressed_budget() / (1000 * 1000));
+            if (ImGui::DragInt("compressed budget", &compressed_budget_mb, 10, 64, 256 * 1000, "%d MB")) {
+                _cache.set_compressed_budget((size_t)compressed_budget_mb * 1000 * 1000);
+            }
+            ImGui::LabelText("compressed", "%d images, %.2f / %.2f MB", (int)_cache.compressed_size(), _cache.compressed_used() / pow(1000, 2), _cache.compressed_limit() / pow(1000, 2));
+            ImGui::LabelText("ratio", "%.2f", _cache.compression_ratio());
+            ImGui::LabelText("compress", "%.1f ms", _cache.compress_seconds() * 1000);
+            ImGui::LabelText("decompress", "%.1f ms", _cache.decompress_seconds() * 1000);
+        }
+
+        // buffers, shared with every reader
+        auto& pool = FramePool::global();
+        ImGui::LabelText("pool", "%.2f MB (%.2f MB idle)", pool.allocated_bytes() / pow(1000, 2), pool.idle_bytes() / pow(1000, 2));
+        ImGui::LabelText("pool reuse", "%d / %d", pool.hits(), pool.hits() + pool.misses());
 
         for (const auto& inlet : plate_out.targets()) {
             ImGui::Text("inlet: %s", "target");
@@ -0,0 +1,119 @@
+#include "PlaybackClock.h"
+
+#include <algorithm>
+#include <cmath>
+
+PlaybackClock::PlaybackClock() : m_histogram(histogram_bins, 0.0f)
+{
+}
+
+void PlaybackClock::start(int frame, clock::time_point now)
+{
+    m_running = true;
+    m_start_frame = frame;
+    m_start_time = now;
+    m_due_tick = 0;
+    m_presented_tick = 0;
+    m_due_late = false;
+
+    m_last_present = now;
+    m_presents.clear();
+    m_presents.push_back(now);
+    m_intervals.clear();
+    m_interval_index = 0;
+    std::fill(m_histogram.begin(), m_histogram.end(), 0.0f);
+    m_dropped = 0;
+    m_late = 0;
+}
+
+void PlaybackClock::stop()
+{
+    m_running = false;
+}
+
+int PlaybackClock::due(clock::time_point now, int first_frame, int last_frame)
+{
+    const double elapsed = std::chrono::duration<double>(now - m_start_time).count();
+    long long tick = std::max(m_presented_tick, (long long)std::floor(elapsed * fps));
+
+    // hold: the next frame is late, move the anchor instead of skipping
+    if (!drop_frames && tick > m_presented_tick + 1)
+    {
+        const auto behind = std::chrono::duration<double>((tick - m_presented_tick - 1) * frame_duration());
+        m_start_time += std::chrono::duration_cast<clock::duration>(behind);
+        tick = m_presented_tick + 1;
+        m_due_late = true;
+    }
+    m_due_tick = tick;
+
+    const int length = last_frame - first_frame + 1;
+    if (length <= 0) return first_frame;
+    const long long position = (long long)(m_start_frame - first_frame) + tick;
+    return first_frame + (int)((position % length + length) % length);
+}
+
+void PlaybackClock::presented(clock::time_point now)
+{
+    if (m_due_tick == m_presented_tick) return;
+
+    if (drop_frames) {
+        m_dropped += (int)std::max(0LL, m_due_tick - m_presented_tick - 1);
+    }
+    else if (m_due_late) {
+        m_late++;
+    }
+    m_presented_tick = m_due_tick;
+    m_due_late = false;
+
+    // interval and its error from the frame duration
+    const float interval = (float)std::chrono::duration<double, std::milli>(now - m_last_present).count();
+    m_last_present = now;
+    const float error = interval - (float)(frame_duration() * 1000);
+    const int bin = std::clamp((int)std::lround(error) + histogram_bins / 2, 0, histogram_bins - 1);
+    m_histogram[bin]++;
+
+    if (m_intervals.size() < history) {
+        m_intervals.push_back(interval);
+    }
+    else {
+        m_intervals[m_interval_index] = interval;
+        m_interval_index = (m_interval_index + 1) % history;
+    }
+
+    m_presents.push_back(now);
+    while (now - m_presents.front() > std::chrono::seconds(1)) {
+        m_presents.pop_front();
+    }
+}
+
+PlaybackClock::clock::time_point PlaybackClock::next_tick() const
+{
+    const long long tick = m_presented_tick < m_due_tick ? m_due_tick : m_due_tick + 1;
+    return m_start_time + std::chrono::duration_cast<clock::duration>(std::chrono::duration<double>(tick * frame_duration()));
+}
+
+double PlaybackClock::achieved_fps() const
+{
+    if (m_presents.size() < 2) return 0.0;
+    const double span = std::chrono::duration<double>(m_presents.back() - m_presents.front()).count();
+    return span > 0 ? (m_presents.size() - 1) / span : 0.0;
+}
+
+double PlaybackClock::jitter() const
+{
+    if (m_intervals.empty()) return 0.0;
+    double mean = 0;
+    for (float interval : m_intervals) mean += interval;
+    mean /= m_intervals.size();
+
+    double variance = 0;
+    for (float interval : m_intervals) variance += (interval - mean) * (interval - mean);
+    return std::sqrt(variance / m_intervals.size());
+}
+
+std::vector<float> PlaybackClock::intervals() const
+{
+    std::vector<float> ordered(m_intervals.begin() + m_interval_index, m_intervals.end());
+    ordered.insert(ordered.end(), m_intervals.begin(), m_intervals.begin() + m_interval_index);
+    return ordered;
+}
@@ -0,0 +1,84 @@
+#pragma once
+#include <vector>
+#include <deque>
+#include <chrono>
+
+/*
+Picks the frame to show from the wall clock, at a fixed frame rate.
+
+Playback used to step one frame per GUI frame, so the speed followed the redraw rate and the decode time.
+The clock is anchored to a frame and a time point when playback starts; the due frame is the number of
+frame durations elapsed since, wrapped into the loop range.
+
+When the frames cannot be decoded in time:
+- drop_frames: the due frame keeps following the wall clock, the frames in between are skipped and counted.
+- otherwise every frame is shown: the due frame is never more than one past the last presented frame,
+  and the anchor slips by the time lost, so playback runs slower than the frame rate.
+
+Time points are passed in, so the clock does not read the time itself.
+*/
+class PlaybackClock
+{
+public:
+    using clock = std::chrono::steady_clock;
+
+    static constexpr int histogram_bins{ 33 }; // present interval error, 1 ms bins from -16 to +16 ms
+    static constexpr int history{ 120 }; // present intervals kept for plotting
+
+private:
+    bool m_running{ false };
+    int m_start_frame{ 0 };
+    clock::time_point m_start_time;
+
+    // frame durations since the start, not wrapped into the loop range
+    long long m_due_tick{ 0 };
+    long long m_presented_tick{ 0 };
+    bool m_due_late{ false }; // the anchor slipped to hold the due frame
+
+    // stats
+    clock::time_point m_last_present;
+    std::deque<clock::time_point> m_presents; // within the last second
+    std::vector<float> m_intervals; // ms, ring buffer of the last present intervals
+    int m_interval_index{ 0 };
+    std::vector<float> m_histogram;
+    int m_dropped{ 0 };
+    int m_late{ 0 };
+
+    double frame_duration() const { return 1.0 / fps; }
+
+public:
+    double fps{ 24.0 };
+    bool drop_frames{ true }; // false: hold each frame until it is presented
+
+    PlaybackClock();
+
+    /// anchor the clock to a frame shown at now, and reset the stats
+    void start(int frame, clock::time_point now);
+    void stop();
+    bool running() const { return m_running; }
+
+    /// the frame to show at now, in the first_frame, last_frame loop range
+    int due(clock::time_point now, int first_frame, int last_frame);
+
+    /// the frame returned by the last due() was shown, at now
+    /// a no-op when it was presented already
+    void presented(clock::time_point now);
+
+    /// when the next frame is due, eg. to sleep until then
+    /// the time of the due frame when it is not presented yet
+    clock::time_point next_tick() const;
+
+    /// frames presented in the last second, per second
+    double achieved_fps() const;
+    /// frames skipped to keep up with the clock
+    int dropped() const { return m_dropped; }
+    /// frames shown later than their time, when frames are not dropped
+    int late() const { return m_late; }
+    /// standard deviation of the present intervals, ms
+    double jitter() const;
+
+    /// ms between presents, oldest first
+    std::vector<float> intervals() const;
+    /// counts of present interval errors, histogram_bins wide, the outer bins are open ended
+    const std::vector<float>& histogram() const { return m_histogram; }
+};
@@ -17,6 +17,8 @@
 #include <tuple>
 #include <map>
 #include <array>
+#include <atomic>
+#include <chrono>
 
 // OpenGL
 #include <glad/glad.h>
@@ -159,6 +161,58 @@ namespace glazy {
 
 	bool _vsync = false;
 
+	/*
+	Idle throttling, for new_frame(true).
+	The main loop sleeps in glfwWaitEventsTimeout while nothing happens, and wakes on input, on request_redraw
+	from any thread eg. when a worker finished a frame, or when a wake_at deadline is reached eg. the next frame of a playback.
+	After waking, settle_frames more frames are drawn, as imgui widgets respond to input on the next frame.
+	The wait is at most idle_timeout, so state that is polled each frame eg. is_file_modified is still checked while idle.
+	*/
+	float idle_timeout{ 0.5f }; // seconds
+	int settle_frames{ 3 };
+	int idle_frames{ 0 }; // frames woken by the idle timeout only
+	int active_frames{ 0 }; // frames drawn for input, a redraw request or a deadline
+
+	std::atomic<bool> _redraw_requested{ false };
+	std::chrono::steady_clock::time_point _wake_time{ std::chrono::steady_clock::time_point::max() };
+	int _settle_frames_left{ 0 };
+
+	/// wake the main loop for a new frame. Safe to call from any thread
+	void request_redraw() {
+		_redraw_requested = true;
+		glfwPostEmptyEvent();
+	}
+
+	/// wake the main loop at time at the latest. Call from the main thread, each frame it is needed for
+	void wake_at(std::chrono::steady_clock::time_point time) {
+		_wake_time = std::min(_wake_time, time);
+	}
+
+	/// wait for an event, a redraw request or a deadline, unless a frame is needed right away
+	/// return true when the frame is active, false when only the idle timeout passed
+	bool _wait_events() {
+		const auto now = std::chrono::steady_clock::now();
+		const auto idle_deadline = now + std::chrono::duration_cast<std::chrono::steady_clock::duration>(std::chrono::duration<float>(idle_timeout));
+		const auto deadline = std::min(_wake_time, idle_deadline);
+		_wake_time = std::chrono::steady_clock::time_point::max();
+
+		if (_redraw_requested.exchange(false) || _settle_frames_left > 0 || deadline <= now) {
+			glfwPollEvents();
+			if (_settle_frames_left > 0) _settle_frames_left--;
+			return true;
+		}
+
+		glfwWaitEventsTimeout(std::chrono::duration<double>(deadline - now).count());
+		_redraw_requested = false;
+
+		// woken before the deadline: by input or a redraw request, let the widgets settle
+		if (std::chrono::steady_clock::now() < deadline) {
+			_settle_frames_left = settle_frames;
+			return true;
+		}
+		return deadline < idle_deadline; // the deadline of wake_at, or the idle timeout only
+	}
+
 
 	// GLuint default_program;
 
@@ -419,10 +473,11 @@ namespace glazy {
 		//ZoneNamed(HELLO, true);
 		// poll events
 		if (wait_events) {
-			glfwWaitEvents();
+			if (_wait_events()) active_frames++; else idle_frames++;
 		}
 		else {
 			glfwPollEvents();
+			active_frames++;
 		}
 
 		/********
@@ -546,6 +601,11 @@ namespace glazy {
 
 			// Show stats
 			if (stats && ImGui::Begin("stats", &stats)) {
+				ImGui::LabelText("active frames", "%d", active_frames);
+				ImGui::LabelText("idle frames", "%d", idle_frames);
+				ImGui::DragFloat("idle timeout", &idle_timeout, 0.01f, 0.01f, 5.0f, "%.2f s");
+				if (ImGui::IsItemHovered()) ImGui::SetTooltip("longest sleep between frames while nothing happens, for new_frame(true)");
+
 				std::vector<float> x_data;
 				static std::vector<float> fps_history;
 
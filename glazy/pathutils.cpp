@@ -4,6 +4,20 @@
 #include <cassert>
 #include <cstdio> // printf sprintf snprintf
 #include <regex>
+#include <cstdlib> // getenv
+#include <algorithm>
+#include <utility> // exchange
+
+#ifdef _WIN32
+#define NOMINMAX
+#include <windows.h>
+#else
+#include <sys/inotify.h>
+#include <sys/vfs.h> // statfs
+#include <poll.h>
+#include <unistd.h>
+#endif
+#include <chrono>
 
 std::string to_string(std::vector<std::filesystem::path> sequence) {
     // collect frame numbers
@@ -117,4 +131,395 @@ std::filesystem::path sequence_item(const std::filesystem::path& pattern, int F)
 
     auto filename = std::string(buf.get(), buf.get() + size - 1);
     return std::filesystem::path(filename);
-}
\ No newline at end of file
+}
+
+std::filesystem::path cache_directory()
+{
+    std::filesystem::path root;
+#ifdef _WIN32
+    char* local_app_data = NULL;
+    size_t len = 0;
+    if (_dupenv_s(&local_app_data, &len, "LOCALAPPDATA") == 0 && local_app_data != NULL) {
+        root = local_app_data;
+        free(local_app_data);
+    }
+#else
+    if (const char* xdg_cache_home = std::getenv("XDG_CACHE_HOME")) {
+        root = xdg_cache_home;
+    }
+    else if (const char* home = std::getenv("HOME")) {
+        root = std::filesystem::path(home) / ".cache";
+    }
+#endif
+    if (root.empty()) {
+        root = std::filesystem::temp_directory_path();
+    }
+
+    auto dir = root / "glazy";
+    std::error_code ec;
+    std::filesystem::create_directories(dir, ec);
+    return dir;
+}
+
+/// SequenceScanner
+
+SequenceScanner::SequenceScanner(const std::filesystem::path& pattern, int first_frame, int last_frame, bool watch)
+{
+    m_folder = pattern.parent_path();
+    if (m_folder.empty()) m_folder = ".";
+
+    static std::regex format_re("^(.*)%0([0-9]+)d(.*)$");
+    std::smatch m;
+    auto filename = pattern.filename().string();
+    if (std::regex_match(filename, m, format_re)) {
+        m_prefix = m[1];
+        m_digits = std::stoi(m[2]);
+        m_suffix = m[3];
+    }
+    else {
+        m_prefix = filename;
+    }
+
+    m_first_frame = first_frame;
+    m_present.resize(std::max(1, last_frame - first_frame + 1), false);
+    rescan();
+
+    if (watch) {
+        m_watcher = std::thread(&SequenceScanner::watch_loop, this);
+    }
+}
+
+SequenceScanner::~SequenceScanner()
+{
+    m_stop = true;
+    if (m_watcher.joinable()) m_watcher.join();
+}
+
+int SequenceScanner::match(const std::string& filename) const
+{
+    if (m_digits == 0) {
+        std::lock_guard<std::mutex> lock(m_mutex); // the first frame is written by set_present and rescan
+        return filename == m_prefix ? m_first_frame : -1;
+    }
+
+    if (filename.size() != m_prefix.size() + m_digits + m_suffix.size()) return -1;
+    if (!starts_with(filename, m_prefix) || filename.compare(filename.size() - m_suffix.size(), m_suffix.size(), m_suffix) != 0) return -1;
+    auto digits = filename.substr(m_prefix.size(), m_digits);
+    if (!std::all_of(digits.begin(), digits.end(), [](char c) { return c >= '0' && c <= '9'; })) return -1;
+    return std::stoi(digits);
+}
+
+void SequenceScanner::set_present(int F, bool present)
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+
+    // grow the range to frames outside of it
+    if (F < m_first_frame) {
+        if (!present) return;
+        m_present.insert(m_present.begin(), m_first_frame - F, false);
+        m_first_frame = F;
+    }
+    if (F >= m_first_frame + (int)m_present.size()) {
+        if (!present) return;
+        m_present.resize(F - m_first_frame + 1, false);
+    }
+
+    if (m_present[F - m_first_frame] != present) {
+        m_present[F - m_first_frame] = present;
+        m_version++;
+        if (m_on_change) m_on_change();
+    }
+}
+
+void SequenceScanner::set_written(int F)
+{
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        int i = F - m_first_frame;
+        if (i >= 0 && i < m_present.size() && m_present[i]) {
+            if (std::find(m_modified.begin(), m_modified.end(), F) == m_modified.end()) m_modified.push_back(F);
+            m_version++;
+            if (m_on_change) m_on_change();
+            return;
+        }
+    }
+    set_present(F, true);
+}
+
+std::vector<int> SequenceScanner::take_modified()
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    return std::exchange(m_modified, {});
+}
+
+void SequenceScanner::rescan()
+{
+    // a listing cannot tell a frame that is still being written from a complete one.
+    // when polling, the size and write time of each frame are compared to the previous listing instead
+    const bool polling = m_polling;
+    std::vector<int> frames;
+    std::map<int, FileStat> listed;
+    std::error_code ec;
+    for (auto it = std::filesystem::directory_iterator(m_folder, std::filesystem::directory_options::skip_permission_denied, ec); !ec && it != std::filesystem::directory_iterator(); it.increment(ec)) {
+        try {
+            int F = match(it->path().filename().string());
+            if (F < 0) continue;
+            frames.push_back(F);
+            if (polling) {
+                std::error_code stat_ec;
+                listed[F] = { it->file_size(stat_ec), it->last_write_time(stat_ec) };
+            }
+        }
+        catch (const std::system_error& ex) {
+            std::cout << "Exception: " << ex.what() << "\n-  probably std::filesystem does not support Unicode filenames" << std::endl;
+        }
+    }
+
+    std::lock_guard<std::mutex> lock(m_mutex);
+    int first_frame = m_first_frame;
+    size_t size = m_present.size();
+    if (!frames.empty()) {
+        // grow the range to frames outside of it
+        auto [min_frame, max_frame] = std::minmax_element(frames.begin(), frames.end());
+        first_frame = std::min(first_frame, *min_frame);
+        size = std::max(m_first_frame + (int)size, *max_frame + 1) - first_frame;
+    }
+    std::vector<bool> present(size, false);
+    for (int F : frames) present[F - first_frame] = true;
+
+    bool modified = false;
+    if (polling) {
+        for (const auto& [F, stat] : listed) {
+            auto last = m_listed.find(F);
+            if (last == m_listed.end() || last->second != stat) {
+                // still being written: a new frame waits for the next listing, a present one keeps its old pixels until then
+                int i = F - m_first_frame;
+                present[F - first_frame] = i >= 0 && i < m_present.size() && m_present[i];
+                continue;
+            }
+            auto settled = m_settled.find(F);
+            if (settled != m_settled.end() && settled->second != stat && present[F - first_frame]) {
+                if (std::find(m_modified.begin(), m_modified.end(), F) == m_modified.end()) m_modified.push_back(F);
+                modified = true;
+            }
+            m_settled[F] = stat;
+        }
+        std::erase_if(m_settled, [&](const auto& item) { return !listed.contains(item.first); });
+        m_listed = std::move(listed);
+    }
+
+    // polled folders are listed every few seconds, only changes wake the viewer
+    if (!modified && first_frame == m_first_frame && present == m_present) return;
+    m_first_frame = first_frame;
+    m_present = std::move(present);
+    m_version++;
+    if (m_on_change) m_on_change();
+}
+
+void SequenceScanner::set_on_change(std::function<void()> callback)
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_on_change = callback;
+}
+
+bool SequenceScanner::exists(int F) const
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    int i = F - m_first_frame;
+    return i >= 0 && i < m_present.size() && m_present[i];
+}
+
+std::vector<int> SequenceScanner::missing_frames() const
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    std::vector<int> missing;
+    for (auto i = 0; i < m_present.size(); i++) {
+        if (!m_present[i]) missing.push_back(m_first_frame + i);
+    }
+    return missing;
+}
+
+std::tuple<int, int> SequenceScanner::range() const
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    return { m_first_frame, m_first_frame + (int)m_present.size() - 1 };
+}
+
+/// true when folder is on a network share
+static bool is_remote_folder(const std::filesystem::path& folder)
+{
+#ifdef _WIN32
+    std::error_code ec;
+    auto root = std::filesystem::absolute(folder, ec).root_path().wstring();
+    if (root.starts_with(L"\\\\")) return true; // UNC path
+    return GetDriveTypeW(root.c_str()) == DRIVE_REMOTE;
+#elif defined(__linux__)
+    struct statfs fs;
+    if (statfs(folder.c_str(), &fs) != 0) return false;
+    switch ((uint32_t)fs.f_type) {
+    case 0x6969: // NFS
+    case 0x517B: // SMB
+    case 0xFF534D42: // CIFS
+    case 0xFE534D42: // SMB2
+    case 0x65735546: // FUSE eg. sshfs
+        return true;
+    default:
+        return false;
+    }
+#else
+    return false;
+#endif
+}
+
+void SequenceScanner::watch_loop()
+{
+    if (!is_remote_folder(m_folder)) watch_notifications();
+    if (m_stop) return;
+
+    // no notifications: list the folder regularly
+    m_watching = false;
+    m_polling = true;
+    auto next_scan = std::chrono::steady_clock::now() + std::chrono::milliseconds(poll_interval_ms);
+    while (!m_stop)
+    {
+        std::this_thread::sleep_for(std::chrono::milliseconds(200)); // check for m_stop
+        if (std::chrono::steady_clock::now() < next_scan) continue;
+        rescan();
+        next_scan = std::chrono::steady_clock::now() + std::chrono::milliseconds(poll_interval_ms);
+    }
+}
+
+void SequenceScanner::watch_notifications()
+{
+    // wake up regularly to check for m_stop
+    const int timeout_ms = 200;
+
+#ifdef _WIN32
+    HANDLE dir = CreateFileW(m_folder.wstring().c_str(), FILE_LIST_DIRECTORY, FILE_SHARE_READ | FILE_SHARE_WRITE | FILE_SHARE_DELETE,
+        NULL, OPEN_EXISTING, FILE_FLAG_BACKUP_SEMANTICS | FILE_FLAG_OVERLAPPED, NULL);
+    if (dir == INVALID_HANDLE_VALUE) return;
+
+    OVERLAPPED overlapped{};
+    overlapped.hEvent = CreateEvent(NULL, TRUE, FALSE, NULL);
+    alignas(DWORD) char buffer[16 * 1024];
+
+    auto listen = [&]() {
+        ResetEvent(overlapped.hEvent);
+        return ReadDirectoryChangesW(dir, buffer, sizeof(buffer), FALSE,
+            FILE_NOTIFY_CHANGE_FILE_NAME | FILE_NOTIFY_CHANGE_LAST_WRITE | FILE_NOTIFY_CHANGE_SIZE, NULL, &overlapped, NULL);
+    };
+
+    // files are reported when they are created, and on every write.
+    // they count once their size and write time stopped changing for settle_ms
+    struct Pending {
+        std::filesystem::path path;
+        FileStat stat;
+        std::chrono::steady_clock::time_point since;
+    };
+    std::map<int, Pending> pending;
+    auto settle = [&]() {
+        auto now = std::chrono::steady_clock::now();
+        for (auto it = pending.begin(); it != pending.end();) {
+            std::error_code ec;
+            FileStat stat{ std::filesystem::file_size(it->second.path, ec), std::filesystem::last_write_time(it->second.path, ec) };
+            if (ec) {
+                it = pending.erase(it); // removed meanwhile
+            }
+            else if (stat != it->second.stat) {
+                it->second.stat = stat;
+                it->second.since = now;
+                ++it;
+            }
+            else if (now - it->second.since >= std::chrono::milliseconds(settle_ms)) {
+                set_written(it->first);
+                it = pending.erase(it);
+            }
+            else {
+                ++it;
+            }
+        }
+    };
+
+    m_watching = listen();
+    if (m_watching) rescan(); // catch frames written before the watch started
+    while (m_watching && !m_stop)
+    {
+        settle();
+        if (WaitForSingleObject(overlapped.hEvent, timeout_ms) != WAIT_OBJECT_0) continue;
+
+        DWORD bytes = 0;
+        if (!GetOverlappedResult(dir, &overlapped, &bytes, FALSE)) break;
+
+        if (bytes == 0) {
+            rescan(); // the buffer overflowed, changes were lost
+        }
+        else {
+            for (auto info = (FILE_NOTIFY_INFORMATION*)buffer;; info = (FILE_NOTIFY_INFORMATION*)((char*)info + info->NextEntryOffset))
+            {
+                auto name = std::filesystem::path(std::wstring(info->FileName, info->FileNameLength / sizeof(WCHAR)));
+                int F = match(name.string());
+                if (F >= 0) {
+                    if (info->Action == FILE_ACTION_ADDED || info->Action == FILE_ACTION_MODIFIED || info->Action == FILE_ACTION_RENAMED_NEW_NAME) {
+                        auto [it, inserted] = pending.try_emplace(F, Pending{ m_folder / name });
+                        it->second.since = std::chrono::steady_clock::now();
+                    }
+                    if (info->Action == FILE_ACTION_REMOVED || info->Action == FILE_ACTION_RENAMED_OLD_NAME) {
+                        pending.erase(F);
+                        set_present(F, false);
+                    }
+                }
+                if (info->NextEntryOffset == 0) break;
+            }
+        }
+        m_watching = listen();
+    }
+
+    // the pending read writes to buffer, wait for it to cancel
+    CancelIo(dir);
+    DWORD bytes;
+    GetOverlappedResult(dir, &overlapped, &bytes, TRUE);
+    CloseHandle(overlapped.hEvent);
+    CloseHandle(dir);
+#elif defined(__linux__)
+    int fd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+    if (fd < 0) return;
+    // frames count once they are written completely, or moved in place
+    int wd = inotify_add_watch(fd, m_folder.c_str(), IN_CLOSE_WRITE | IN_MOVED_TO | IN_DELETE | IN_MOVED_FROM | IN_DELETE_SELF);
+    if (wd < 0) {
+        close(fd);
+        return;
+    }
+
+    m_watching = true;
+    rescan(); // catch frames written before the watch started
+    alignas(inotify_event) char buffer[16 * 1024];
+    while (m_watching && !m_stop)
+    {
+        pollfd pfd{ fd, POLLIN, 0 };
+        if (poll(&pfd, 1, timeout_ms) <= 0) continue;
+
+        ssize_t len = read(fd, buffer, sizeof(buffer));
+        for (char* ptr = buffer; len > 0 && ptr < buffer + len;)
+        {
+            auto event = (const inotify_event*)ptr;
+            ptr += sizeof(inotify_event) + event->len;
+
+            if (event->mask & IN_Q_OVERFLOW) {
+                rescan(); // changes were lost
+                continue;
+            }
+            if (event->mask & (IN_DELETE_SELF | IN_IGNORED)) {
+                m_watching = false; // the folder is gone
+                break;
+            }
+            if (event->len == 0) continue;
+
+            int F = match(event->name);
+            if (F < 0) continue;
+            if (event->mask & (IN_CLOSE_WRITE | IN_MOVED_TO)) set_written(F);
+            if (event->mask & (IN_DELETE | IN_MOVED_FROM)) set_present(F, false);
+        }
+    }
+    close(fd);
+#endif
+}
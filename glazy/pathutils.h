@@ -3,6 +3,11 @@
 #include <filesystem>
 #include <string>
 #include <vector>
+#include <thread>
+#include <mutex>
+#include <atomic>
+#include <functional>
+#include <map>
 
 /*
 * Find the image sequence on disk from a single frame
@@ -28,4 +33,88 @@ std::vector<std::filesystem::path> enumerate_sequence(const std::tuple<std::file
 
 std::string to_string(std::vector<std::filesystem::path> sequence);
 
+/*
+return the per user cache directory of glazy, such as %LOCALAPPDATA%/glazy or ~/.cache/glazy
+the directory is created when it does not exist yet
+*/
+std::filesystem::path cache_directory();
+
+/*
+Keep track of the frames of a sequence that exist on disk.
+The folder is listed once, and then updated from file system notifications on a background thread
+(ReadDirectoryChangesW on windows, inotify on linux) instead of a stat call per frame.
+Frames that appear outside of the range extend it, so a sequence that is still rendering can be followed.
+A frame counts once it is written completely, and frames rewritten in place are reported by take_modified.
+Network shares accept a watch but never report changes made by other machines, so they, and folders that cannot be
+watched, are listed again every poll_interval_ms instead.
+
+pattern: such as "image.%04d.tif", as returned by sequence_from_item
+*/
+class SequenceScanner
+{
+private:
+    // set once by the constructor
+    std::filesystem::path m_folder;
+    std::string m_prefix; // filename before the frame number
+    std::string m_suffix; // filename after the frame number
+    int m_digits{ 0 }; // 0 when the pattern is a single file
+
+    mutable std::mutex m_mutex;
+    int m_first_frame;
+    std::vector<bool> m_present; // by frame - m_first_frame
+    std::atomic<size_t> m_version{ 0 }; // bumped on every change
+    std::function<void()> m_on_change;
+    std::vector<int> m_modified; // frames rewritten since the last take_modified
+
+    /// size and write time of a file, a frame is complete once they stop changing
+    using FileStat = std::pair<uintmax_t, std::filesystem::file_time_type>;
+    std::map<int, FileStat> m_listed; // polling: each frame at the last listing
+    std::map<int, FileStat> m_settled; // polling: each frame when it was last found complete
+
+    std::thread m_watcher;
+    std::atomic<bool> m_stop{ false };
+    std::atomic<bool> m_watching{ false };
+    std::atomic<bool> m_polling{ false };
+
+    /// frame number of a filename in the folder, or -1 when it is not part of the sequence
+    int match(const std::string& filename) const;
+    void set_present(int F, bool present);
+    /// a frame was written completely: it becomes present, or is reported modified when it was present already
+    void set_written(int F);
+    void watch_loop();
+    /// follow file system notifications, until stopped or the watch fails
+    void watch_notifications();
+
+public:
+    static constexpr int poll_interval_ms{ 2000 };
+    /// windows reports a file when it is created, it counts once its size and write time did not change for this long
+    static constexpr int settle_ms{ 1000 };
+
+    SequenceScanner(const std::filesystem::path& pattern, int first_frame, int last_frame, bool watch = true);
+    ~SequenceScanner();
+
+    SequenceScanner(const SequenceScanner&) = delete;
+    SequenceScanner& operator=(const SequenceScanner&) = delete;
+
+    /// list the folder again eg. when notifications were lost
+    void rescan();
+
+    bool exists(int F) const;
+    std::vector<int> missing_frames() const;
+    std::tuple<int, int> range() const;
+
+    /// changes whenever a frame appears, disappears or is rewritten
+    size_t version() const { return m_version; }
+
+    /// frames rewritten in place since the last call, eg. to drop them from caches
+    std::vector<int> take_modified();
+
+    /// called after a frame appears, disappears or is rewritten, on the watcher thread eg. to wake an idle main loop
+    void set_on_change(std::function<void()> callback);
+
+    /// false when the platform, or the file system does not support notifications eg. on a network share
+    bool watching() const { return m_watching; }
 
+    /// true when the folder is listed regularly, instead of watched
+    bool polling() const { return m_polling; }
+};
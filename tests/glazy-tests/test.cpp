@@ -7,7 +7,14 @@
 
 #include "stringutils.h"
 #include "pathutils.h"
+#include "FrameCache.h"
+#include "FramePool.h"
+#include "PlaybackClock.h"
 #include <filesystem>
+#include <fstream>
+#include <cstring>
+#include <thread>
+#include <chrono>
 
 namespace fs = std::filesystem;
 
@@ -98,4 +105,253 @@ TEST(SequenceFromPattern, test_mispelled_patternformat)
 			throw;
 		}
 	}, std::filesystem::filesystem_error);
-}
\ No newline at end of file
+}
+
+TEST(CacheDirectory, test_cache_directory_exists)
+{
+	auto dir = cache_directory();
+	EXPECT_TRUE(dir.is_absolute());
+	EXPECT_TRUE(fs::is_directory(dir));
+}
+
+TEST(SequenceScanner, test_missing_frames)
+{
+	auto folder = fs::temp_directory_path() / "glazy-sequence-scanner";
+	fs::remove_all(folder);
+	fs::create_directories(folder);
+	for (auto name : { "frame.0001.exr", "frame.0002.exr", "frame.0004.exr", "other.0003.exr" }) {
+		std::ofstream(folder / name) << "x";
+	}
+
+	SequenceScanner scanner(folder / "frame.%04d.exr", 1, 4, false);
+	EXPECT_EQ(scanner.missing_frames(), std::vector<int>({ 3 }));
+	EXPECT_TRUE(scanner.exists(4));
+
+	// frames outside of the range extend it
+	std::ofstream(folder / "frame.0006.exr") << "x";
+	fs::remove(folder / "frame.0001.exr");
+	scanner.rescan();
+	EXPECT_EQ(scanner.range(), std::tuple(1, 6));
+	EXPECT_EQ(scanner.missing_frames(), std::vector<int>({ 1, 3, 5 }));
+
+	fs::remove_all(folder);
+}
+
+TEST(SequenceScanner, test_reports_rewritten_frames)
+{
+	auto folder = fs::temp_directory_path() / "glazy-sequence-scanner-rewrite";
+	fs::remove_all(folder);
+	fs::create_directories(folder);
+	std::ofstream(folder / "frame.0001.exr") << "x";
+
+	SequenceScanner scanner(folder / "frame.%04d.exr", 1, 2, true);
+	auto wait_for = [](auto condition) {
+		auto deadline = std::chrono::steady_clock::now() + std::chrono::seconds(15);
+		while (!condition() && std::chrono::steady_clock::now() < deadline) std::this_thread::sleep_for(std::chrono::milliseconds(50));
+		return condition();
+	};
+	ASSERT_TRUE(wait_for([&]() { return scanner.watching() || scanner.polling(); }));
+	if (scanner.polling()) std::this_thread::sleep_for(std::chrono::milliseconds(2 * SequenceScanner::poll_interval_ms + 500)); // the first listings record the frame
+
+	std::ofstream(folder / "frame.0001.exr") << "xy";
+	std::vector<int> modified;
+	EXPECT_TRUE(wait_for([&]() { auto frames = scanner.take_modified(); modified.insert(modified.end(), frames.begin(), frames.end()); return !modified.empty(); }));
+	EXPECT_EQ(modified, std::vector<int>({ 1 }));
+
+	// a new frame is present, not modified
+	std::ofstream(folder / "frame.0002.exr") << "x";
+	EXPECT_TRUE(wait_for([&]() { return scanner.exists(2); }));
+	EXPECT_TRUE(scanner.take_modified().empty());
+
+	fs::remove_all(folder);
+}
+
+TEST(FrameCache, test_evicts_frames_just_played)
+{
+	FrameCache cache(4 * 100);
+	cache.headroom = 0;
+	cache.set_playback(5, 1, 1, 10);
+	for (int F : { 3, 4, 5, 6, 7 }) {
+		cache.insert(F, FrameCache::make_frame(10, 10, 1, 1));
+	}
+	EXPECT_EQ(cache.frames(), std::vector<int>({ 3, 5, 6, 7 }));
+	EXPECT_EQ(cache.used(), 400);
+
+	// playing backwards, the frames after the playhead were just played
+	cache.set_playback(5, -1, 1, 10);
+	cache.insert(2, FrameCache::make_frame(10, 10, 1, 1));
+	EXPECT_EQ(cache.frames(), std::vector<int>({ 2, 3, 5, 7 }));
+}
+
+TEST(FrameCache, test_shrinking_budget_evicts)
+{
+	FrameCache cache(1000);
+	cache.headroom = 0;
+	cache.set_playback(1, 1, 1, 4);
+	for (int F : { 1, 2, 3, 4 }) {
+		cache.insert(F, FrameCache::make_frame(10, 10, 1, 1));
+	}
+	cache.set_budget(200);
+	EXPECT_EQ(cache.frames(), std::vector<int>({ 1, 2 }));
+	EXPECT_EQ(cache.used(), 200);
+	EXPECT_EQ(cache.get(3), nullptr);
+}
+
+TEST(FrameCache, test_memory_pressure_evicts)
+{
+	FrameCache cache(1000);
+	size_t available = 10000;
+	cache.memory_available = [&]() { return available; };
+	cache.headroom = 500;
+	cache.set_playback(1, 1, 1, 4);
+	for (int F : { 1, 2, 3, 4 }) {
+		cache.insert(F, FrameCache::make_frame(10, 10, 1, 1));
+	}
+	EXPECT_EQ(cache.used(), 400);
+
+	// 250 bytes short of the headroom, the frames furthest ahead are given back
+	available = 250;
+	std::this_thread::sleep_for(std::chrono::milliseconds(300)); // checks are throttled
+	cache.update_memory_pressure();
+	EXPECT_EQ(cache.limit(), 150);
+	EXPECT_EQ(cache.frames(), std::vector<int>({ 1 }));
+
+	// the limit grows back with the memory
+	available = 10000;
+	std::this_thread::sleep_for(std::chrono::milliseconds(300));
+	cache.update_memory_pressure();
+	EXPECT_EQ(cache.limit(), 1000);
+}
+
+TEST(FrameCache, test_compress_roundtrip)
+{
+	auto frame = FrameCache::make_frame(33, 17, 4, 2);
+	for (size_t i = 0; i < frame.bytes; i++) {
+		frame.pixels[i] = (char)(i * 7 % 251);
+	}
+
+	auto compressed = FrameCache::compress(frame, 4);
+	EXPECT_EQ(compressed.chunks.size(), 4);
+	auto restored = FrameCache::decompress(compressed, 4);
+	ASSERT_EQ(restored.bytes, frame.bytes);
+	EXPECT_EQ(std::memcmp(restored.pixels.get(), frame.pixels.get(), frame.bytes), 0);
+}
+
+TEST(FrameCache, test_compressed_tier_keeps_evicted_frames)
+{
+	FrameCache cache(200);
+	cache.headroom = 0;
+	cache.set_compressed_budget(100 * 1000);
+	cache.set_playback(1, 1, 1, 10);
+	for (int F = 1; F <= 5; F++) {
+		auto frame = FrameCache::make_frame(10, 10, 1, 1);
+		std::memset(frame.pixels.get(), F, frame.bytes);
+		cache.insert(F, std::move(frame));
+	}
+	EXPECT_EQ(cache.size(), 2);
+	EXPECT_EQ(cache.frames(), std::vector<int>({ 1, 2, 3, 4, 5 }));
+
+	auto frame = cache.get(3);
+	ASSERT_NE(frame, nullptr);
+	EXPECT_EQ(frame->pixels[50], 3);
+}
+
+TEST(FrameCache, test_takes_back_frames_being_compressed)
+{
+	FrameCache cache(100);
+	cache.headroom = 0;
+	cache.set_compressed_budget(100 * 1000);
+	cache.set_playback(1, 1, 1, 10);
+	for (int F = 1; F <= 2; F++) {
+		auto frame = FrameCache::make_frame(10, 10, 1, 1);
+		std::memset(frame.pixels.get(), F, frame.bytes);
+		cache.insert(F, std::move(frame));
+	}
+	EXPECT_TRUE(cache.contains(1)); // compressed in the background, or already in the compressed tier
+
+	auto frame = cache.get(1);
+	ASSERT_NE(frame, nullptr);
+	EXPECT_EQ(frame->pixels[99], 1);
+	EXPECT_EQ(cache.compressed_size(), 1); // the compressed copy is kept
+
+	cache.clear();
+	EXPECT_EQ(cache.compressing(), 0);
+	EXPECT_TRUE(cache.frames().empty());
+}
+
+TEST(FramePool, test_size_classes)
+{
+	EXPECT_EQ(FramePool::size_class(1), 64 * 1024);
+	EXPECT_EQ(FramePool::size_class(1024 * 1024), 1024 * 1024);
+	EXPECT_EQ(FramePool::size_class(1024 * 1024 + 1), 1024 * 1024 + 256 * 1024);
+	EXPECT_EQ(FramePool::size_class(3840 * 2160 * 4 * 2), 64 * 1024 * 1024); // 4K half RGBA
+}
+
+TEST(FramePool, test_reuses_released_buffers)
+{
+	FramePool pool;
+	char* first;
+	{
+		auto buffer = pool.acquire(1000 * 1000);
+		first = buffer.get();
+		EXPECT_EQ(reinterpret_cast<uintptr_t>(first) % 64, 0);
+		EXPECT_EQ(buffer.size(), 1000 * 1000);
+	}
+	EXPECT_EQ(pool.idle_bytes(), FramePool::size_class(1000 * 1000));
+
+	// same size class
+	auto buffer = pool.acquire(950 * 1000);
+	EXPECT_EQ(buffer.get(), first);
+	EXPECT_EQ(pool.hits(), 1);
+
+	auto moved = std::move(buffer);
+	EXPECT_FALSE(buffer);
+	moved.reset();
+	pool.trim();
+	EXPECT_EQ(pool.idle_bytes(), 0);
+	EXPECT_EQ(pool.allocated_bytes(), 0);
+}
+
+/// the wall clock time of frames at 24 fps after t0
+static PlaybackClock::clock::time_point at_frame(double frames)
+{
+	auto seconds = std::chrono::duration<double>(frames / 24.0);
+	return PlaybackClock::clock::time_point{} + std::chrono::duration_cast<PlaybackClock::clock::duration>(seconds);
+}
+
+TEST(PlaybackClock, test_drops_frames_to_keep_time)
+{
+	PlaybackClock clock;
+	clock.start(10, at_frame(0));
+	EXPECT_EQ(clock.due(at_frame(0.5), 10, 20), 10);
+	EXPECT_EQ(clock.due(at_frame(1.5), 10, 20), 11);
+	clock.presented(at_frame(1.5));
+	EXPECT_EQ(clock.due(at_frame(4.5), 10, 20), 14);
+	clock.presented(at_frame(4.5));
+	EXPECT_EQ(clock.dropped(), 2);
+
+	// wraps into the loop range
+	EXPECT_EQ(clock.due(at_frame(12.5), 10, 20), 11);
+	EXPECT_EQ(clock.next_tick(), at_frame(12));
+	clock.presented(at_frame(12.5));
+	EXPECT_EQ(clock.next_tick(), at_frame(13));
+}
+
+TEST(PlaybackClock, test_holds_late_frames)
+{
+	PlaybackClock clock;
+	clock.drop_frames = false;
+	clock.start(10, at_frame(0));
+	EXPECT_EQ(clock.due(at_frame(1.5), 10, 20), 11);
+	clock.presented(at_frame(1.5));
+
+	// a slow frame: the next one is shown, late
+	EXPECT_EQ(clock.due(at_frame(4.5), 10, 20), 12);
+	clock.presented(at_frame(4.5));
+	EXPECT_EQ(clock.dropped(), 0);
+	EXPECT_EQ(clock.late(), 1);
+
+	// and the clock continues from there
+	EXPECT_EQ(clock.due(at_frame(4.9), 10, 20), 12);
+	EXPECT_EQ(clock.due(at_frame(5.6), 10, 20), 13);
+}